@@ -249,6 +249,14 @@ po::options_description get_fscp_options()
 	("fscp.listen_on", po::value<asiotap::endpoint>()->default_value(asiotap::ipv4_endpoint(boost::asio::ip::address_v4::any(), 12000)), "The endpoint to listen on.")
 	("fscp.listen_on_device", po::value<std::string>()->default_value(std::string()), "The endpoint to listen on.")
 	("fscp.hello_timeout", po::value<millisecond_duration>()->default_value(3000), "The default timeout for HELLO messages, in milliseconds.")
+	("fscp.keep_alive_period", po::value<millisecond_duration>()->default_value(fscp::SESSION_KEEP_ALIVE_PERIOD.total_milliseconds()), "The time after which a keep-alive is sent to an idle peer, in milliseconds.")
+	("fscp.session_timeout", po::value<millisecond_duration>()->default_value(fscp::SESSION_TIMEOUT.total_milliseconds()), "The time after which a silent peer loses its session, in milliseconds.")
+	("fscp.rekey_threshold", po::value<fscp::sequence_number_type>()->default_value(fscp::SESSION_REKEY_THRESHOLD), "The sequence number after which a session is renewed.")
+	("fscp.compact_data_framing", po::value<bool>()->default_value(false, "no"), "Whether to use the compact data framing with the hosts that support it.")
+	("fscp.path_mtu_discovery", po::value<bool>()->default_value(true, "yes"), "Whether to discover the path MTU to the hosts that support it.")
+	("fscp.fragmentation", po::value<bool>()->default_value(true, "yes"), "Whether to fragment the datagrams that exceed the path MTU to the hosts that support it.")
+	("fscp.data_aggregation", po::value<bool>()->default_value(false, "no"), "Whether to pack small frames sent to a same host into a single message.")
+	("fscp.data_aggregation_delay", po::value<unsigned int>()->default_value(0), "The maximum time a frame waits to be aggregated, in microseconds.")
 	("fscp.contact", po::value<std::vector<asiotap::endpoint> >()->multitoken()->zero_tokens()->default_value(std::vector<asiotap::endpoint>(), ""), "The address of an host to contact.")
 	("fscp.accept_contact_requests", po::value<bool>()->default_value(true, "yes"), "Whether to accept CONTACT-REQUEST messages.")
 	("fscp.accept_contacts", po::value<bool>()->default_value(true, "yes"), "Whether to accept CONTACT messages.")
@@ -298,6 +306,8 @@ po::options_description get_tap_adapter_options()
 	("tap_adapter.remote_ipv4_address", po::value<asiotap::ipv4_network_address>(), "The tap adapter IPv4 remote address.")
 	("tap_adapter.arp_proxy_enabled", po::value<bool>()->default_value(false), "Whether to enable the ARP proxy.")
 	("tap_adapter.arp_proxy_fake_ethernet_address", po::value<fl::tap_adapter_configuration::ethernet_address_type>()->default_value(boost::lexical_cast<fl::tap_adapter_configuration::ethernet_address_type>("00:aa:bb:cc:dd:ee")), "The ARP proxy fake ethernet address.")
+	("tap_adapter.ndp_proxy_enabled", po::value<bool>()->default_value(false), "Whether to enable the NDP proxy.")
+	("tap_adapter.ndp_proxy_fake_ethernet_address", po::value<fl::tap_adapter_configuration::ethernet_address_type>()->default_value(boost::lexical_cast<fl::tap_adapter_configuration::ethernet_address_type>("00:aa:bb:cc:dd:ee")), "The NDP proxy fake ethernet address.")
 	("tap_adapter.dhcp_proxy_enabled", po::value<bool>()->default_value(true), "Whether to enable the DHCP proxy.")
 	("tap_adapter.dhcp_server_ipv4_address_prefix_length", po::value<asiotap::ipv4_network_address>()->default_value(default_dhcp_ipv4_network_address), "The DHCP proxy server IPv4 address and prefix length.")
 	("tap_adapter.dhcp_server_ipv6_address_prefix_length", po::value<asiotap::ipv6_network_address>()->default_value(default_dhcp_ipv6_network_address), "The DHCP proxy server IPv6 address and prefix length.")
@@ -315,6 +325,15 @@ po::options_description get_switch_options()
 	result.add_options()
 	("switch.routing_method", po::value<fl::switch_configuration::routing_method_type>()->default_value(fl::switch_configuration::RM_SWITCH), "The routing method for messages.")
 	("switch.relay_mode_enabled", po::value<bool>()->default_value(false, "no"), "Whether to enable the relay mode.")
+	("switch.multicast_snooping_enabled", po::value<bool>()->default_value(false, "no"), "Whether to enable IGMP/MLD snooping.")
+	("switch.multicast_membership_timeout", po::value<millisecond_duration>()->default_value(260000), "The multicast membership timeout, in milliseconds.")
+	("switch.arp_suppression_enabled", po::value<bool>()->default_value(false, "no"), "Whether to enable ARP suppression.")
+	("switch.arp_binding_timeout", po::value<millisecond_duration>()->default_value(300000), "The ARP binding timeout, in milliseconds.")
+	("switch.broadcast_rate_limit", po::value<unsigned int>()->default_value(0), "The maximum broadcast frames rate per port, in frames per second.")
+	("switch.multicast_rate_limit", po::value<unsigned int>()->default_value(0), "The maximum multicast frames rate per port, in frames per second.")
+	("switch.unknown_unicast_rate_limit", po::value<unsigned int>()->default_value(0), "The maximum unknown unicast frames rate per port, in frames per second.")
+	("switch.storm_control_burst_size", po::value<unsigned int>()->default_value(64), "The count of frames a port may burst above the rate limits.")
+	("switch.tcp_mss_clamping_enabled", po::value<bool>()->default_value(false, "no"), "Whether to clamp the MSS of TCP connections to the tap adapter MTU.")
 	;
 
 	return result;
@@ -331,6 +350,10 @@ po::options_description get_router_options()
 	("router.internal_route_acceptance_policy", po::value<fl::router_configuration::internal_route_scope_type>()->default_value(fl::router_configuration::internal_route_scope_type::unicast_in_network), "The internal route acceptance policy.")
 	("router.system_route_acceptance_policy", po::value<fl::router_configuration::system_route_scope_type>()->default_value(fl::router_configuration::system_route_scope_type::none), "The system route acceptance policy.")
 	("router.maximum_routes_limit", po::value<unsigned int>()->default_value(1), "The maximum count of routes to accept for a given host.")
+	("router.tcp_mss_clamping_enabled", po::value<bool>()->default_value(false, "no"), "Whether to clamp the MSS of TCP connections to the tap adapter MTU.")
+	("router.route_metric", po::value<unsigned int>()->default_value(0), "The metric to announce with the local routes.")
+	("router.round_trip_time_metric_unit", po::value<millisecond_duration>()->default_value(10), "The round-trip time, in milliseconds, that adds one to the metric of a peer.")
+	("router.port_weight", po::value<std::vector<fl::router_configuration::port_weight_type> >()->multitoken()->zero_tokens()->default_value(std::vector<fl::router_configuration::port_weight_type>(), ""), "The weight of the peers that announce a same route.")
 	;
 
 	return result;
@@ -368,6 +391,21 @@ void setup_configuration(fl::configuration& configuration, const boost::filesyst
 	configuration.fscp.listen_on = vm["fscp.listen_on"].as<asiotap::endpoint>();
 	configuration.fscp.listen_on_device = vm["fscp.listen_on_device"].as<std::string>();
 	configuration.fscp.hello_timeout = vm["fscp.hello_timeout"].as<millisecond_duration>().to_time_duration();
+	configuration.fscp.keep_alive_period = vm["fscp.keep_alive_period"].as<millisecond_duration>().to_time_duration();
+	configuration.fscp.session_timeout = vm["fscp.session_timeout"].as<millisecond_duration>().to_time_duration();
+
+	// Idle sessions only get a sign of life every keep-alive period: a shorter timeout would tear them down over and over.
+	if (configuration.fscp.session_timeout <= configuration.fscp.keep_alive_period)
+	{
+		throw po::error_with_option_name("in %canonical_option%: the session timeout must be greater than fscp.keep_alive_period", "fscp.session_timeout");
+	}
+
+	configuration.fscp.rekey_threshold = vm["fscp.rekey_threshold"].as<fscp::sequence_number_type>();
+	configuration.fscp.compact_data_framing = vm["fscp.compact_data_framing"].as<bool>();
+	configuration.fscp.path_mtu_discovery = vm["fscp.path_mtu_discovery"].as<bool>();
+	configuration.fscp.fragmentation = vm["fscp.fragmentation"].as<bool>();
+	configuration.fscp.data_aggregation = vm["fscp.data_aggregation"].as<bool>();
+	configuration.fscp.data_aggregation_delay = boost::posix_time::microseconds(vm["fscp.data_aggregation_delay"].as<unsigned int>());
 
 	const std::vector<asiotap::endpoint> contact = vm["fscp.contact"].as<std::vector<asiotap::endpoint> >();
 	configuration.fscp.contact_list.insert(contact.begin(), contact.end());
@@ -422,6 +460,8 @@ void setup_configuration(fl::configuration& configuration, const boost::filesyst
 
 	configuration.tap_adapter.arp_proxy_enabled = vm["tap_adapter.arp_proxy_enabled"].as<bool>();
 	configuration.tap_adapter.arp_proxy_fake_ethernet_address = vm["tap_adapter.arp_proxy_fake_ethernet_address"].as<fl::tap_adapter_configuration::ethernet_address_type>();
+	configuration.tap_adapter.ndp_proxy_enabled = vm["tap_adapter.ndp_proxy_enabled"].as<bool>();
+	configuration.tap_adapter.ndp_proxy_fake_ethernet_address = vm["tap_adapter.ndp_proxy_fake_ethernet_address"].as<fl::tap_adapter_configuration::ethernet_address_type>();
 	configuration.tap_adapter.dhcp_proxy_enabled = vm["tap_adapter.dhcp_proxy_enabled"].as<bool>();
 	configuration.tap_adapter.dhcp_server_ipv4_address_prefix_length = vm["tap_adapter.dhcp_server_ipv4_address_prefix_length"].as<asiotap::ipv4_network_address>();
 	configuration.tap_adapter.dhcp_server_ipv6_address_prefix_length = vm["tap_adapter.dhcp_server_ipv6_address_prefix_length"].as<asiotap::ipv6_network_address>();
@@ -429,6 +469,15 @@ void setup_configuration(fl::configuration& configuration, const boost::filesyst
 	// Switch options
 	configuration.switch_.routing_method = vm["switch.routing_method"].as<fl::switch_configuration::routing_method_type>();
 	configuration.switch_.relay_mode_enabled = vm["switch.relay_mode_enabled"].as<bool>();
+	configuration.switch_.multicast_snooping_enabled = vm["switch.multicast_snooping_enabled"].as<bool>();
+	configuration.switch_.multicast_membership_timeout = vm["switch.multicast_membership_timeout"].as<millisecond_duration>().to_time_duration();
+	configuration.switch_.arp_suppression_enabled = vm["switch.arp_suppression_enabled"].as<bool>();
+	configuration.switch_.arp_binding_timeout = vm["switch.arp_binding_timeout"].as<millisecond_duration>().to_time_duration();
+	configuration.switch_.broadcast_rate_limit = vm["switch.broadcast_rate_limit"].as<unsigned int>();
+	configuration.switch_.multicast_rate_limit = vm["switch.multicast_rate_limit"].as<unsigned int>();
+	configuration.switch_.unknown_unicast_rate_limit = vm["switch.unknown_unicast_rate_limit"].as<unsigned int>();
+	configuration.switch_.storm_control_burst_size = vm["switch.storm_control_burst_size"].as<unsigned int>();
+	configuration.switch_.tcp_mss_clamping_enabled = vm["switch.tcp_mss_clamping_enabled"].as<bool>();
 
 	// Router
 	const auto local_ip_routes = vm["router.local_ip_route"].as<std::vector<asiotap::ip_route> >();
@@ -439,6 +488,10 @@ void setup_configuration(fl::configuration& configuration, const boost::filesyst
 	configuration.router.internal_route_acceptance_policy = vm["router.internal_route_acceptance_policy"].as<fl::router_configuration::internal_route_scope_type>();
 	configuration.router.system_route_acceptance_policy = vm["router.system_route_acceptance_policy"].as<fl::router_configuration::system_route_scope_type>();
 	configuration.router.maximum_routes_limit = vm["router.maximum_routes_limit"].as<unsigned int>();
+	configuration.router.tcp_mss_clamping_enabled = vm["router.tcp_mss_clamping_enabled"].as<bool>();
+	configuration.router.route_metric = vm["router.route_metric"].as<unsigned int>();
+	configuration.router.round_trip_time_metric_unit = vm["router.round_trip_time_metric_unit"].as<millisecond_duration>().to_time_duration();
+	configuration.router.port_weights = vm["router.port_weight"].as<std::vector<fl::router_configuration::port_weight_type> >();
 }
 
 boost::filesystem::path get_tap_adapter_up_script(const boost::filesystem::path& root, const boost::program_options::variables_map& vm)
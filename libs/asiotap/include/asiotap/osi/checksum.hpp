@@ -47,12 +47,85 @@
 
 #include <boost/asio.hpp>
 
-#include "osi/checksum_helper.hpp"
+#include "checksum_helper.hpp"
 
 namespace asiotap
 {
 	namespace osi
 	{
+		/**
+		 * \brief The checksum kernels.
+		 */
+		enum class checksum_kernel
+		{
+			scalar,
+			sse2,
+			avx2,
+			neon
+		};
+
+		/**
+		 * \brief Check whether a checksum kernel is supported by the running CPU.
+		 * \param kernel The kernel.
+		 * \return true if kernel can be used.
+		 */
+		bool is_checksum_kernel_supported(checksum_kernel kernel);
+
+		/**
+		 * \brief Get the checksum kernel selected for the running CPU.
+		 * \return The fastest supported kernel.
+		 */
+		checksum_kernel get_checksum_kernel();
+
+		/**
+		 * \brief Add the 16-bit words of a buffer to a partial checksum, in host memory order.
+		 * \param buf The buffer. Its alignment does not matter.
+		 * \param buf_len The length of buf. Must be even.
+		 * \param sum The partial checksum to add to.
+		 * \return The new partial checksum, which is not folded.
+		 */
+		uint64_t add_checksum_words(const void* buf, size_t buf_len, uint64_t sum);
+
+		/**
+		 * \brief Add the 16-bit words of a buffer to a partial checksum, with a specific kernel.
+		 * \param kernel The kernel to use. An unsupported kernel falls back to the scalar one.
+		 * \param buf The buffer. Its alignment does not matter.
+		 * \param buf_len The length of buf. Must be even.
+		 * \param sum The partial checksum to add to.
+		 * \return The new partial checksum, which is not folded.
+		 */
+		uint64_t add_checksum_words(checksum_kernel kernel, const void* buf, size_t buf_len, uint64_t sum);
+
+		/**
+		 * \brief Fold a partial checksum to 16 bits.
+		 * \param sum The partial checksum.
+		 * \return The folded sum, not complemented.
+		 */
+		uint16_t fold_checksum(uint64_t sum);
+
+		/**
+		 * \brief Update a checksum after a 16-bit field of the checksummed data was rewritten (RFC 1624).
+		 * \param checksum The current checksum, as stored in the frame.
+		 * \param old_value The old value of the field, as stored in the frame.
+		 * \param new_value The new value of the field, as stored in the frame.
+		 * \return The updated checksum, as it must be stored in the frame.
+		 *
+		 * The field must start at an even offset of the checksummed data. A UDP checksum of zero means "no checksum" and must not be updated.
+		 */
+		uint16_t update_checksum(uint16_t checksum, uint16_t old_value, uint16_t new_value);
+
+		/**
+		 * \brief Update a checksum after some data of the checksummed data was rewritten (RFC 1624).
+		 * \param checksum The current checksum, as stored in the frame.
+		 * \param old_data The old data.
+		 * \param new_data The new data.
+		 * \param len The length of old_data and new_data. Must be even.
+		 * \return The updated checksum, as it must be stored in the frame.
+		 *
+		 * The data must start at an even offset of the checksummed data. Use it for addresses, for instance.
+		 */
+		uint16_t update_checksum(uint16_t checksum, const void* old_data, const void* new_data, size_t len);
+
 		/**
 		 * \brief Compute a checksum from the specified buffer.
 		 * \param buf The buffer from which to compute a checksum.
@@ -69,6 +142,24 @@ namespace asiotap
 
 			return helper.compute();
 		}
+
+		inline uint16_t fold_checksum(uint64_t sum)
+		{
+			while (sum >> 16)
+			{
+				sum = (sum & 0xFFFF) + (sum >> 16);
+			}
+
+			return static_cast<uint16_t>(sum);
+		}
+
+		inline uint16_t update_checksum(uint16_t checksum, uint16_t old_value, uint16_t new_value)
+		{
+			// HC' = ~(~HC + ~m + m'), which never yields -0 unlike the original RFC 1141 formula.
+			const uint64_t sum = static_cast<uint16_t>(~checksum) + static_cast<uint16_t>(~old_value) + new_value;
+
+			return static_cast<uint16_t>(~fold_checksum(sum));
+		}
 	}
 }
 
@@ -66,7 +66,7 @@ namespace asiotap
 				/**
 				 * \brief Update the checksum.
 				 * \param buf The buffer to compute the checksum from.
-				 * \param buf_len The size of buf.
+				 * \param buf_len The size of buf. It may be odd, in which case the next call continues the same word.
 				 */
 				void update(const uint16_t* buf, size_t buf_len);
 
@@ -78,13 +78,15 @@ namespace asiotap
 
 			private:
 
-				uint32_t m_checksum;
+				uint64_t m_checksum;
 				uint8_t m_left;
+				bool m_has_left;
 		};
 
 		inline checksum_helper::checksum_helper() :
 			m_checksum(0),
-			m_left(0)
+			m_left(0),
+			m_has_left(false)
 		{
 		}
 	}
@@ -0,0 +1,149 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file igmp_frame.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An IGMP frame structure.
+ */
+
+#ifndef ASIOTAP_OSI_IGMP_FRAME_HPP
+#define ASIOTAP_OSI_IGMP_FRAME_HPP
+
+#include "frame.hpp"
+
+namespace asiotap
+{
+	namespace osi
+	{
+		/**
+		 * \brief The IGMP protocol.
+		 */
+		const uint8_t IGMP_PROTOCOL = 0x02;
+
+		/**
+		 * \brief The IGMP membership query message type.
+		 */
+		const uint8_t IGMP_MEMBERSHIP_QUERY = 0x11;
+
+		/**
+		 * \brief The IGMPv1 membership report message type.
+		 */
+		const uint8_t IGMP_V1_MEMBERSHIP_REPORT = 0x12;
+
+		/**
+		 * \brief The IGMPv2 membership report message type.
+		 */
+		const uint8_t IGMP_V2_MEMBERSHIP_REPORT = 0x16;
+
+		/**
+		 * \brief The IGMPv2 leave group message type.
+		 */
+		const uint8_t IGMP_V2_LEAVE_GROUP = 0x17;
+
+		/**
+		 * \brief The IGMPv3 membership report message type.
+		 */
+		const uint8_t IGMP_V3_MEMBERSHIP_REPORT = 0x22;
+
+		/**
+		 * \brief The IGMPv3 "mode is include" group record type.
+		 */
+		const uint8_t IGMP_V3_MODE_IS_INCLUDE = 0x01;
+
+		/**
+		 * \brief The IGMPv3 "mode is exclude" group record type.
+		 */
+		const uint8_t IGMP_V3_MODE_IS_EXCLUDE = 0x02;
+
+		/**
+		 * \brief The IGMPv3 "change to include mode" group record type.
+		 */
+		const uint8_t IGMP_V3_CHANGE_TO_INCLUDE_MODE = 0x03;
+
+		/**
+		 * \brief The IGMPv3 "change to exclude mode" group record type.
+		 */
+		const uint8_t IGMP_V3_CHANGE_TO_EXCLUDE_MODE = 0x04;
+
+		/**
+		 * \brief The IGMPv3 "allow new sources" group record type.
+		 */
+		const uint8_t IGMP_V3_ALLOW_NEW_SOURCES = 0x05;
+
+		/**
+		 * \brief The IGMPv3 "block old sources" group record type.
+		 */
+		const uint8_t IGMP_V3_BLOCK_OLD_SOURCES = 0x06;
+
+#ifdef MSV
+#pragma pack(push, 1)
+#endif
+
+		/**
+		 * \brief An IGMP frame structure.
+		 *
+		 * For IGMPv3 membership reports, group_address holds a reserved
+		 * field and the number of group records that follow.
+		 */
+		struct igmp_frame
+		{
+			uint8_t type; /**< IGMP message type. */
+			uint8_t max_response_time; /**< Max response time, in tenths of second. */
+			uint16_t checksum; /**< The checksum. */
+			struct in_addr group_address; /**< The group address. */
+		} PACKED;
+
+		/**
+		 * \brief An IGMPv3 group record structure.
+		 */
+		struct igmpv3_group_record
+		{
+			uint8_t record_type; /**< The record type. */
+			uint8_t aux_data_length; /**< The auxiliary data length, in 32-bit words. */
+			uint16_t source_count; /**< The number of sources. */
+			struct in_addr multicast_address; /**< The multicast address. */
+		} PACKED;
+
+#ifdef MSV
+#pragma pack(pop)
+#endif
+	}
+}
+
+#endif /* ASIOTAP_OSI_IGMP_FRAME_HPP */
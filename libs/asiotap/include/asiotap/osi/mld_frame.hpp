@@ -0,0 +1,149 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file mld_frame.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A MLD frame structure.
+ */
+
+#ifndef ASIOTAP_OSI_MLD_FRAME_HPP
+#define ASIOTAP_OSI_MLD_FRAME_HPP
+
+#include "frame.hpp"
+#include "icmpv6_frame.hpp"
+
+namespace asiotap
+{
+	namespace osi
+	{
+		/**
+		 * \brief The MLD listener query ICMPv6 message type.
+		 */
+		const uint8_t MLD_LISTENER_QUERY = 130;
+
+		/**
+		 * \brief The MLDv1 listener report ICMPv6 message type.
+		 */
+		const uint8_t MLD_V1_LISTENER_REPORT = 131;
+
+		/**
+		 * \brief The MLDv1 listener done ICMPv6 message type.
+		 */
+		const uint8_t MLD_V1_LISTENER_DONE = 132;
+
+		/**
+		 * \brief The MLDv2 listener report ICMPv6 message type.
+		 */
+		const uint8_t MLD_V2_LISTENER_REPORT = 143;
+
+		/**
+		 * \brief The MLDv2 "mode is include" multicast address record type.
+		 */
+		const uint8_t MLD_V2_MODE_IS_INCLUDE = 0x01;
+
+		/**
+		 * \brief The MLDv2 "mode is exclude" multicast address record type.
+		 */
+		const uint8_t MLD_V2_MODE_IS_EXCLUDE = 0x02;
+
+		/**
+		 * \brief The MLDv2 "change to include mode" multicast address record type.
+		 */
+		const uint8_t MLD_V2_CHANGE_TO_INCLUDE_MODE = 0x03;
+
+		/**
+		 * \brief The MLDv2 "change to exclude mode" multicast address record type.
+		 */
+		const uint8_t MLD_V2_CHANGE_TO_EXCLUDE_MODE = 0x04;
+
+		/**
+		 * \brief The MLDv2 "allow new sources" multicast address record type.
+		 */
+		const uint8_t MLD_V2_ALLOW_NEW_SOURCES = 0x05;
+
+		/**
+		 * \brief The MLDv2 "block old sources" multicast address record type.
+		 */
+		const uint8_t MLD_V2_BLOCK_OLD_SOURCES = 0x06;
+
+#ifdef MSV
+#pragma pack(push, 1)
+#endif
+
+		/**
+		 * \brief A MLD query or MLDv1 report/done frame structure.
+		 *
+		 * This is the body that follows the ICMPv6 header.
+		 */
+		struct mld_frame
+		{
+			uint16_t max_response_delay; /**< The maximum response delay, in milliseconds. */
+			uint16_t reserved; /**< Reserved. */
+			struct in6_addr multicast_address; /**< The multicast address. */
+		} PACKED;
+
+		/**
+		 * \brief A MLDv2 listener report frame structure.
+		 *
+		 * This is the body that follows the ICMPv6 header.
+		 */
+		struct mldv2_report_frame
+		{
+			uint16_t reserved; /**< Reserved. */
+			uint16_t record_count; /**< The number of multicast address records. */
+		} PACKED;
+
+		/**
+		 * \brief A MLDv2 multicast address record structure.
+		 */
+		struct mldv2_address_record
+		{
+			uint8_t record_type; /**< The record type. */
+			uint8_t aux_data_length; /**< The auxiliary data length, in 32-bit words. */
+			uint16_t source_count; /**< The number of sources. */
+			struct in6_addr multicast_address; /**< The multicast address. */
+		} PACKED;
+
+#ifdef MSV
+#pragma pack(pop)
+#endif
+	}
+}
+
+#endif /* ASIOTAP_OSI_MLD_FRAME_HPP */
@@ -0,0 +1,243 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file mld_helper.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A MLD helper class.
+ */
+
+#ifndef ASIOTAP_OSI_MLD_HELPER_HPP
+#define ASIOTAP_OSI_MLD_HELPER_HPP
+
+#include "helper.hpp"
+#include "mld_frame.hpp"
+
+#include <cstring>
+
+namespace asiotap
+{
+	namespace osi
+	{
+		/**
+		 * \brief The base mld helper implementation class.
+		 */
+		template <class HelperTag>
+		class _base_helper_impl<HelperTag, mld_frame> : public _base_helper<HelperTag, mld_frame>
+		{
+			public:
+
+				/**
+				 * \brief Get the maximum response delay.
+				 * \return The maximum response delay, in milliseconds.
+				 */
+				uint16_t max_response_delay() const;
+
+				/**
+				 * \brief Get the multicast address.
+				 * \return The multicast address.
+				 */
+				boost::asio::ip::address_v6 multicast_address() const;
+
+			protected:
+
+				/**
+				 * \brief Create a helper from a frame type structure.
+				 * \param buf The buffer to refer to.
+				 */
+				_base_helper_impl(typename _base_helper_impl::buffer_type buf);
+		};
+
+		/**
+		 * \brief The base mldv2 report helper implementation class.
+		 */
+		template <class HelperTag>
+		class _base_helper_impl<HelperTag, mldv2_report_frame> : public _base_helper<HelperTag, mldv2_report_frame>
+		{
+			public:
+
+				/**
+				 * \brief Get the record count.
+				 * \return The number of multicast address records.
+				 */
+				size_t record_count() const;
+
+				/**
+				 * \brief Get the payload buffer.
+				 * \return The payload, that contains the multicast address records.
+				 */
+				typename _base_helper_impl::buffer_type payload() const
+				{
+					return this->buffer() + sizeof(typename _base_helper_impl<HelperTag, mldv2_report_frame>::frame_type);
+				}
+
+			protected:
+
+				/**
+				 * \brief Create a helper from a frame type structure.
+				 * \param buf The buffer to refer to.
+				 */
+				_base_helper_impl(typename _base_helper_impl::buffer_type buf);
+		};
+
+		/**
+		 * \brief The base mldv2 address record helper implementation class.
+		 */
+		template <class HelperTag>
+		class _base_helper_impl<HelperTag, mldv2_address_record> : public _base_helper<HelperTag, mldv2_address_record>
+		{
+			public:
+
+				/**
+				 * \brief Get the record type.
+				 * \return The record type.
+				 */
+				uint8_t record_type() const;
+
+				/**
+				 * \brief Get the auxiliary data length.
+				 * \return The auxiliary data length, in bytes.
+				 */
+				size_t aux_data_length() const;
+
+				/**
+				 * \brief Get the source count.
+				 * \return The source count.
+				 */
+				size_t source_count() const;
+
+				/**
+				 * \brief Get the multicast address.
+				 * \return The multicast address.
+				 */
+				boost::asio::ip::address_v6 multicast_address() const;
+
+				/**
+				 * \brief Get the total length of the record, including the sources and the auxiliary data.
+				 * \return The length of the record, in bytes.
+				 */
+				size_t length() const;
+
+			protected:
+
+				/**
+				 * \brief Create a helper from a frame type structure.
+				 * \param buf The buffer to refer to.
+				 */
+				_base_helper_impl(typename _base_helper_impl::buffer_type buf);
+		};
+
+		template <class HelperTag>
+		inline uint16_t _base_helper_impl<HelperTag, mld_frame>::max_response_delay() const
+		{
+			return ntohs(this->frame().max_response_delay);
+		}
+
+		template <class HelperTag>
+		inline boost::asio::ip::address_v6 _base_helper_impl<HelperTag, mld_frame>::multicast_address() const
+		{
+			using boost::asio::ip::address_v6;
+
+			address_v6::bytes_type raw;
+			std::memcpy(&raw.front(), this->frame().multicast_address.s6_addr, raw.size());
+
+			return address_v6(raw);
+		}
+
+		template <class HelperTag>
+		inline _base_helper_impl<HelperTag, mld_frame>::_base_helper_impl(typename _base_helper_impl<HelperTag, mld_frame>::buffer_type buf) :
+			_base_helper<HelperTag, mld_frame>(buf)
+		{
+		}
+
+		template <class HelperTag>
+		inline size_t _base_helper_impl<HelperTag, mldv2_report_frame>::record_count() const
+		{
+			return ntohs(this->frame().record_count);
+		}
+
+		template <class HelperTag>
+		inline _base_helper_impl<HelperTag, mldv2_report_frame>::_base_helper_impl(typename _base_helper_impl<HelperTag, mldv2_report_frame>::buffer_type buf) :
+			_base_helper<HelperTag, mldv2_report_frame>(buf)
+		{
+		}
+
+		template <class HelperTag>
+		inline uint8_t _base_helper_impl<HelperTag, mldv2_address_record>::record_type() const
+		{
+			return this->frame().record_type;
+		}
+
+		template <class HelperTag>
+		inline size_t _base_helper_impl<HelperTag, mldv2_address_record>::aux_data_length() const
+		{
+			return this->frame().aux_data_length * 4;
+		}
+
+		template <class HelperTag>
+		inline size_t _base_helper_impl<HelperTag, mldv2_address_record>::source_count() const
+		{
+			return ntohs(this->frame().source_count);
+		}
+
+		template <class HelperTag>
+		inline boost::asio::ip::address_v6 _base_helper_impl<HelperTag, mldv2_address_record>::multicast_address() const
+		{
+			using boost::asio::ip::address_v6;
+
+			address_v6::bytes_type raw;
+			std::memcpy(&raw.front(), this->frame().multicast_address.s6_addr, raw.size());
+
+			return address_v6(raw);
+		}
+
+		template <class HelperTag>
+		inline size_t _base_helper_impl<HelperTag, mldv2_address_record>::length() const
+		{
+			return sizeof(mldv2_address_record) + source_count() * sizeof(in6_addr) + aux_data_length();
+		}
+
+		template <class HelperTag>
+		inline _base_helper_impl<HelperTag, mldv2_address_record>::_base_helper_impl(typename _base_helper_impl<HelperTag, mldv2_address_record>::buffer_type buf) :
+			_base_helper<HelperTag, mldv2_address_record>(buf)
+		{
+		}
+	}
+}
+
+#endif /* ASIOTAP_OSI_MLD_HELPER_HPP */
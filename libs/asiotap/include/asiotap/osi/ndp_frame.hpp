@@ -0,0 +1,131 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file ndp_frame.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An NDP frame structure.
+ */
+
+#ifndef ASIOTAP_OSI_NDP_FRAME_HPP
+#define ASIOTAP_OSI_NDP_FRAME_HPP
+
+#include "frame.hpp"
+#include "icmpv6_frame.hpp"
+
+namespace asiotap
+{
+	namespace osi
+	{
+		/**
+		 * \brief The neighbor solicitation ICMPv6 message type.
+		 */
+		const uint8_t NDP_NEIGHBOR_SOLICITATION = 135;
+
+		/**
+		 * \brief The neighbor advertisement ICMPv6 message type.
+		 */
+		const uint8_t NDP_NEIGHBOR_ADVERTISEMENT = 136;
+
+		/**
+		 * \brief The hop limit all NDP messages must be sent with.
+		 */
+		const uint8_t NDP_HOP_LIMIT = 255;
+
+		/**
+		 * \brief The router flag.
+		 */
+		const uint32_t NDP_ROUTER_FLAG = 0x80000000;
+
+		/**
+		 * \brief The solicited flag.
+		 */
+		const uint32_t NDP_SOLICITED_FLAG = 0x40000000;
+
+		/**
+		 * \brief The override flag.
+		 */
+		const uint32_t NDP_OVERRIDE_FLAG = 0x20000000;
+
+		/**
+		 * \brief The source link-layer address option.
+		 */
+		const uint8_t NDP_SOURCE_LINK_LAYER_ADDRESS_OPTION = 1;
+
+		/**
+		 * \brief The target link-layer address option.
+		 */
+		const uint8_t NDP_TARGET_LINK_LAYER_ADDRESS_OPTION = 2;
+
+		/**
+		 * \brief The NDP option length unit, in bytes.
+		 */
+		const size_t NDP_OPTION_LENGTH_UNIT = 8;
+
+#ifdef MSV
+#pragma pack(push, 1)
+#endif
+
+		/**
+		 * \brief A neighbor solicitation or advertisement frame structure.
+		 *
+		 * The frame follows the ICMPv6 header and is followed by the options.
+		 */
+		struct ndp_frame
+		{
+			uint32_t flags; /**< The flags (advertisements only, reserved otherwise). */
+			struct in6_addr target; /**< The target address. */
+		} PACKED;
+
+		/**
+		 * \brief A NDP option header.
+		 */
+		struct ndp_option
+		{
+			uint8_t type; /**< The option type. */
+			uint8_t length; /**< The option length, in units of 8 bytes, including the header. */
+		} PACKED;
+
+#ifdef MSV
+#pragma pack(pop)
+#endif
+	}
+}
+
+#endif /* ASIOTAP_OSI_NDP_FRAME_HPP */
+
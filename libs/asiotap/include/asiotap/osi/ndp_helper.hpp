@@ -0,0 +1,199 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file ndp_helper.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An NDP helper class.
+ */
+
+#ifndef ASIOTAP_OSI_NDP_HELPER_HPP
+#define ASIOTAP_OSI_NDP_HELPER_HPP
+
+#include "helper.hpp"
+#include "ndp_frame.hpp"
+
+namespace asiotap
+{
+	namespace osi
+	{
+		/**
+		 * \brief The base ndp helper implementation class.
+		 */
+		template <class HelperTag>
+		class _base_helper_impl<HelperTag, ndp_frame> : public _base_helper<HelperTag, ndp_frame>
+		{
+			public:
+
+				/**
+				 * \brief Get the flags.
+				 * \return The flags.
+				 */
+				uint32_t flags() const;
+
+				/**
+				 * \brief Check whether the router flag is set.
+				 * \return true if the router flag is set.
+				 */
+				bool router_flag() const;
+
+				/**
+				 * \brief Check whether the solicited flag is set.
+				 * \return true if the solicited flag is set.
+				 */
+				bool solicited_flag() const;
+
+				/**
+				 * \brief Check whether the override flag is set.
+				 * \return true if the override flag is set.
+				 */
+				bool override_flag() const;
+
+				/**
+				 * \brief Get the target address.
+				 * \return The target address.
+				 */
+				boost::asio::ip::address_v6 target() const;
+
+				/**
+				 * \brief Get the options buffer.
+				 * \return The options.
+				 */
+				typename _base_helper_impl::buffer_type options() const
+				{
+					return this->buffer() + sizeof(typename _base_helper_impl<HelperTag, ndp_frame>::frame_type);
+				}
+
+			protected:
+
+				/**
+				 * \brief Create a helper from a frame type structure.
+				 * \param buf The buffer to refer to.
+				 */
+				_base_helper_impl(typename _base_helper_impl::buffer_type buf);
+		};
+
+		/**
+		 * \brief The mutable ndp helper implementation class.
+		 */
+		template <>
+		class _helper_impl<mutable_helper_tag, ndp_frame> : public _base_helper_impl<mutable_helper_tag, ndp_frame>
+		{
+			public:
+
+				/**
+				 * \brief Set the flags.
+				 * \param flags The flags.
+				 */
+				void set_flags(uint32_t flags) const;
+
+				/**
+				 * \brief Set the target address.
+				 * \param target The target address.
+				 */
+				void set_target(boost::asio::ip::address_v6 target) const;
+
+			protected:
+
+				/**
+				 * \brief Create a helper from a frame type structure.
+				 * \param buf The buffer to refer to.
+				 */
+				_helper_impl(_helper_impl::buffer_type buf);
+		};
+
+		template <class HelperTag>
+		inline uint32_t _base_helper_impl<HelperTag, ndp_frame>::flags() const
+		{
+			return ntohl(this->frame().flags);
+		}
+
+		template <class HelperTag>
+		inline bool _base_helper_impl<HelperTag, ndp_frame>::router_flag() const
+		{
+			return ((flags() & NDP_ROUTER_FLAG) != 0);
+		}
+
+		template <class HelperTag>
+		inline bool _base_helper_impl<HelperTag, ndp_frame>::solicited_flag() const
+		{
+			return ((flags() & NDP_SOLICITED_FLAG) != 0);
+		}
+
+		template <class HelperTag>
+		inline bool _base_helper_impl<HelperTag, ndp_frame>::override_flag() const
+		{
+			return ((flags() & NDP_OVERRIDE_FLAG) != 0);
+		}
+
+		template <class HelperTag>
+		inline boost::asio::ip::address_v6 _base_helper_impl<HelperTag, ndp_frame>::target() const
+		{
+			using boost::asio::ip::address_v6;
+
+			address_v6::bytes_type raw;
+			std::memcpy(&raw.front(), this->frame().target.s6_addr, raw.size());
+
+			return address_v6(raw);
+		}
+
+		template <class HelperTag>
+		inline _base_helper_impl<HelperTag, ndp_frame>::_base_helper_impl(typename _base_helper_impl<HelperTag, ndp_frame>::buffer_type buf) :
+			_base_helper<HelperTag, ndp_frame>(buf)
+		{
+		}
+
+		inline void _helper_impl<mutable_helper_tag, ndp_frame>::set_flags(uint32_t _flags) const
+		{
+			this->frame().flags = htonl(_flags);
+		}
+
+		inline void _helper_impl<mutable_helper_tag, ndp_frame>::set_target(boost::asio::ip::address_v6 _target) const
+		{
+			std::memcpy(this->frame().target.s6_addr, _target.to_bytes().data(), _target.to_bytes().size());
+		}
+
+		inline _helper_impl<mutable_helper_tag, ndp_frame>::_helper_impl(_helper_impl<mutable_helper_tag, ndp_frame>::buffer_type buf) :
+			_base_helper_impl<mutable_helper_tag, ndp_frame>(buf)
+		{
+		}
+	}
+}
+
+#endif /* ASIOTAP_OSI_NDP_HELPER_HPP */
+
@@ -0,0 +1,170 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file ndp_proxy.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A NDP proxy class.
+ */
+
+#ifndef ASIOTAP_OSI_NDP_PROXY_HPP
+#define ASIOTAP_OSI_NDP_PROXY_HPP
+
+#include "proxy.hpp"
+
+#include "ethernet_filter.hpp"
+#include "ipv6_filter.hpp"
+#include "icmpv6_filter.hpp"
+#include "ndp_filter.hpp"
+#include "complex_filter.hpp"
+#include "ethernet_address.hpp"
+
+#include <boost/optional.hpp>
+
+#include <map>
+
+namespace asiotap
+{
+	namespace osi
+	{
+		/**
+		 * \brief A NDP proxy class.
+		 *
+		 * Answers IPv6 neighbor solicitations, like the ARP proxy does for ARP requests.
+		 */
+		template <>
+		class proxy<ndp_frame> : public _base_proxy<ndp_frame>
+		{
+			public:
+
+				/**
+				 * \brief The Ethernet address type.
+				 */
+				typedef ethernet_address ethernet_address_type;
+
+				/**
+				 * \brief The entry type.
+				 */
+				typedef std::pair<boost::asio::ip::address_v6, ethernet_address_type> entry_type;
+
+				/**
+				 * \brief The neighbor solicitation callback type.
+				 */
+				typedef boost::function<bool (const boost::asio::ip::address_v6&, ethernet_address_type&)> neighbor_solicitation_callback_type;
+
+				/**
+				 * \brief Create a NDP proxy.
+				 */
+				proxy() :
+					m_neighbor_solicitation_callback(0)
+				{
+				}
+
+				/**
+				 * \brief Add a proxy entry.
+				 * \param entry The entry to add.
+				 * \return If an entry for the specified logical address already exists, nothing is done and the call returns false. Otherwise, the call returns true.
+				 */
+				bool add_entry(const entry_type& entry);
+
+				/**
+				 * \brief Add a proxy entry.
+				 * \param logical_address The logical address.
+				 * \param hardware_address The hardware address.
+				 * \return If an entry for the specified logical address already exists, nothing is done and the call returns false. Otherwise, the call returns true.
+				 */
+				bool add_entry(const boost::asio::ip::address_v6& logical_address, const ethernet_address_type& hardware_address);
+
+				/**
+				 * \brief Delete a proxy entry.
+				 * \param logical_address The logical address.
+				 * \return If an entry was deleted, true is returned. Otherwise, the call returns false.
+				 */
+				bool remove_entry(const boost::asio::ip::address_v6& logical_address);
+
+				/**
+				 * \brief Set the callback function when a neighbor solicitation is received.
+				 * \param callback The callback function.
+				 */
+				void set_neighbor_solicitation_callback(neighbor_solicitation_callback_type callback);
+
+				/**
+				 * \brief Process a frame.
+				 * \param ethernet_helper The ethernet layer.
+				 * \param ipv6_helper The IPv6 layer.
+				 * \param icmpv6_helper The ICMPv6 layer.
+				 * \param ndp_helper The NDP layer.
+				 * \param response_buffer The buffer to write the response to.
+				 * \return The buffer that contains the answer, if there is one.
+				 *
+				 * Duplicate address detection probes (sent from the unspecified address) are never answered.
+				 */
+				boost::optional<boost::asio::const_buffer> process_frame(const_helper<ethernet_frame> ethernet_helper, const_helper<ipv6_frame> ipv6_helper, const_helper<icmpv6_frame> icmpv6_helper, const_helper<ndp_frame> ndp_helper, boost::asio::mutable_buffer response_buffer) const;
+
+			private:
+
+				typedef std::map<boost::asio::ip::address_v6, ethernet_address_type> entry_map_type;
+
+				entry_map_type m_entry_map;
+				neighbor_solicitation_callback_type m_neighbor_solicitation_callback;
+		};
+
+		inline bool proxy<ndp_frame>::add_entry(const entry_type& entry)
+		{
+			return m_entry_map.insert(entry).second;
+		}
+
+		inline bool proxy<ndp_frame>::add_entry(const boost::asio::ip::address_v6& logical_address, const ethernet_address_type& hardware_address)
+		{
+			return add_entry(std::make_pair(logical_address, hardware_address));
+		}
+
+		inline bool proxy<ndp_frame>::remove_entry(const boost::asio::ip::address_v6& logical_address)
+		{
+			return (m_entry_map.erase(logical_address) > 0);
+		}
+
+		inline void proxy<ndp_frame>::set_neighbor_solicitation_callback(neighbor_solicitation_callback_type callback)
+		{
+			m_neighbor_solicitation_callback = callback;
+		}
+	}
+}
+
+#endif /* ASIOTAP_NDP_PROXY_HPP */
+
@@ -0,0 +1,226 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file static_filter.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An OSI static filter class.
+ */
+
+#ifndef ASIOTAP_OSI_STATIC_FILTER_HPP
+#define ASIOTAP_OSI_STATIC_FILTER_HPP
+
+#include "filter.hpp"
+
+namespace asiotap
+{
+	namespace osi
+	{
+		/**
+		 * \brief A static filter class.
+		 *
+		 * Unlike filter, a static filter has no state: its chain is composed at compile time and the handler gets called inline with the helpers of every layer, innermost first. It can be used concurrently from any number of threads.
+		 *
+		 * Layers are only checked with frame_parent_match() and check_frame(): any additional check belongs to the handler.
+		 */
+		template <typename OSIFrameType, typename ParentFilterType = void>
+		class static_filter
+		{
+			public:
+
+				/**
+				 * \brief The frame type.
+				 */
+				typedef OSIFrameType frame_type;
+
+				/**
+				 * \brief The parent filter type.
+				 */
+				typedef ParentFilterType parent_filter_type;
+
+				/**
+				 * \brief Parse a buffer.
+				 * \param buf The buffer to parse.
+				 * \param handler The handler to call if the buffer matches the whole chain. Its signature must be bool (const_helper<frame_type>, ...), with the helpers of the parent layers following.
+				 * \return The value returned by handler, or false if the buffer does not match.
+				 */
+				template <typename Handler>
+				static bool parse(boost::asio::const_buffer buf, Handler handler);
+
+				/**
+				 * \brief Parse the payload of a parent frame.
+				 * \param handler The handler to call if the payload matches.
+				 * \param parent_helper The parent helper.
+				 * \param parent_helpers The helpers of the upper parent layers, if any.
+				 * \return The value returned by handler, or false if the payload does not match.
+				 */
+				template <typename Handler, typename... ParentHelperTypes>
+				static bool parse_payload(Handler& handler, const_helper<typename ParentFilterType::frame_type> parent_helper, ParentHelperTypes... parent_helpers);
+
+			private:
+
+				template <typename Handler>
+				class parent_handler
+				{
+					public:
+
+						explicit parent_handler(Handler& handler) :
+							m_handler(handler)
+						{}
+
+						template <typename... HelperTypes>
+						bool operator()(HelperTypes... helpers) const
+						{
+							return static_filter::parse_payload(m_handler, helpers...);
+						}
+
+					private:
+
+						Handler& m_handler;
+				};
+		};
+
+		/**
+		 * \brief A static filter class, for frames that have no parent.
+		 */
+		template <typename OSIFrameType>
+		class static_filter<OSIFrameType, void>
+		{
+			public:
+
+				/**
+				 * \brief The frame type.
+				 */
+				typedef OSIFrameType frame_type;
+
+				/**
+				 * \brief The parent filter type.
+				 */
+				typedef void parent_filter_type;
+
+				/**
+				 * \brief Parse a buffer.
+				 * \param buf The buffer to parse.
+				 * \param handler The handler to call if the buffer matches. Its signature must be bool (const_helper<frame_type>).
+				 * \return The value returned by handler, or false if the buffer does not match.
+				 */
+				template <typename Handler>
+				static bool parse(boost::asio::const_buffer buf, Handler handler);
+		};
+
+		/**
+		 * \brief A complex static filter type.
+		 *
+		 * The frame types are given innermost first, like for complex_filter.
+		 */
+		template <typename A, typename B = void, typename C = void, typename D = void, typename E = void>
+		struct complex_static_filter
+		{
+			typedef static_filter<A, typename complex_static_filter<B, C, D, E>::type> type; /**< Filter type. */
+		};
+
+		template <>
+		struct complex_static_filter<void, void, void, void, void>
+		{
+			typedef void type; /**< Filter type. */
+		};
+
+		template <typename OSIFrameType, typename ParentFilterType>
+		template <typename Handler>
+		inline bool static_filter<OSIFrameType, ParentFilterType>::parse(boost::asio::const_buffer buf, Handler handler)
+		{
+			return ParentFilterType::parse(buf, parent_handler<Handler>(handler));
+		}
+
+		template <typename OSIFrameType, typename ParentFilterType>
+		template <typename Handler, typename... ParentHelperTypes>
+		inline bool static_filter<OSIFrameType, ParentFilterType>::parse_payload(Handler& handler, const_helper<typename ParentFilterType::frame_type> parent_helper, ParentHelperTypes... parent_helpers)
+		{
+			if (!frame_parent_match<OSIFrameType, typename ParentFilterType::frame_type>(parent_helper))
+			{
+				return false;
+			}
+
+			const boost::asio::const_buffer payload = parent_helper.payload();
+
+			// This avoids the exception that the helper would throw for truncated frames, which are common enough.
+			if (boost::asio::buffer_size(payload) < sizeof(OSIFrameType))
+			{
+				return false;
+			}
+
+			const const_helper<OSIFrameType> helper(payload);
+
+			if (!check_frame(helper))
+			{
+				return false;
+			}
+
+			return handler(helper, parent_helper, parent_helpers...);
+		}
+
+		template <typename OSIFrameType>
+		template <typename Handler>
+		inline bool static_filter<OSIFrameType, void>::parse(boost::asio::const_buffer buf, Handler handler)
+		{
+			if (boost::asio::buffer_size(buf) < sizeof(OSIFrameType))
+			{
+				return false;
+			}
+
+			try
+			{
+				const const_helper<OSIFrameType> helper(buf);
+
+				if (!check_frame(helper))
+				{
+					return false;
+				}
+
+				return handler(helper);
+			}
+			catch (std::logic_error&)
+			{
+				// Some helpers validate their frame further and throw if it is malformed.
+				return false;
+			}
+		}
+	}
+}
+
+#endif /* ASIOTAP_OSI_STATIC_FILTER_HPP */
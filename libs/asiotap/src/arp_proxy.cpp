@@ -95,7 +95,7 @@ namespace asiotap
 
 					payload_size = ethernet_builder.write(
 					                   ethernet_helper.sender(),
-					                   ethernet_helper.target(),
+					                   boost::asio::buffer(eth_addr.data()),
 					                   ethernet_helper.protocol()
 					               );
 
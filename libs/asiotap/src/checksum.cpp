@@ -44,9 +44,310 @@
 
 #include "osi/checksum.hpp"
 
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ASIOTAP_CHECKSUM_X86
+#define ASIOTAP_CHECKSUM_TARGET(name) __attribute__((target(name)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define ASIOTAP_CHECKSUM_X86
+#define ASIOTAP_CHECKSUM_TARGET(name)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define ASIOTAP_CHECKSUM_NEON
+#include <arm_neon.h>
+#endif
+
 namespace asiotap
 {
 	namespace osi
 	{
+		namespace
+		{
+			// Below this size, the vector kernels are not worth the dispatch.
+			const size_t VECTOR_KERNEL_THRESHOLD = 64;
+
+			// Every 32-bit lane of the vector kernels grows by at most 2 * 0xFFFF per block: flushing them every 0x8000 blocks avoids any overflow.
+			const size_t VECTOR_BLOCKS_PER_FLUSH = 0x8000;
+
+			uint64_t add_checksum_words_scalar(const uint8_t* buf, size_t buf_len, uint64_t sum)
+			{
+				// Summing 32-bit words gives the same folded result as summing 16-bit words, in half the additions.
+				while (buf_len >= sizeof(uint32_t))
+				{
+					uint32_t word;
+					std::memcpy(&word, buf, sizeof(word));
+
+					sum += word;
+					buf += sizeof(word);
+					buf_len -= sizeof(word);
+				}
+
+				if (buf_len >= sizeof(uint16_t))
+				{
+					uint16_t word;
+					std::memcpy(&word, buf, sizeof(word));
+
+					sum += word;
+				}
+
+				return sum;
+			}
+
+#ifdef ASIOTAP_CHECKSUM_X86
+			ASIOTAP_CHECKSUM_TARGET("sse2") uint64_t add_checksum_words_sse2(const uint8_t* buf, size_t buf_len, uint64_t sum)
+			{
+				const __m128i mask = _mm_set1_epi32(0xFFFF);
+
+				while (buf_len >= sizeof(__m128i))
+				{
+					size_t blocks = std::min(buf_len / sizeof(__m128i), VECTOR_BLOCKS_PER_FLUSH);
+					buf_len -= blocks * sizeof(__m128i);
+
+					__m128i acc = _mm_setzero_si128();
+
+					for (; blocks > 0; --blocks, buf += sizeof(__m128i))
+					{
+						const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf));
+
+						acc = _mm_add_epi32(acc, _mm_and_si128(value, mask));
+						acc = _mm_add_epi32(acc, _mm_srli_epi32(value, 16));
+					}
+
+					uint32_t lanes[sizeof(__m128i) / sizeof(uint32_t)];
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+
+					for (auto lane : lanes)
+					{
+						sum += lane;
+					}
+				}
+
+				return add_checksum_words_scalar(buf, buf_len, sum);
+			}
+
+			ASIOTAP_CHECKSUM_TARGET("avx2") uint64_t add_checksum_words_avx2(const uint8_t* buf, size_t buf_len, uint64_t sum)
+			{
+				const __m256i mask = _mm256_set1_epi32(0xFFFF);
+
+				while (buf_len >= sizeof(__m256i))
+				{
+					size_t blocks = std::min(buf_len / sizeof(__m256i), VECTOR_BLOCKS_PER_FLUSH);
+					buf_len -= blocks * sizeof(__m256i);
+
+					__m256i acc = _mm256_setzero_si256();
+
+					for (; blocks > 0; --blocks, buf += sizeof(__m256i))
+					{
+						const __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf));
+
+						acc = _mm256_add_epi32(acc, _mm256_and_si256(value, mask));
+						acc = _mm256_add_epi32(acc, _mm256_srli_epi32(value, 16));
+					}
+
+					uint32_t lanes[sizeof(__m256i) / sizeof(uint32_t)];
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+
+					for (auto lane : lanes)
+					{
+						sum += lane;
+					}
+				}
+
+				return add_checksum_words_scalar(buf, buf_len, sum);
+			}
+
+			bool detect_sse2()
+			{
+#if defined(__GNUC__)
+				__builtin_cpu_init();
+
+				return __builtin_cpu_supports("sse2");
+#else
+				int info[4];
+				__cpuid(info, 1);
+
+				return (info[3] & (1 << 26)) != 0;
+#endif
+			}
+
+			bool detect_avx2()
+			{
+#if defined(__GNUC__)
+				__builtin_cpu_init();
+
+				return __builtin_cpu_supports("avx2");
+#else
+				int info[4];
+				__cpuid(info, 0);
+
+				if (info[0] < 7)
+				{
+					return false;
+				}
+
+				__cpuid(info, 1);
+
+				// The OS must save the AVX registers on context switches.
+				const bool osxsave = (info[2] & (1 << 27)) != 0;
+				const bool avx = (info[2] & (1 << 28)) != 0;
+
+				if (!osxsave || !avx || ((_xgetbv(0) & 0x6) != 0x6))
+				{
+					return false;
+				}
+
+				__cpuidex(info, 7, 0);
+
+				return (info[1] & (1 << 5)) != 0;
+#endif
+			}
+#endif
+
+#ifdef ASIOTAP_CHECKSUM_NEON
+			uint64_t add_checksum_words_neon(const uint8_t* buf, size_t buf_len, uint64_t sum)
+			{
+				uint64x2_t acc = vdupq_n_u64(0);
+
+				while (buf_len >= sizeof(uint16x8_t))
+				{
+					const uint16x8_t value = vreinterpretq_u16_u8(vld1q_u8(buf));
+
+					acc = vpadalq_u32(acc, vpaddlq_u16(value));
+					buf += sizeof(uint16x8_t);
+					buf_len -= sizeof(uint16x8_t);
+				}
+
+				sum += vgetq_lane_u64(acc, 0);
+				sum += vgetq_lane_u64(acc, 1);
+
+				return add_checksum_words_scalar(buf, buf_len, sum);
+			}
+#endif
+
+			uint64_t call_checksum_kernel(checksum_kernel kernel, const uint8_t* buf, size_t buf_len, uint64_t sum)
+			{
+				switch (kernel)
+				{
+#ifdef ASIOTAP_CHECKSUM_X86
+					case checksum_kernel::sse2:
+						return add_checksum_words_sse2(buf, buf_len, sum);
+					case checksum_kernel::avx2:
+						return add_checksum_words_avx2(buf, buf_len, sum);
+#endif
+#ifdef ASIOTAP_CHECKSUM_NEON
+					case checksum_kernel::neon:
+						return add_checksum_words_neon(buf, buf_len, sum);
+#endif
+					default:
+						return add_checksum_words_scalar(buf, buf_len, sum);
+				}
+			}
+
+			checksum_kernel select_checksum_kernel()
+			{
+				if (is_checksum_kernel_supported(checksum_kernel::avx2))
+				{
+					return checksum_kernel::avx2;
+				}
+
+				if (is_checksum_kernel_supported(checksum_kernel::sse2))
+				{
+					return checksum_kernel::sse2;
+				}
+
+				if (is_checksum_kernel_supported(checksum_kernel::neon))
+				{
+					return checksum_kernel::neon;
+				}
+
+				return checksum_kernel::scalar;
+			}
+		}
+
+		bool is_checksum_kernel_supported(checksum_kernel kernel)
+		{
+			switch (kernel)
+			{
+				case checksum_kernel::scalar:
+					return true;
+#ifdef ASIOTAP_CHECKSUM_X86
+				case checksum_kernel::sse2:
+				{
+					static const bool supported = detect_sse2();
+
+					return supported;
+				}
+				case checksum_kernel::avx2:
+				{
+					static const bool supported = detect_avx2();
+
+					return supported;
+				}
+#endif
+#ifdef ASIOTAP_CHECKSUM_NEON
+				case checksum_kernel::neon:
+					return true;
+#endif
+				default:
+					return false;
+			}
+		}
+
+		checksum_kernel get_checksum_kernel()
+		{
+			static const checksum_kernel kernel = select_checksum_kernel();
+
+			return kernel;
+		}
+
+		uint64_t add_checksum_words(const void* buf, size_t buf_len, uint64_t sum)
+		{
+			const uint8_t* data = static_cast<const uint8_t*>(buf);
+
+			if (buf_len < VECTOR_KERNEL_THRESHOLD)
+			{
+				return add_checksum_words_scalar(data, buf_len, sum);
+			}
+
+			return call_checksum_kernel(get_checksum_kernel(), data, buf_len, sum);
+		}
+
+		uint64_t add_checksum_words(checksum_kernel kernel, const void* buf, size_t buf_len, uint64_t sum)
+		{
+			if (!is_checksum_kernel_supported(kernel))
+			{
+				kernel = checksum_kernel::scalar;
+			}
+
+			return call_checksum_kernel(kernel, static_cast<const uint8_t*>(buf), buf_len, sum);
+		}
+
+		uint16_t update_checksum(uint16_t checksum, const void* old_data, const void* new_data, size_t len)
+		{
+			const uint8_t* old_words = static_cast<const uint8_t*>(old_data);
+			const uint8_t* new_words = static_cast<const uint8_t*>(new_data);
+
+			uint64_t sum = static_cast<uint16_t>(~checksum);
+
+			for (size_t i = 0; i + 1 < len; i += sizeof(uint16_t))
+			{
+				uint16_t old_value;
+				uint16_t new_value;
+
+				std::memcpy(&old_value, old_words + i, sizeof(old_value));
+				std::memcpy(&new_value, new_words + i, sizeof(new_value));
+
+				sum += static_cast<uint16_t>(~old_value);
+				sum += new_value;
+			}
+
+			return static_cast<uint16_t>(~fold_checksum(sum));
+		}
 	}
 }
@@ -44,48 +44,53 @@
 
 #include "osi/checksum_helper.hpp"
 
+#include "osi/checksum.hpp"
+
 namespace asiotap
 {
 	namespace osi
 	{
 		void checksum_helper::update(const uint16_t* buf, size_t buf_len)
 		{
-			if (buf_len > 0)
+			const uint8_t* data = reinterpret_cast<const uint8_t*>(buf);
+
+			if (buf_len == 0)
+			{
+				return;
+			}
+
+			if (m_has_left)
 			{
-				if (m_left != 0)
-				{
-					m_checksum += (static_cast<uint16_t>(m_left) << 8 | *reinterpret_cast<const uint8_t*>(buf));
-					buf_len -= sizeof(uint8_t);
-					m_left = 0;
-				}
+				// The byte left by the previous call and the first byte of this buffer form a word.
+				const uint8_t word[2] = { m_left, *data };
 
-				while (buf_len > 1)
-				{
-					m_checksum += *buf++;
-					buf_len -= sizeof(uint16_t);
-				}
+				m_checksum = add_checksum_words(word, sizeof(word), m_checksum);
+				++data;
+				--buf_len;
+				m_has_left = false;
+			}
+
+			m_checksum = add_checksum_words(data, buf_len & ~static_cast<size_t>(1), m_checksum);
 
-				if (buf_len > 0)
-				{
-					m_left = *reinterpret_cast<const uint8_t*>(buf);
-				}
+			if (buf_len % 2 != 0)
+			{
+				m_left = data[buf_len - 1];
+				m_has_left = true;
 			}
 		}
 
 		uint32_t checksum_helper::compute()
 		{
-			if (m_left != 0)
+			if (m_has_left)
 			{
-				m_checksum += m_left;
-				m_left = 0;
-			}
+				// A trailing byte is padded with zero.
+				const uint8_t word[2] = { m_left, 0 };
 
-			while (m_checksum >> 16)
-			{
-				m_checksum = (m_checksum & 0xFFFF) + (m_checksum >> 16);
+				m_checksum = add_checksum_words(word, sizeof(word), m_checksum);
+				m_has_left = false;
 			}
 
-			return static_cast<uint16_t>(~m_checksum);
+			return static_cast<uint16_t>(~fold_checksum(m_checksum));
 		}
 	}
 }
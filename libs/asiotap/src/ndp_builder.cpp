@@ -0,0 +1,80 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file ndp_builder.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An NDP frame builder class.
+ */
+
+#include "osi/ndp_builder.hpp"
+
+#include "osi/ndp_helper.hpp"
+
+namespace asiotap
+{
+	namespace osi
+	{
+		size_t builder<ndp_frame>::write(
+		    uint32_t flags,
+		    boost::asio::ip::address_v6 target,
+		    uint8_t link_layer_address_option,
+		    boost::asio::const_buffer link_layer_address
+		) const
+		{
+			const size_t option_header_size = sizeof(ndp_option) + boost::asio::buffer_size(link_layer_address);
+			const size_t option_size = (option_header_size + NDP_OPTION_LENGTH_UNIT - 1) / NDP_OPTION_LENGTH_UNIT * NDP_OPTION_LENGTH_UNIT;
+
+			helper_type helper = get_helper(sizeof(frame_type) + option_size);
+
+			helper.set_flags(flags);
+			helper.set_target(target);
+
+			const boost::asio::mutable_buffer option = helper.options();
+
+			ndp_option& option_header = *boost::asio::buffer_cast<ndp_option*>(option);
+			option_header.type = link_layer_address_option;
+			option_header.length = static_cast<uint8_t>(option_size / NDP_OPTION_LENGTH_UNIT);
+
+			boost::asio::buffer_copy(option + sizeof(ndp_option), link_layer_address);
+			std::memset(boost::asio::buffer_cast<uint8_t*>(option) + option_header_size, 0x00, option_size - option_header_size);
+
+			return sizeof(frame_type) + option_size + boost::asio::buffer_size(payload());
+		}
+	}
+}
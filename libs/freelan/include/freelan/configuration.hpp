@@ -305,6 +305,46 @@ namespace freelan
 		 */
 		boost::posix_time::time_duration hello_timeout;
 
+		/**
+		 * \brief The session keep-alive period.
+		 */
+		boost::posix_time::time_duration keep_alive_period;
+
+		/**
+		 * \brief The session timeout.
+		 */
+		boost::posix_time::time_duration session_timeout;
+
+		/**
+		 * \brief The sequence number after which a session is renewed.
+		 */
+		fscp::sequence_number_type rekey_threshold;
+
+		/**
+		 * \brief Whether to use the compact data framing with the hosts that support it.
+		 */
+		bool compact_data_framing;
+
+		/**
+		 * \brief Whether to discover the path MTU to the hosts that support it.
+		 */
+		bool path_mtu_discovery;
+
+		/**
+		 * \brief Whether to fragment the datagrams that exceed the path MTU to the hosts that support it.
+		 */
+		bool fragmentation;
+
+		/**
+		 * \brief Whether to aggregate small outgoing frames.
+		 */
+		bool data_aggregation;
+
+		/**
+		 * \brief The maximum delay of a frame waiting to be aggregated.
+		 */
+		boost::posix_time::time_duration data_aggregation_delay;
+
 		/**
 		 * \brief The list of allowed cipher suites.
 		 */
@@ -470,6 +510,16 @@ namespace freelan
 		 */
 		ethernet_address_type arp_proxy_fake_ethernet_address;
 
+		/**
+		 * \brief Whether to enable the NDP proxy.
+		 */
+		bool ndp_proxy_enabled;
+
+		/**
+		 * \brief The NDP proxy fake ethernet address.
+		 */
+		ethernet_address_type ndp_proxy_fake_ethernet_address;
+
 		/**
 		 * \brief Whether to enable the DHCP proxy.
 		 */
@@ -524,6 +574,61 @@ namespace freelan
 		 * \brief Whether to enable the relay mode.
 		 */
 		bool relay_mode_enabled;
+
+		/**
+		 * \brief Whether to enable IGMP/MLD snooping.
+		 *
+		 * When enabled, multicast frames are only sent to the ports that have listeners for the group and to the ports where multicast queriers were seen.
+		 */
+		bool multicast_snooping_enabled;
+
+		/**
+		 * \brief The multicast membership timeout.
+		 */
+		boost::posix_time::time_duration multicast_membership_timeout;
+
+		/**
+		 * \brief Whether to enable ARP suppression.
+		 *
+		 * When enabled, ARP requests for known IPv4 addresses are answered by the switch instead of being flooded.
+		 */
+		bool arp_suppression_enabled;
+
+		/**
+		 * \brief The ARP binding timeout.
+		 */
+		boost::posix_time::time_duration arp_binding_timeout;
+
+		/**
+		 * \brief The maximum broadcast frames rate accepted from a given port, in frames per second.
+		 *
+		 * A value of 0 means no limit.
+		 */
+		unsigned int broadcast_rate_limit;
+
+		/**
+		 * \brief The maximum multicast frames rate accepted from a given port, in frames per second.
+		 *
+		 * A value of 0 means no limit.
+		 */
+		unsigned int multicast_rate_limit;
+
+		/**
+		 * \brief The maximum unknown unicast frames rate accepted from a given port, in frames per second.
+		 *
+		 * A value of 0 means no limit.
+		 */
+		unsigned int unknown_unicast_rate_limit;
+
+		/**
+		 * \brief The count of frames a port may burst above the rate limits.
+		 */
+		unsigned int storm_control_burst_size;
+
+		/**
+		 * \brief Whether to clamp the MSS of the TCP SYN segments to the tap adapter MTU.
+		 */
+		bool tcp_mss_clamping_enabled;
 	};
 
 	/**
@@ -591,6 +696,48 @@ namespace freelan
 		 * \brief The maximum routes count to accept from a given peer.
 		 */
 		unsigned int maximum_routes_limit;
+
+		/**
+		 * \brief Whether to clamp the MSS of the TCP SYN segments to the tap adapter MTU.
+		 */
+		bool tcp_mss_clamping_enabled;
+
+		/**
+		 * \brief A port weight type.
+		 *
+		 * When several peers announce a same route, the flows are spread among them proportionally to their weights.
+		 */
+		struct port_weight_type
+		{
+			/**
+			 * \brief The network the peer addresses must belong to.
+			 */
+			asiotap::ip_network_address network;
+
+			/**
+			 * \brief The weight. Cannot be zero.
+			 */
+			unsigned int weight;
+		};
+
+		/**
+		 * \brief The port weights.
+		 *
+		 * The first matching entry applies. Peers that don't match any entry have a weight of 1.
+		 */
+		std::vector<port_weight_type> port_weights;
+
+		/**
+		 * \brief The metric announced with the local routes.
+		 */
+		unsigned int route_metric;
+
+		/**
+		 * \brief The round-trip time that adds one to the metric of a peer.
+		 *
+		 * A zero duration means that the round-trip times are ignored.
+		 */
+		boost::posix_time::time_duration round_trip_time_metric_unit;
 	};
 
 	/**
@@ -773,6 +920,22 @@ namespace freelan
 	 * \return os.
 	 */
 	std::ostream& operator<<(std::ostream& os, const router_configuration::system_route_scope_type& value);
+
+	/**
+	 * \brief Input a port weight.
+	 * \param is The input stream.
+	 * \param value The value to read.
+	 * \return is.
+	 */
+	std::istream& operator>>(std::istream& is, router_configuration::port_weight_type& value);
+
+	/**
+	 * \brief Output a port weight to a stream.
+	 * \param os The output stream.
+	 * \param value The value.
+	 * \return os.
+	 */
+	std::ostream& operator<<(std::ostream& os, const router_configuration::port_weight_type& value);
 }
 
 #endif /* FREELAN_CONFIGURATION_HPP */
@@ -59,7 +59,8 @@
 #include <asiotap/asiotap.hpp>
 #include <asiotap/osi/arp_proxy.hpp>
 #include <asiotap/osi/dhcp_proxy.hpp>
-#include <asiotap/osi/complex_filter.hpp>
+#include <asiotap/osi/ndp_proxy.hpp>
+#include <asiotap/osi/static_filter.hpp>
 #include <asiotap/route_manager.hpp>
 #include <asiotap/types/ip_route.hpp>
 
@@ -489,6 +490,8 @@ namespace freelan
 			void async_send_routes_request_to_all(multiple_endpoints_handler_type);
 			void async_send_routes_request_to_all();
 			void async_send_routes(const ep_type&, routes_message::version_type, const asiotap::ip_route_set&, simple_handler_type);
+			void async_measure_round_trip_time(const ep_type&);
+			void async_measure_round_trip_time_to_all();
 
 			void do_contact(const ep_type&, duration_handler_type);
 
@@ -513,10 +516,13 @@ namespace freelan
 			void do_handle_session_error(const ep_type&, bool, const std::exception&);
 			void do_handle_session_established(const ep_type&, bool, const fscp::cipher_suite_type&, const fscp::elliptic_curve_type&);
 			void do_handle_session_lost(const ep_type&, fscp::server::session_loss_reason);
+			void do_handle_path_mtu_discovered(const ep_type&, size_t);
 			void do_handle_data_received(const ep_type&, fscp::channel_number_type, fscp::SharedBuffer, boost::asio::const_buffer);
 			void do_handle_message(const ep_type&, fscp::SharedBuffer, const message&);
 			void do_handle_routes_request(const ep_type&);
-			void do_handle_routes(const asiotap::ip_network_address_list&, const ep_type&, routes_message::version_type, const asiotap::ip_route_set&);
+			void do_handle_routes(const asiotap::ip_network_address_list&, const ep_type&, routes_message::version_type, const asiotap::ip_route_set&, routes_message::metric_type);
+			void do_handle_round_trip_time(const ep_type&, const boost::posix_time::time_duration&);
+			void do_measure_round_trip_time_to_all();
 
 			boost::shared_ptr<fscp::server> m_fscp_server;
 			boost::asio::deadline_timer m_contact_timer;
@@ -543,16 +549,21 @@ namespace freelan
 
 		private: /* TAP adapter */
 
-			typedef asiotap::osi::filter<asiotap::osi::ethernet_frame> ethernet_filter_type;
-			typedef asiotap::osi::complex_filter<asiotap::osi::arp_frame, asiotap::osi::ethernet_frame>::type arp_filter_type;
-			typedef asiotap::osi::complex_filter<asiotap::osi::ipv4_frame, asiotap::osi::ethernet_frame>::type ipv4_filter_type;
-			typedef asiotap::osi::complex_filter<asiotap::osi::udp_frame, asiotap::osi::ipv4_frame, asiotap::osi::ethernet_frame>::type udp_filter_type;
-			typedef asiotap::osi::complex_filter<asiotap::osi::bootp_frame, asiotap::osi::udp_frame, asiotap::osi::ipv4_frame, asiotap::osi::ethernet_frame>::type bootp_filter_type;
-			typedef asiotap::osi::complex_filter<asiotap::osi::dhcp_frame, asiotap::osi::bootp_frame, asiotap::osi::udp_frame, asiotap::osi::ipv4_frame, asiotap::osi::ethernet_frame>::type dhcp_filter_type;
+			typedef asiotap::osi::complex_static_filter<asiotap::osi::arp_frame, asiotap::osi::ethernet_frame>::type arp_filter_type;
+			typedef asiotap::osi::complex_static_filter<asiotap::osi::dhcp_frame, asiotap::osi::bootp_frame, asiotap::osi::udp_frame, asiotap::osi::ipv4_frame, asiotap::osi::ethernet_frame>::type dhcp_filter_type;
+			typedef asiotap::osi::complex_static_filter<asiotap::osi::ndp_frame, asiotap::osi::icmpv6_frame, asiotap::osi::ipv6_frame, asiotap::osi::ethernet_frame>::type ndp_filter_type;
+			typedef asiotap::osi::const_helper<asiotap::osi::ethernet_frame> ethernet_helper_type;
+			typedef asiotap::osi::const_helper<asiotap::osi::ipv4_frame> ipv4_helper_type;
+			typedef asiotap::osi::const_helper<asiotap::osi::udp_frame> udp_helper_type;
+			typedef asiotap::osi::const_helper<asiotap::osi::bootp_frame> bootp_helper_type;
+			typedef asiotap::osi::const_helper<asiotap::osi::ipv6_frame> ipv6_helper_type;
+			typedef asiotap::osi::const_helper<asiotap::osi::icmpv6_frame> icmpv6_helper_type;
 			typedef asiotap::osi::const_helper<asiotap::osi::arp_frame> arp_helper_type;
 			typedef asiotap::osi::const_helper<asiotap::osi::dhcp_frame> dhcp_helper_type;
+			typedef asiotap::osi::const_helper<asiotap::osi::ndp_frame> ndp_helper_type;
 			typedef asiotap::osi::proxy<asiotap::osi::arp_frame> arp_proxy_type;
 			typedef asiotap::osi::proxy<asiotap::osi::dhcp_frame> dhcp_proxy_type;
+			typedef asiotap::osi::proxy<asiotap::osi::ndp_frame> ndp_proxy_type;
 
 			void open_tap_adapter();
 			void close_tap_adapter();
@@ -575,25 +586,22 @@ namespace freelan
 
 			void do_handle_tap_adapter_read(fscp::SharedBuffer, const boost::system::error_code&, size_t);
 			void do_handle_tap_adapter_write(const boost::system::error_code&);
-			void do_handle_arp_frame(const arp_helper_type&);
-			void do_handle_dhcp_frame(const dhcp_helper_type&);
+			bool do_handle_arp_frame(const arp_helper_type&, const ethernet_helper_type&);
+			bool do_handle_dhcp_frame(const dhcp_helper_type&, const bootp_helper_type&, const udp_helper_type&, const ipv4_helper_type&, const ethernet_helper_type&);
 			bool do_handle_arp_request(const boost::asio::ip::address_v4&, ethernet_address_type&);
+			bool do_handle_ndp_frame(const ndp_helper_type&, const icmpv6_helper_type&, const ipv6_helper_type&, const ethernet_helper_type&);
+			bool do_handle_neighbor_solicitation(const boost::asio::ip::address_v6&, ethernet_address_type&);
 
 			boost::shared_ptr<asiotap::tap_adapter> m_tap_adapter;
+			port_handle_type m_tap_adapter_port;
 			boost::asio::strand m_tap_adapter_strand;
 			boost::asio::strand m_proxies_strand;
 			std::queue<void_handler_type> m_tap_write_queue;
 			boost::asio::strand m_tap_write_queue_strand;
 
-			ethernet_filter_type m_ethernet_filter;
-			arp_filter_type m_arp_filter;
-			ipv4_filter_type m_ipv4_filter;
-			udp_filter_type m_udp_filter;
-			bootp_filter_type m_bootp_filter;
-			dhcp_filter_type m_dhcp_filter;
-
 			boost::scoped_ptr<arp_proxy_type> m_arp_proxy;
 			boost::scoped_ptr<dhcp_proxy_type> m_dhcp_proxy;
+			boost::scoped_ptr<ndp_proxy_type> m_ndp_proxy;
 
 		private: /* Switch & router */
 
@@ -604,7 +612,9 @@ namespace freelan
 				client_router_info_type() :
 					version(),
 					system_route_entries(),
-					saved_system_route()
+					saved_system_route(),
+					metric(),
+					round_trip_time()
 				{}
 
 				bool is_older_than(routes_message::version_type _version)
@@ -615,10 +625,24 @@ namespace freelan
 				boost::optional<routes_message::version_type> version;
 				std::vector<asiotap::route_manager::entry_type> system_route_entries;
 				asiotap::route_manager::entry_type saved_system_route;
+				routes_message::metric_type metric;
+				boost::optional<boost::posix_time::time_duration> round_trip_time;
 			};
 
 			typedef std::map<ep_type, client_router_info_type> client_router_info_map_type;
 
+			/**
+			 * \brief The handles of the ports of the hosts, as returned when they got registered.
+			 *
+			 * A table is never modified once published: the registrations publish a new one.
+			 */
+			typedef std::map<ep_type, port_handle_type> endpoint_port_map_type;
+
+			/**
+			 * \brief The largest frames that reach the hosts without being fragmented, as of their last path MTU discovery.
+			 */
+			typedef std::map<ep_type, unsigned int> path_mtu_map_type;
+
 			void async_register_switch_port(const ep_type& host, void_handler_type handler)
 			{
 				m_router_strand.post(boost::bind(&core::do_register_switch_port, this, host, handler));
@@ -649,31 +673,46 @@ namespace freelan
 				m_router_strand.post(boost::bind(&core::do_clear_client_router_info, this, host, handler));
 			}
 
+			// Forwarding only reads the published port snapshots: unlike the registrations, it runs on the calling thread.
 			template <typename WriteHandler>
-			void async_write_switch(const port_index_type& index, boost::asio::const_buffer data, WriteHandler handler)
+			void async_write_switch(const port_handle_type& source, boost::asio::const_buffer data, WriteHandler handler)
 			{
-				m_router_strand.post(boost::bind(&core::do_write_switch, this, index, data, handler));
+				do_write_switch(source, data, handler);
 			}
 
 			template <typename WriteHandler>
-			void async_write_router(const port_index_type& index, boost::asio::const_buffer data, WriteHandler handler)
+			void async_write_router(const port_handle_type& source, boost::asio::const_buffer data, WriteHandler handler)
 			{
-				m_router_strand.post(boost::bind(&core::do_write_router, this, index, data, handler));
+				do_write_router(source, data, handler);
 			}
 
+			port_handle_type get_endpoint_port(const ep_type&) const;
+
 			void do_register_switch_port(const ep_type&, void_handler_type);
 			void do_register_router_port(const ep_type&, void_handler_type);
 			void do_unregister_switch_port(const ep_type&, void_handler_type);
 			void do_unregister_router_port(const ep_type&, void_handler_type);
 			void do_save_system_route(const ep_type&, const route_type&, void_handler_type);
 			void do_clear_client_router_info(const ep_type&, void_handler_type);
-			void do_write_switch(const port_index_type&, boost::asio::const_buffer, switch_::multi_write_handler_type);
-			void do_write_router(const port_index_type&, boost::asio::const_buffer, router::port_type::write_handler_type);
+			void do_set_path_mtu(const ep_type&, unsigned int);
+			void forget_path_mtu(const ep_type&);
+			void update_switch_tcp_mss_clamping_mtu();
+			void do_write_switch(const port_handle_type&, boost::asio::const_buffer, switch_::port_type::write_handler_type);
+			void do_write_router(const port_handle_type&, boost::asio::const_buffer, router::port_type::write_handler_type);
+			void set_endpoint_port(const ep_type&, const port_handle_type&);
+			void erase_endpoint_port(const ep_type&);
 
 			boost::asio::strand m_router_strand;
 
 			switch_ m_switch;
 			router m_router;
+
+			// Always accessed through boost::atomic_load() and boost::atomic_store().
+			boost::shared_ptr<const endpoint_port_map_type> m_endpoint_ports;
+
+			unsigned int m_tcp_mss_clamping_mtu;
+			path_mtu_map_type m_path_mtus;
+
 			asiotap::route_manager m_route_manager;
 			boost::optional<routes_message::version_type> m_local_routes_version;
 			client_router_info_map_type m_client_router_info_map;
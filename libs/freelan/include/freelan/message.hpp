@@ -120,6 +120,20 @@ namespace freelan
 			 */
 			const uint8_t* payload() const;
 
+			/**
+			 * \brief Get the trailer data.
+			 * \return The bytes that follow the payload in the buffer.
+			 *
+			 * Peers ignore whatever follows the payload of a message, which makes the trailer the place for extensions that older peers must not see.
+			 */
+			const uint8_t* trailer() const;
+
+			/**
+			 * \brief Get the length of the trailer.
+			 * \return The length of the trailer.
+			 */
+			size_t trailer_length() const;
+
 		protected:
 
 			/**
@@ -130,6 +144,7 @@ namespace freelan
 		private:
 
 			const void* m_data;
+			size_t m_buf_len;
 	};
 
 	inline message::message_type message::type() const
@@ -156,6 +171,16 @@ namespace freelan
 	{
 		return static_cast<const uint8_t*>(m_data) + HEADER_LENGTH;
 	}
+
+	inline const uint8_t* message::trailer() const
+	{
+		return static_cast<const uint8_t*>(m_data) + size();
+	}
+
+	inline size_t message::trailer_length() const
+	{
+		return m_buf_len - size();
+	}
 }
 
 #endif /* FREELAN_MESSAGE_HPP */
@@ -54,6 +54,8 @@
 #include <boost/shared_ptr.hpp>
 
 #include <cassert>
+#include <map>
+#include <set>
 
 namespace freelan
 {
@@ -185,6 +187,139 @@ namespace freelan
 	{
 		return endpoint_port_index_type(ep);
 	}
+
+	/**
+	 * \brief A dense port identifier type.
+	 *
+	 * Port identifiers are allocated when a port is registered and reused once it gets unregistered, so that they can index vectors.
+	 */
+	typedef unsigned int port_id_type;
+
+	/**
+	 * \brief The invalid port identifier.
+	 */
+	const port_id_type INVALID_PORT_ID = static_cast<port_id_type>(-1);
+
+	/**
+	 * \brief A handle to a registered port.
+	 *
+	 * Designates a port by its identifier, without any lookup. The generation tells apart the successive ports that got the same identifier: a handle that outlives its port never designates another one. A default handle designates no port.
+	 */
+	struct port_handle_type
+	{
+		port_handle_type() : id(INVALID_PORT_ID), generation(0) {}
+		port_handle_type(port_id_type _id, unsigned int _generation) : id(_id), generation(_generation) {}
+
+		port_id_type id;
+		unsigned int generation;
+
+		friend bool operator<(const port_handle_type& lhs, const port_handle_type& rhs)
+		{
+			return (lhs.id < rhs.id) || ((lhs.id == rhs.id) && (lhs.generation < rhs.generation));
+		}
+	};
+
+	/**
+	 * \brief A port identifier table.
+	 *
+	 * Associates a dense identifier to every allocated port index.
+	 */
+	class port_id_table
+	{
+		public:
+
+			/**
+			 * \brief Create an empty port identifier table.
+			 */
+			port_id_table() :
+				m_ids(),
+				m_free_ids(),
+				m_size(0)
+			{}
+
+			/**
+			 * \brief Get the identifier of a port index, allocating it if needed.
+			 * \param index The port index.
+			 * \return The port identifier.
+			 */
+			port_id_type allocate(const port_index_type& index)
+			{
+				const id_map_type::const_iterator entry = m_ids.find(index);
+
+				if (entry != m_ids.end())
+				{
+					return entry->second;
+				}
+
+				port_id_type id;
+
+				// We reuse the lowest released identifiers first to keep the vectors dense.
+				if (!m_free_ids.empty())
+				{
+					id = *m_free_ids.begin();
+					m_free_ids.erase(m_free_ids.begin());
+				}
+				else
+				{
+					id = m_size++;
+				}
+
+				m_ids[index] = id;
+
+				return id;
+			}
+
+			/**
+			 * \brief Release the identifier of a port index.
+			 * \param index The port index.
+			 * \return The released identifier, or INVALID_PORT_ID if index had none.
+			 */
+			port_id_type release(const port_index_type& index)
+			{
+				const id_map_type::iterator entry = m_ids.find(index);
+
+				if (entry == m_ids.end())
+				{
+					return INVALID_PORT_ID;
+				}
+
+				const port_id_type id = entry->second;
+
+				m_ids.erase(entry);
+				m_free_ids.insert(id);
+
+				return id;
+			}
+
+			/**
+			 * \brief Find the identifier of a port index.
+			 * \param index The port index.
+			 * \return The port identifier, or INVALID_PORT_ID if index has none.
+			 */
+			port_id_type find(const port_index_type& index) const
+			{
+				const id_map_type::const_iterator entry = m_ids.find(index);
+
+				return (entry != m_ids.end()) ? entry->second : INVALID_PORT_ID;
+			}
+
+			/**
+			 * \brief Get the identifiers upper bound.
+			 * \return A value strictly greater than all the allocated identifiers.
+			 */
+			port_id_type size() const
+			{
+				return m_size;
+			}
+
+		private:
+
+			typedef std::map<port_index_type, port_id_type> id_map_type;
+
+			id_map_type m_ids;
+			std::set<port_id_type> m_free_ids;
+			port_id_type m_size;
+	};
 }
 
 #endif /* PORT_INDEX_HPP */
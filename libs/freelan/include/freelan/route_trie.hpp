@@ -0,0 +1,368 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file route_trie.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A longest-prefix match trie.
+ */
+
+#ifndef ROUTE_TRIE_HPP
+#define ROUTE_TRIE_HPP
+
+#include <algorithm>
+#include <array>
+#include <tuple>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/array.hpp>
+
+#include <asiotap/types/ip_network_address.hpp>
+
+namespace freelan
+{
+	/**
+	 * \brief A path-compressed binary trie, used for longest-prefix matching.
+	 *
+	 * Nodes are stored contiguously and reference their children by index. The
+	 * trie is meant to be built once and then queried many times: there is no
+	 * removal, the trie is rebuilt instead.
+	 */
+	template <typename AddressType, typename ValueType>
+	class route_trie
+	{
+		public:
+
+			/**
+			 * \brief The address type.
+			 */
+			typedef AddressType address_type;
+
+			/**
+			 * \brief The value type.
+			 */
+			typedef ValueType value_type;
+
+			/**
+			 * \brief The network address type.
+			 */
+			typedef asiotap::base_ip_network_address<address_type> network_address_type;
+
+			/**
+			 * \brief Create an empty trie.
+			 */
+			route_trie() :
+				m_nodes(1)
+			{}
+
+			/**
+			 * \brief Remove all the values from the trie.
+			 */
+			void clear()
+			{
+				m_nodes.assign(1, node_type());
+			}
+
+			/**
+			 * \brief Insert a value.
+			 * \param network_address The network address to associate the value with. The host bits are ignored.
+			 * \param value The value.
+			 *
+			 * Values associated to a same network are kept in insertion order.
+			 */
+			void insert(const network_address_type& network_address, const value_type& value);
+
+			/**
+			 * \brief Find the values whose network contains a given address.
+			 * \param addr The address.
+			 * \param function The function to call on the matching values, from the most specific network to the least specific one. It must return true to stop the search.
+			 * \return true if function returned true for one of the values.
+			 *
+			 * The search is done in O(prefix length).
+			 */
+			template <typename Function>
+			bool find(const address_type& addr, Function function) const;
+
+			/**
+			 * \brief Find the networks that contain a given address.
+			 * \param addr The address.
+			 * \param function The function to call on the values of each matching network, from the most specific network to the least specific one. It gets a const std::vector<value_type>& and must return true to stop the search.
+			 * \return true if function returned true for one of the networks.
+			 *
+			 * The vectors given to function remain valid until the trie is modified.
+			 */
+			template <typename Function>
+			bool find_networks(const address_type& addr, Function function) const;
+
+			/**
+			 * \brief Get the count of nodes in the trie.
+			 * \return The count of nodes, including the root node.
+			 */
+			size_t node_count() const
+			{
+				return m_nodes.size();
+			}
+
+		private:
+
+			typedef typename address_type::bytes_type key_type;
+
+			static const unsigned int key_length = std::tuple_size<key_type>::value * 8;
+
+			struct node_type
+			{
+				node_type() :
+					key(),
+					prefix_length(0),
+					children(),
+					values()
+				{}
+
+				node_type(const key_type& _key, unsigned int _prefix_length) :
+					key(_key),
+					prefix_length(_prefix_length),
+					children(),
+					values()
+				{}
+
+				key_type key;
+				unsigned int prefix_length;
+				boost::array<size_t, 2> children; // The root node can't be a child: 0 means no child.
+				std::vector<value_type> values;
+			};
+
+			static unsigned int get_bit(const key_type& key, unsigned int position)
+			{
+				return (key[position / 8] >> (7 - position % 8)) & 0x01;
+			}
+
+			static key_type get_masked_key(key_type key, unsigned int prefix_length)
+			{
+				for (unsigned int i = 0; i < key.size(); ++i)
+				{
+					if (prefix_length >= 8)
+					{
+						prefix_length -= 8;
+					}
+					else
+					{
+						key[i] &= static_cast<unsigned char>(0xFF << (8 - prefix_length));
+						prefix_length = 0;
+					}
+				}
+
+				return key;
+			}
+
+			static unsigned int get_common_prefix_length(const key_type& lhs, const key_type& rhs, unsigned int max_length)
+			{
+				unsigned int length = 0;
+
+				while ((length < max_length) && (get_bit(lhs, length) == get_bit(rhs, length)))
+				{
+					++length;
+				}
+
+				return length;
+			}
+
+			static bool has_prefix(const key_type& key, const key_type& prefix, unsigned int prefix_length)
+			{
+				const unsigned int bytes = prefix_length / 8;
+
+				if (!std::equal(prefix.begin(), prefix.begin() + bytes, key.begin()))
+				{
+					return false;
+				}
+
+				const unsigned int bits = prefix_length % 8;
+
+				if (bits == 0)
+				{
+					return true;
+				}
+
+				const unsigned char mask = static_cast<unsigned char>(0xFF << (8 - bits));
+
+				return ((key[bytes] & mask) == prefix[bytes]);
+			}
+
+			size_t add_node(const key_type& key, unsigned int prefix_length)
+			{
+				m_nodes.push_back(node_type(get_masked_key(key, prefix_length), prefix_length));
+
+				return m_nodes.size() - 1;
+			}
+
+			std::vector<node_type> m_nodes;
+	};
+
+	template <typename AddressType, typename ValueType>
+	const unsigned int route_trie<AddressType, ValueType>::key_length;
+
+	template <typename AddressType, typename ValueType>
+	inline void route_trie<AddressType, ValueType>::insert(const network_address_type& network_address, const value_type& value)
+	{
+		const unsigned int prefix_length = std::min(network_address.prefix_length(), key_length);
+		const key_type key = get_masked_key(network_address.address().to_bytes(), prefix_length);
+
+		size_t current = 0;
+
+		for (;;)
+		{
+			if (m_nodes[current].prefix_length == prefix_length)
+			{
+				m_nodes[current].values.push_back(value);
+
+				return;
+			}
+
+			const unsigned int branch = get_bit(key, m_nodes[current].prefix_length);
+			const size_t child = m_nodes[current].children[branch];
+
+			if (child == 0)
+			{
+				const size_t leaf = add_node(key, prefix_length);
+				m_nodes[leaf].values.push_back(value);
+				m_nodes[current].children[branch] = leaf;
+
+				return;
+			}
+
+			const unsigned int common_prefix_length = get_common_prefix_length(key, m_nodes[child].key, std::min(prefix_length, m_nodes[child].prefix_length));
+
+			if (common_prefix_length == m_nodes[child].prefix_length)
+			{
+				current = child;
+
+				continue;
+			}
+
+			// The child node diverges from the key: we split its edge.
+			const size_t middle = add_node(key, common_prefix_length);
+			m_nodes[middle].children[get_bit(m_nodes[child].key, common_prefix_length)] = child;
+			m_nodes[current].children[branch] = middle;
+
+			if (common_prefix_length == prefix_length)
+			{
+				m_nodes[middle].values.push_back(value);
+			}
+			else
+			{
+				const size_t leaf = add_node(key, prefix_length);
+				m_nodes[leaf].values.push_back(value);
+				m_nodes[middle].children[get_bit(key, common_prefix_length)] = leaf;
+			}
+
+			return;
+		}
+	}
+
+	template <typename AddressType, typename ValueType>
+	template <typename Function>
+	inline bool route_trie<AddressType, ValueType>::find(const address_type& addr, Function function) const
+	{
+		return find_networks(addr, [&function] (const std::vector<value_type>& values) {
+			for (auto&& value : values)
+			{
+				if (function(value))
+				{
+					return true;
+				}
+			}
+
+			return false;
+		});
+	}
+
+	template <typename AddressType, typename ValueType>
+	template <typename Function>
+	inline bool route_trie<AddressType, ValueType>::find_networks(const address_type& addr, Function function) const
+	{
+		const key_type key = addr.to_bytes();
+
+		// There can't be more matching nodes than there are prefix lengths.
+		boost::array<size_t, key_length + 1> matching_nodes;
+		size_t matching_nodes_count = 0;
+
+		size_t current = 0;
+
+		for (;;)
+		{
+			const node_type& node = m_nodes[current];
+
+			// Path compression skips bits: they must be checked.
+			if (!has_prefix(key, node.key, node.prefix_length))
+			{
+				break;
+			}
+
+			if (!node.values.empty())
+			{
+				matching_nodes[matching_nodes_count++] = current;
+			}
+
+			if (node.prefix_length == key_length)
+			{
+				break;
+			}
+
+			current = node.children[get_bit(key, node.prefix_length)];
+
+			if (current == 0)
+			{
+				break;
+			}
+		}
+
+		while (matching_nodes_count > 0)
+		{
+			if (function(m_nodes[matching_nodes[--matching_nodes_count]].values))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
+
+#endif /* ROUTE_TRIE_HPP */
+
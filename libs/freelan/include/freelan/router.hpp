@@ -47,16 +47,20 @@
 #define ROUTER_HPP
 
 #include <algorithm>
+#include <array>
+#include <cassert>
+#include <atomic>
 #include <map>
 #include <set>
+#include <tuple>
+#include <vector>
 
 #include <boost/asio.hpp>
 #include <boost/array.hpp>
 #include <boost/optional.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
 
-#include <asiotap/osi/ipv4_filter.hpp>
-#include <asiotap/osi/ipv6_filter.hpp>
 #include <asiotap/osi/ipv4_frame.hpp>
 #include <asiotap/osi/ipv6_frame.hpp>
 #include <asiotap/types/ip_network_address.hpp>
@@ -64,6 +68,7 @@
 #include "configuration.hpp"
 #include "port_index.hpp"
 #include "routes_message.hpp"
+#include "route_trie.hpp"
 
 namespace freelan
 {
@@ -103,6 +108,8 @@ namespace freelan
 						m_write_function(),
 						m_local_routes(),
 						m_group(),
+						m_weight(1),
+						m_cost(0),
 						m_router(NULL)
 					{}
 
@@ -110,13 +117,19 @@ namespace freelan
 					 * \brief Create a new port.
 					 * \param write_function The write function to use.
 					 * \param _group The group this port belongs to.
+					 * \param _weight The share of the flows the port gets when other ports announce the same routes. Cannot be zero.
 					 */
-					port_type(write_function_type write_function, port_group_type _group) :
+					port_type(write_function_type write_function, port_group_type _group, unsigned int _weight = 1) :
 						m_write_function(write_function),
 						m_local_routes(),
 						m_group(_group),
+						m_weight(_weight),
+						m_cost(0),
+						m_tcp_mss_clamping_mtu(0),
 						m_router(NULL)
-					{}
+					{
+						assert(m_weight > 0);
+					}
 
 					/**
 					 * \brief Copy constructor.
@@ -126,6 +139,9 @@ namespace freelan
 						m_write_function(other.m_write_function),
 						m_local_routes(other.m_local_routes),
 						m_group(other.m_group),
+						m_weight(other.m_weight),
+						m_cost(other.m_cost),
+						m_tcp_mss_clamping_mtu(other.m_tcp_mss_clamping_mtu),
 						m_router(NULL)
 					{}
 
@@ -149,6 +165,9 @@ namespace freelan
 						m_write_function = other.m_write_function;
 						m_local_routes = other.m_local_routes;
 						m_group = other.m_group;
+						m_weight = other.m_weight;
+						m_cost = other.m_cost;
+						m_tcp_mss_clamping_mtu = other.m_tcp_mss_clamping_mtu;
 
 						return *this;
 					}
@@ -174,7 +193,7 @@ namespace freelan
 
 						if (m_router)
 						{
-							m_router->invalidate_routes();
+							m_router->publish_snapshot();
 						}
 					}
 
@@ -183,33 +202,81 @@ namespace freelan
 						return m_group;
 					}
 
-				private:
+					unsigned int weight() const
+					{
+						return m_weight;
+					}
 
-					void associate_to_router(router* _router)
+					unsigned int cost() const
 					{
-						m_router = _router;
+						return m_cost;
+					}
+
+					/**
+					 * \brief Set the cost of the port.
+					 * \param _cost The cost. When several ports announce the most specific route to a destination, only the ones with the lowest cost are used.
+					 */
+					void set_cost(unsigned int _cost)
+					{
+						if (m_cost == _cost)
+						{
+							return;
+						}
+
+						m_cost = _cost;
 
 						if (m_router)
 						{
-							m_router->invalidate_routes();
+							m_router->publish_snapshot();
 						}
 					}
 
-					void dissociate_from_router()
+					unsigned int tcp_mss_clamping_mtu() const
 					{
-						if (m_router)
+						return m_tcp_mss_clamping_mtu;
+					}
+
+					/**
+					 * \brief Set the MTU the TCP segments routed to the port get clamped to.
+					 * \param mtu The MTU, usually the one of the path to the port. 0 means the router MTU applies alone.
+					 *
+					 * The segments are clamped to the lowest of this MTU and the router one, and only if the router clamps them at all.
+					 */
+					void set_tcp_mss_clamping_mtu(unsigned int mtu)
+					{
+						if (m_tcp_mss_clamping_mtu == mtu)
 						{
-							m_router->invalidate_routes();
+							return;
+						}
 
-							m_router = NULL;
+						m_tcp_mss_clamping_mtu = mtu;
+
+						if (m_router)
+						{
+							m_router->publish_snapshot();
 						}
 					}
 
+				private:
+
+					void associate_to_router(router* _router)
+					{
+						m_router = _router;
+					}
+
+					void dissociate_from_router()
+					{
+						m_router = NULL;
+					}
+
 					friend class router;
 
 					write_function_type m_write_function;
 					asiotap::ip_route_set m_local_routes;
 					port_group_type m_group;
+					unsigned int m_weight;
+					unsigned int m_cost;
+					unsigned int m_tcp_mss_clamping_mtu;
 					router* m_router;
 			};
 
@@ -223,28 +290,64 @@ namespace freelan
 			 * \param configuration The router configuration.
 			 */
 			router(const router_configuration& configuration) :
-				m_configuration(configuration)
+				m_configuration(configuration),
+				m_tcp_mss_clamping_mtu(0),
+				m_last_port_generation(0),
+				m_snapshot(boost::make_shared<snapshot_type>())
 			{}
 
 			/**
-			 * \brief Invalidate the routes cache.
+			 * \brief Set the MTU the TCP segments get clamped to.
+			 * \param mtu The MTU. 0 disables the clamping.
+			 *
+			 * May be called at any time: the packets being forwarded meanwhile are clamped to either value.
+			 */
+			void set_tcp_mss_clamping_mtu(unsigned int mtu)
+			{
+				m_tcp_mss_clamping_mtu.store(mtu, std::memory_order_relaxed);
+			}
+
+			/**
+			 * \brief Get the MTU the TCP segments get clamped to.
+			 * \return The MTU. 0 means the clamping is disabled.
 			 */
-			void invalidate_routes()
+			unsigned int tcp_mss_clamping_mtu() const
 			{
-				m_routes = boost::none;
+				return m_tcp_mss_clamping_mtu.load(std::memory_order_relaxed);
 			}
 
 			/**
 			 * \brief Register a router port.
 			 * \param index The index of the port.
 			 * \param port The port to register. Cannot be null.
+			 * \return The handle of the port, to pass to async_write(). Registering the same index again keeps the same handle.
+			 *
+			 * Calls to register_port(), unregister_port(), port_type::set_local_routes() and port_type::set_cost() must be serialized.
 			 */
-			void register_port(port_index_type index, port_type port)
+			port_handle_type register_port(port_index_type index, port_type port)
 			{
 				port_type& local_port = (m_ports[index] = port);
 
-				// This takes care of automatically clearing the route cache whenever needed.
+				// This takes care of automatically publishing the routes whenever they change.
 				local_port.associate_to_router(this);
+
+				const bool is_new = (m_port_ids.find(index) == INVALID_PORT_ID);
+				const port_id_type port_id = m_port_ids.allocate(index);
+
+				if (m_port_generations.size() <= port_id)
+				{
+					m_port_generations.resize(port_id + 1, 0);
+				}
+
+				if (is_new)
+				{
+					// The handles of a previous owner of the identifier won't match the new generation.
+					m_port_generations[port_id] = ++m_last_port_generation;
+				}
+
+				publish_snapshot();
+
+				return port_handle_type(port_id, m_port_generations[port_id]);
 			}
 
 			/**
@@ -255,7 +358,12 @@ namespace freelan
 			 */
 			void unregister_port(port_index_type index)
 			{
-				m_ports.erase(index);
+				if (m_ports.erase(index) > 0)
+				{
+					m_port_generations[m_port_ids.release(index)] = 0;
+
+					publish_snapshot();
+				}
 			}
 
 			/**
@@ -287,30 +395,180 @@ namespace freelan
 
 			/**
 			 * \brief Receive data trough the specified port.
-			 * \param index The port from which the data comes.
+			 * \param source The handle of the port from which the data comes, as returned by register_port(). The data is dropped if the port was unregistered since.
 			 * \param data The data to write.
 			 * \param handler The handler to call when the write is complete.
+			 *
+			 * This only reads the last published snapshot and can be called from any thread, concurrently with the registration functions.
 			 */
-			void async_write(port_index_type index, boost::asio::const_buffer data, port_type::write_handler_type handler);
+			void async_write(const port_handle_type& source, boost::asio::const_buffer data, port_type::write_handler_type handler) const;
 
 		private:
 
-			port_list_type::const_iterator get_target_for(port_index_type, boost::asio::const_buffer);
+			/**
+			 * \brief A port entry type.
+			 */
+			struct port_entry_type
+			{
+				port_entry_type() : index(), port(), generation(0) {}
+
+				port_index_type index;
+				port_type port;
+				unsigned int generation;
+			};
 
+			/**
+			 * \brief The port table type, indexed by port identifier.
+			 */
+			typedef std::vector<port_entry_type> port_table_type;
+
+			/**
+			 * \brief The compiled routes type.
+			 *
+			 * Each family has its own trie, which references the ports that announced a given route.
+			 */
+			struct routes_type
+			{
+				route_trie<boost::asio::ip::address_v4, port_id_type> ipv4;
+				route_trie<boost::asio::ip::address_v6, port_id_type> ipv6;
+
+				const route_trie<boost::asio::ip::address_v4, port_id_type>& get(const boost::asio::ip::address_v4&) const
+				{
+					return ipv4;
+				}
+
+				const route_trie<boost::asio::ip::address_v6, port_id_type>& get(const boost::asio::ip::address_v6&) const
+				{
+					return ipv6;
+				}
+			};
+
+			/**
+			 * \brief The flow cache size, per address family, as a power of two.
+			 */
+			static const unsigned int FLOW_CACHE_BITS = 8;
+
+			/**
+			 * \brief The flow cache size, per address family.
+			 */
+			static const size_t FLOW_CACHE_SIZE = static_cast<size_t>(1) << FLOW_CACHE_BITS;
+
+			/**
+			 * \brief A routing verdict type.
+			 *
+			 * Holds the ports that announced the most specific route to a destination. Only the eligible ones with the lowest cost are used. When there is only one of them, it is the target and no flow hashing is needed. Otherwise, candidates points to the ports of the route in the snapshot tries, of which the used ones weigh total_weight.
+			 */
+			struct verdict_type
+			{
+				verdict_type() :
+					target(INVALID_PORT_ID),
+					candidates(nullptr),
+					cost(0),
+					total_weight(0)
+				{}
+
+				port_id_type target;
+				const std::vector<port_id_type>* candidates;
+				unsigned int cost;
+				unsigned int total_weight;
+			};
+
+			/**
+			 * \brief A flow cache entry type.
+			 *
+			 * Caches the routing verdict for a destination and a source port group. Entries are shared by all the forwarding threads and are protected by a sequence lock: the sequence is odd while an update is in progress and 0 if the entry was never written.
+			 *
+			 * The fields the sequence lock protects are relaxed atomics: readers may see them change under their feet, but that is not a data race.
+			 */
 			template <typename AddressType>
-			port_list_type::const_iterator get_target_for(port_index_type, const AddressType&);
+			struct flow_cache_entry_type
+			{
+				/**
+				 * \brief The key size, in words: the destination address bytes followed by the source port group.
+				 */
+				static const size_t KEY_SIZE = std::tuple_size<typename AddressType::bytes_type>::value / sizeof(uint32_t) + 1;
+
+				/**
+				 * \brief The key type.
+				 */
+				typedef boost::array<uint32_t, KEY_SIZE> key_type;
+
+				flow_cache_entry_type() :
+					sequence(0),
+					target(INVALID_PORT_ID),
+					candidates(nullptr),
+					cost(0),
+					total_weight(0)
+				{
+					for (auto&& word : key)
+					{
+						word.store(0, std::memory_order_relaxed);
+					}
+				}
 
-			router_configuration m_configuration;
+				static key_type make_key(const AddressType&, port_group_type);
 
-			port_list_type m_ports;
+				bool load(const AddressType&, port_group_type, verdict_type&) const;
+				void store(const AddressType&, port_group_type, const verdict_type&);
+
+				mutable std::atomic<unsigned int> sequence;
+				boost::array<std::atomic<uint32_t>, KEY_SIZE> key;
+				std::atomic<port_id_type> target;
+				std::atomic<const std::vector<port_id_type>*> candidates;
+				std::atomic<unsigned int> cost;
+				std::atomic<unsigned int> total_weight;
+			};
+
+			typedef boost::array<flow_cache_entry_type<boost::asio::ip::address_v4>, FLOW_CACHE_SIZE> ipv4_flow_cache_type;
+			typedef boost::array<flow_cache_entry_type<boost::asio::ip::address_v6>, FLOW_CACHE_SIZE> ipv6_flow_cache_type;
 
-			asiotap::osi::filter<asiotap::osi::ipv4_frame> m_ipv4_filter;
-			asiotap::osi::filter<asiotap::osi::ipv6_frame> m_ipv6_filter;
+			static size_t get_flow_cache_slot(const boost::asio::ip::address_v4&, port_group_type);
+			static size_t get_flow_cache_slot(const boost::asio::ip::address_v6&, port_group_type);
+
+			/**
+			 * \brief A snapshot type.
+			 *
+			 * A snapshot holds a copy of the ports, indexed by their identifiers, and their compiled routes. It is never modified once published, except for its flow caches, so forwarding can read it without locking. A new snapshot comes with empty flow caches, which takes care of invalidating them.
+			 */
+			struct snapshot_type
+			{
+				port_table_type ports;
+				routes_type routes;
+				mutable ipv4_flow_cache_type ipv4_flow_cache;
+				mutable ipv6_flow_cache_type ipv6_flow_cache;
 
-			typedef std::multimap<asiotap::ip_route, port_index_type> routes_port_type;
+				flow_cache_entry_type<boost::asio::ip::address_v4>& get_flow_cache_entry(const boost::asio::ip::address_v4& addr, port_group_type source_group) const
+				{
+					return ipv4_flow_cache[get_flow_cache_slot(addr, source_group)];
+				}
+
+				flow_cache_entry_type<boost::asio::ip::address_v6>& get_flow_cache_entry(const boost::asio::ip::address_v6& addr, port_group_type source_group) const
+				{
+					return ipv6_flow_cache[get_flow_cache_slot(addr, source_group)];
+				}
+			};
+
+			typedef boost::shared_ptr<const snapshot_type> snapshot_ptr;
+
+			void publish_snapshot();
+
+			const port_entry_type* get_target_for(const snapshot_type&, const port_handle_type&, boost::asio::const_buffer) const;
+
+			template <typename AddressType>
+			const port_entry_type* get_target_for(const snapshot_type&, const port_handle_type&, const AddressType&, boost::asio::const_buffer) const;
+
+			bool is_eligible(const snapshot_type&, port_group_type, port_id_type) const;
+
+			router_configuration m_configuration;
+			std::atomic<unsigned int> m_tcp_mss_clamping_mtu;
+
+			port_list_type m_ports;
+			port_id_table m_port_ids;
+			std::vector<unsigned int> m_port_generations;
+			unsigned int m_last_port_generation;
 
-			const routes_port_type& routes() const;
-			mutable boost::optional<routes_port_type> m_routes;
+			// Always accessed through boost::atomic_load() and boost::atomic_store().
+			snapshot_ptr m_snapshot;
 	};
 }
 
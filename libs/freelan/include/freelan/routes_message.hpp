@@ -66,15 +66,21 @@ namespace freelan
 			 */
 			typedef uint32_t version_type;
 
+			/**
+			 * \brief The metric typedef.
+			 */
+			typedef uint32_t metric_type;
+
 			/**
 			 * \brief Write a routes message to a buffer.
 			 * \param buf The buffer to write to.
 			 * \param buf_len The length of buf.
 			 * \param version The version.
 			 * \param routes The routes.
+			 * \param metric The metric of the routes. It is written as an extension in the trailer of the message, where the peers that don't know about metrics never look. A zero metric is not written at all.
 			 * \return The count of bytes written.
 			 */
-			static size_t write(void* buf, size_t buf_len, version_type version, const asiotap::ip_route_set& routes);
+			static size_t write(void* buf, size_t buf_len, version_type version, const asiotap::ip_route_set& routes, metric_type metric = 0);
 
 			/**
 			 * \brief Get the version.
@@ -88,6 +94,12 @@ namespace freelan
 			 */
 			const asiotap::ip_route_set& routes() const;
 
+			/**
+			 * \brief Get the metric of the routes.
+			 * \return The metric. The lower, the better.
+			 */
+			metric_type metric() const;
+
 			/**
 			 * \brief Create a routes_message and map it on a buffer.
 			 * \param buf The buffer.
@@ -105,7 +117,10 @@ namespace freelan
 
 		private:
 
+			void read_extensions();
+
 			mutable boost::optional<asiotap::ip_route_set> m_routes_cache;
+			metric_type m_metric;
 	};
 }
 
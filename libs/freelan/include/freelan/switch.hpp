@@ -47,11 +47,22 @@
 #define SWITCH_HPP
 
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <set>
+#include <vector>
 
 #include <boost/asio.hpp>
 #include <boost/array.hpp>
+#include <boost/optional.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <asiotap/osi/arp_proxy.hpp>
+
+#include <fscp/shared_buffer.hpp>
 
 #include "configuration.hpp"
 #include "port_index.hpp"
@@ -125,7 +136,7 @@ namespace freelan
 					 * \param data The data to write.
 					 * \param handler The handler to call when the write is complete.
 					 */
-					void async_write(boost::asio::const_buffer data, write_handler_type handler)
+					void async_write(boost::asio::const_buffer data, write_handler_type handler) const
 					{
 						m_write_function(data, handler);
 					}
@@ -146,6 +157,22 @@ namespace freelan
 			 */
 			typedef std::map<port_index_type, port_type> port_list_type;
 
+			/**
+			 * \brief The flooded traffic types, subject to storm control.
+			 */
+			enum flooded_traffic_type
+			{
+				FT_BROADCAST, /**< Broadcast frames. */
+				FT_MULTICAST, /**< Multicast frames. */
+				FT_UNKNOWN_UNICAST, /**< Unicast frames with an unknown target. */
+				FT_COUNT /**< The count of flooded traffic types. */
+			};
+
+			/**
+			 * \brief The storm control drop counters type, indexed by flooded traffic type.
+			 */
+			typedef boost::array<uint64_t, FT_COUNT> storm_control_drops_type;
+
 			/**
 			 * \brief Create a new switch.
 			 * \param configuration The switch configuration.
@@ -153,17 +180,62 @@ namespace freelan
 			 */
 			switch_(const switch_configuration& configuration, const unsigned int max_entries = MAX_ENTRIES_DEFAULT) :
 				m_configuration(configuration),
-				m_max_entries(max_entries)
+				m_max_entries(max_entries),
+				m_tcp_mss_clamping_mtu(0),
+				m_last_port_generation(0),
+				m_ports_snapshot(boost::make_shared<ports_snapshot_type>())
 			{}
 
+			/**
+			 * \brief Set the MTU the TCP segments get clamped to.
+			 * \param mtu The MTU. 0 disables the clamping.
+			 *
+			 * May be called at any time: the packets being forwarded meanwhile are clamped to either value.
+			 */
+			void set_tcp_mss_clamping_mtu(unsigned int mtu)
+			{
+				m_tcp_mss_clamping_mtu.store(mtu, std::memory_order_relaxed);
+			}
+
+			/**
+			 * \brief Get the MTU the TCP segments get clamped to.
+			 * \return The MTU. 0 means the clamping is disabled.
+			 */
+			unsigned int tcp_mss_clamping_mtu() const
+			{
+				return m_tcp_mss_clamping_mtu.load(std::memory_order_relaxed);
+			}
+
 			/**
 			 * \brief Register a switch port.
 			 * \param index The index of the port.
 			 * \param port The port to register. Cannot be null.
+			 * \return The handle of the port, to pass to async_write() and async_forward(). Registering the same index again keeps the same handle.
 			 */
-			void register_port(port_index_type index, port_type port)
+			port_handle_type register_port(port_index_type index, port_type port)
 			{
+				boost::mutex::scoped_lock lock(m_state_mutex);
+
 				m_ports[index] = port;
+
+				const bool is_new = (m_port_ids.find(index) == INVALID_PORT_ID);
+				const port_id_type port_id = m_port_ids.allocate(index);
+
+				if (m_port_states.size() <= port_id)
+				{
+					m_port_states.resize(port_id + 1);
+				}
+
+				if (is_new)
+				{
+					// The learnt state that still references a previous owner of the identifier won't match the new generation.
+					m_port_states[port_id].generation = ++m_last_port_generation;
+					m_port_states[port_id].storm_control = boost::make_shared<storm_control_state_type>();
+				}
+
+				publish_ports_snapshot();
+
+				return port_handle_type(port_id, m_port_states[port_id].generation);
 			}
 
 			/**
@@ -174,7 +246,22 @@ namespace freelan
 			 */
 			void unregister_port(port_index_type index)
 			{
+				boost::mutex::scoped_lock lock(m_state_mutex);
+
 				m_ports.erase(index);
+
+				const port_id_type port_id = m_port_ids.release(index);
+
+				if (port_id != INVALID_PORT_ID)
+				{
+					// Forwarding threads may still learn the port from an older snapshot: those entries are ignored since the generation changed.
+					forget_ethernet_port(port_id);
+					forget_multicast_port(port_id);
+					forget_arp_port(port_id);
+					m_port_states[port_id] = port_state_type();
+
+					publish_ports_snapshot();
+				}
 			}
 
 			/**
@@ -189,29 +276,278 @@ namespace freelan
 
 			/**
 			 * \brief Receive data trough the specified port.
-			 * \param index The port from which the data comes.
+			 * \param source The handle of the port from which the data comes, as returned by register_port(). The data is dropped if the port was unregistered since.
 			 * \param data The data to write.
 			 * \param handler The handler to call when the write is complete.
+			 *
+			 * Can be called from any thread, concurrently with the registration functions.
 			 */
-			void async_write(port_index_type index, boost::asio::const_buffer data, multi_write_handler_type handler);
+			void async_write(const port_handle_type& source, boost::asio::const_buffer data, multi_write_handler_type handler);
+
+			/**
+			 * \brief Receive data trough the specified port, without gathering the write results.
+			 * \param source The handle of the port from which the data comes, as returned by register_port(). The data is dropped if the port was unregistered since.
+			 * \param data The data to write.
+			 * \param handler The handler to call when the write is complete.
+			 *
+			 * handler is copied and called once for every target port. This is
+			 * the allocation-free variant to use when the results are ignored.
+			 *
+			 * Can be called from any thread, concurrently with the registration functions.
+			 */
+			void async_forward(const port_handle_type& source, boost::asio::const_buffer data, port_type::write_handler_type handler);
+
+			/**
+			 * \brief Get the count of frames dropped by storm control for a given port.
+			 * \param index The port.
+			 * \return The drop counters, indexed by flooded traffic type.
+			 */
+			storm_control_drops_type get_storm_control_drops(port_index_type index) const;
 
 		private:
 
-			std::set<port_index_type> get_targets_for(port_index_type, boost::asio::const_buffer);
-			std::set<port_index_type> get_targets_for(port_list_type::const_iterator);
+			/**
+			 * \brief The flood list type.
+			 *
+			 * A flood list references the ports that may receive a frame
+			 * flooded from a given port group.
+			 */
+			typedef std::vector<port_id_type> flood_list_type;
+
+			/**
+			 * \brief The flood lists type, indexed by source port group.
+			 */
+			typedef std::map<port_group_type, flood_list_type> flood_lists_type;
+
+			struct storm_control_state_type;
+
+			/**
+			 * \brief The per-port state type.
+			 *
+			 * The generation changes every time the port identifier is allocated to a new port.
+			 */
+			struct port_state_type
+			{
+				port_state_type() : generation(0), storm_control() {}
+
+				unsigned int generation;
+				boost::shared_ptr<storm_control_state_type> storm_control;
+			};
+
+			/**
+			 * \brief A port entry type.
+			 */
+			struct port_entry_type
+			{
+				port_entry_type() : index(), port(), state() {}
+
+				port_index_type index;
+				port_type port;
+				port_state_type state;
+			};
+
+			/**
+			 * \brief A reference to a port, as kept in the learnt state.
+			 */
+			typedef port_handle_type port_ref_type;
+
+			/**
+			 * \brief A list of target ports.
+			 *
+			 * The targets are collected while the learnt state is locked and written to once it is unlocked. The first ones are stored inline, so that unicast frames don't allocate.
+			 */
+			class target_list_type
+			{
+				public:
+
+					target_list_type() : m_inline_targets(), m_other_targets(), m_size(0) {}
+
+					void push_back(const port_entry_type& port_entry)
+					{
+						if (m_size < m_inline_targets.size())
+						{
+							m_inline_targets[m_size] = &port_entry;
+						}
+						else
+						{
+							m_other_targets.push_back(&port_entry);
+						}
+
+						++m_size;
+					}
+
+					size_t size() const { return m_size; }
+
+					const port_entry_type& operator[](size_t i) const
+					{
+						return (i < m_inline_targets.size()) ? *m_inline_targets[i] : *m_other_targets[i - m_inline_targets.size()];
+					}
+
+				private:
+
+					boost::array<const port_entry_type*, 8> m_inline_targets;
+					std::vector<const port_entry_type*> m_other_targets;
+					size_t m_size;
+			};
+
+			/**
+			 * \brief The port table type, indexed by port identifier.
+			 */
+			typedef std::vector<port_entry_type> port_table_type;
+
+			/**
+			 * \brief The ports snapshot type.
+			 *
+			 * A snapshot holds a copy of the ports, indexed by their identifiers, and the flood lists that reference them. It is never modified once published, so forwarding can read it without locking.
+			 */
+			struct ports_snapshot_type
+			{
+				port_table_type ports;
+				flood_lists_type flood_lists;
+			};
+
+			typedef boost::shared_ptr<const ports_snapshot_type> ports_snapshot_ptr;
+
+			static const port_entry_type* find_port(const ports_snapshot_type&, const port_ref_type&);
+			static port_ref_type get_port_ref(const ports_snapshot_type&, port_id_type);
+
+			void select_targets(const ports_snapshot_type&, port_id_type, boost::asio::const_buffer, target_list_type&);
+			void select_flood_targets(const ports_snapshot_type&, port_id_type, target_list_type&);
+
+			void publish_ports_snapshot();
 
 			switch_configuration m_configuration;
 			unsigned int m_max_entries;
+			std::atomic<unsigned int> m_tcp_mss_clamping_mtu;
+
+			// Protects the registrations. Forwarding never takes it.
+			mutable boost::mutex m_state_mutex;
 
 			port_list_type m_ports;
+			port_id_table m_port_ids;
+			std::vector<port_state_type> m_port_states;
+			unsigned int m_last_port_generation;
+
+			// Always accessed through boost::atomic_load() and boost::atomic_store().
+			ports_snapshot_ptr m_ports_snapshot;
 
 			typedef boost::array<uint8_t, 6> ethernet_address_type;
-			typedef std::map<ethernet_address_type, port_index_type> ethernet_address_map_type;
+			typedef std::map<ethernet_address_type, port_ref_type> ethernet_address_map_type;
+
+			/**
+			 * \brief A shard of the ethernet address table.
+			 *
+			 * Addresses are spread across the shards by hash so that forwarding threads rarely wait for one another.
+			 */
+			struct ethernet_address_shard_type
+			{
+				boost::mutex mutex;
+				ethernet_address_map_type entries;
+			};
+
+			static const size_t ETHERNET_ADDRESS_SHARD_COUNT = 16;
 
 			static ethernet_address_type to_ethernet_address(boost::asio::const_buffer);
+			static ethernet_address_type to_ethernet_address(const boost::asio::ip::address_v4&);
+			static ethernet_address_type to_ethernet_address(const boost::asio::ip::address_v6&);
 			static bool is_multicast_address(const ethernet_address_type&);
+			static bool is_flooded_multicast_address(const ethernet_address_type&);
+
+			ethernet_address_shard_type& get_ethernet_address_shard(const ethernet_address_type&);
+			void learn_ethernet_address(const ethernet_address_type&, const port_ref_type&);
+			port_ref_type find_ethernet_address(const ethernet_address_type&);
+			void forget_ethernet_port(port_id_type);
+
+			boost::array<ethernet_address_shard_type, ETHERNET_ADDRESS_SHARD_COUNT> m_ethernet_address_shards;
+
+			/**
+			 * \brief The multicast port map type.
+			 *
+			 * Associates a port to the expiration time of its membership.
+			 */
+			typedef std::map<port_ref_type, boost::posix_time::ptime> multicast_port_map_type;
+
+			/**
+			 * \brief The multicast group map type.
+			 *
+			 * Groups are identified by their ethernet address.
+			 */
+			typedef std::map<ethernet_address_type, multicast_port_map_type> multicast_group_map_type;
+
+			bool snoop_multicast_membership(const port_ref_type&, boost::asio::const_buffer);
+			void snoop_igmp(const port_ref_type&, boost::asio::const_buffer);
+			void snoop_mld(const port_ref_type&, boost::asio::const_buffer);
+			void add_multicast_listener(const port_ref_type&, const ethernet_address_type&);
+			void remove_multicast_listener(const port_ref_type&, const ethernet_address_type&);
+			void forget_multicast_port(port_id_type);
+
+			bool select_multicast_targets(const ports_snapshot_type&, port_id_type, const ethernet_address_type&, target_list_type&);
+
+			// Protects the multicast memberships, which only multicast frames use.
+			boost::mutex m_multicast_mutex;
+			multicast_group_map_type m_multicast_groups;
+			multicast_port_map_type m_multicast_routers;
+
+			/**
+			 * \brief An ARP binding type.
+			 *
+			 * The hardware address lives in the ARP proxy.
+			 */
+			struct arp_binding_type
+			{
+				port_ref_type port;
+				boost::posix_time::ptime expiration;
+			};
+
+			typedef std::map<boost::asio::ip::address_v4, arp_binding_type> arp_binding_map_type;
+
+			/**
+			 * \brief The ARP response type.
+			 *
+			 * The buffer that holds the response, and the response itself.
+			 */
+			typedef std::pair<fscp::SharedBuffer, boost::asio::const_buffer> arp_response_type;
+
+			boost::optional<arp_response_type> process_arp_frame(const ports_snapshot_type&, port_id_type, boost::asio::const_buffer);
+			void learn_arp_binding(const port_ref_type&, const boost::asio::ip::address_v4&, const ethernet_address_type&);
+			void forget_arp_binding(arp_binding_map_type::iterator);
+			void forget_arp_port(port_id_type);
+
+			// Protects the ARP bindings and the ARP proxy, which only ARP frames use.
+			boost::mutex m_arp_mutex;
+			arp_binding_map_type m_arp_bindings;
+			asiotap::osi::proxy<asiotap::osi::arp_frame> m_arp_proxy;
+
+			/**
+			 * \brief A token bucket type.
+			 *
+			 * Tokens are frames. A bucket that was never used is full.
+			 */
+			struct token_bucket_type
+			{
+				token_bucket_type() : tokens(0), last_refill() {}
+
+				double tokens;
+				boost::posix_time::ptime last_refill;
+			};
+
+			/**
+			 * \brief The storm control state of a port.
+			 *
+			 * Only the frames that come from the port use it, so its lock is rarely contended.
+			 */
+			struct storm_control_state_type
+			{
+				storm_control_state_type() : mutex(), buckets(), drops() {}
+
+				boost::mutex mutex;
+				boost::array<token_bucket_type, FT_COUNT> buckets;
+				storm_control_drops_type drops;
+			};
 
-			ethernet_address_map_type m_ethernet_address_map;
+			static flooded_traffic_type get_flooded_traffic_type(const ethernet_address_type&);
+			unsigned int get_rate_limit(flooded_traffic_type) const;
+			bool storm_control_admit(const port_entry_type&, flooded_traffic_type);
 	};
 }
 
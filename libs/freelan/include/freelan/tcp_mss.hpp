@@ -0,0 +1,84 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file tcp_mss.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief TCP MSS clamping functions.
+ */
+
+#ifndef TCP_MSS_HPP
+#define TCP_MSS_HPP
+
+#include <fscp/shared_buffer.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/optional.hpp>
+
+#include <utility>
+
+namespace freelan
+{
+	/**
+	 * \brief A clamped packet type.
+	 *
+	 * The buffer owns the data.
+	 */
+	typedef std::pair<fscp::SharedBuffer, boost::asio::const_buffer> tcp_mss_clamped_packet_type;
+
+	/**
+	 * \brief Clamp the MSS option of a TCP SYN segment, in an IP packet.
+	 * \param packet The IPv4 or IPv6 packet.
+	 * \param mtu The MTU of the path. 0 disables the clamping.
+	 * \return A clamped copy of packet, if it is a TCP SYN segment that announces a MSS too big for mtu.
+	 *
+	 * The segments are clamped in both directions, so checking SYN segments covers the SYN-ACK ones too. The packet is only copied when it needs clamping, which keeps the usual path free of any copy.
+	 */
+	boost::optional<tcp_mss_clamped_packet_type> clamp_tcp_mss(boost::asio::const_buffer packet, unsigned int mtu);
+
+	/**
+	 * \brief Clamp the MSS option of a TCP SYN segment, in an ethernet frame.
+	 * \param frame The ethernet frame.
+	 * \param mtu The MTU of the path. 0 disables the clamping.
+	 * \return A clamped copy of frame, if it carries a TCP SYN segment that announces a MSS too big for mtu.
+	 */
+	boost::optional<tcp_mss_clamped_packet_type> clamp_ethernet_tcp_mss(boost::asio::const_buffer frame, unsigned int mtu);
+}
+
+#endif /* TCP_MSS_HPP */
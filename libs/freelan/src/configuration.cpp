@@ -79,7 +79,15 @@ namespace freelan
 		accept_contact_requests(true),
 		accept_contacts(true),
 		hostname_resolution_protocol(HRP_IPV4),
-		hello_timeout(boost::posix_time::seconds(3))
+		hello_timeout(boost::posix_time::seconds(3)),
+		keep_alive_period(fscp::SESSION_KEEP_ALIVE_PERIOD),
+		session_timeout(fscp::SESSION_TIMEOUT),
+		rekey_threshold(fscp::SESSION_REKEY_THRESHOLD),
+		compact_data_framing(false),
+		path_mtu_discovery(true),
+		fragmentation(true),
+		data_aggregation(false),
+		data_aggregation_delay()
 	{
 	}
 
@@ -100,6 +108,8 @@ namespace freelan
 		ipv6_address_prefix_length(),
 		arp_proxy_enabled(false),
 		arp_proxy_fake_ethernet_address(),
+		ndp_proxy_enabled(false),
+		ndp_proxy_fake_ethernet_address(),
 		dhcp_proxy_enabled(false),
 		dhcp_server_ipv4_address_prefix_length(),
 		dhcp_server_ipv6_address_prefix_length(),
@@ -110,7 +120,16 @@ namespace freelan
 
 	switch_configuration::switch_configuration() :
 		routing_method(RM_SWITCH),
-		relay_mode_enabled(false)
+		relay_mode_enabled(false),
+		multicast_snooping_enabled(false),
+		multicast_membership_timeout(boost::posix_time::seconds(260)),
+		arp_suppression_enabled(false),
+		arp_binding_timeout(boost::posix_time::seconds(300)),
+		broadcast_rate_limit(0),
+		multicast_rate_limit(0),
+		unknown_unicast_rate_limit(0),
+		storm_control_burst_size(64),
+		tcp_mss_clamping_enabled(false)
 	{
 	}
 
@@ -120,7 +139,11 @@ namespace freelan
 		accept_routes_requests(true),
 		internal_route_acceptance_policy(internal_route_scope_type::unicast_in_network),
 		system_route_acceptance_policy(system_route_scope_type::none),
-		maximum_routes_limit(1)
+		maximum_routes_limit(1),
+		tcp_mss_clamping_enabled(false),
+		port_weights(),
+		route_metric(0),
+		round_trip_time_metric_unit(boost::posix_time::milliseconds(10))
 	{
 	}
 
@@ -415,4 +438,29 @@ namespace freelan
 		assert(false);
 		throw std::logic_error("Unexpected value");
 	}
+
+	std::istream& operator>>(std::istream& is, router_configuration::port_weight_type& v)
+	{
+		std::string value;
+
+		is >> value;
+
+		const std::string::size_type separator = value.rfind('=');
+
+		if (separator == std::string::npos)
+			throw boost::bad_lexical_cast();
+
+		v.network = boost::lexical_cast<asiotap::ip_network_address>(value.substr(0, separator));
+		v.weight = boost::lexical_cast<unsigned int>(value.substr(separator + 1));
+
+		if (v.weight == 0)
+			throw boost::bad_lexical_cast();
+
+		return is;
+	}
+
+	std::ostream& operator<<(std::ostream& os, const router_configuration::port_weight_type& value)
+	{
+		return os << value.network << "=" << value.weight;
+	}
 }
@@ -70,6 +70,7 @@
 #include <boost/date_time/c_local_time_adjustor.hpp>
 
 #include <cassert>
+#include <limits>
 
 namespace freelan
 {
@@ -87,10 +88,6 @@ namespace freelan
 		{
 		}
 
-		void null_switch_write_handler(const switch_::multi_write_result_type&)
-		{
-		}
-
 		void null_router_write_handler(const boost::system::error_code&)
 		{
 		}
@@ -183,9 +180,47 @@ namespace freelan
 			return default_mtu_value - static_payload_size;
 		}
 
+		unsigned int get_path_mtu_payload_value(const boost::asio::ip::udp::endpoint& host, size_t path_mtu)
+		{
+			const size_t static_payload_size = (host.address().is_v4() ? 20 : 40) + 8 + 4 + 22; // IP + UDP + FSCP HEADER + FSCP DATA HEADER
+
+			return static_cast<unsigned int>(path_mtu - static_payload_size);
+		}
+
 		static const unsigned int TAP_ADAPTERS_GROUP = 0;
 		static const unsigned int ENDPOINTS_GROUP = 1;
 
+		unsigned int get_port_weight(const std::vector<router_configuration::port_weight_type>& port_weights, boost::asio::ip::address address)
+		{
+			// IPv4 peers reach dual-stack sockets with mapped addresses.
+			if (address.is_v6() && address.to_v6().is_v4_mapped())
+			{
+				address = address.to_v6().to_v4();
+			}
+
+			for (auto&& port_weight : port_weights)
+			{
+				if (asiotap::has_address(port_weight.network, address))
+				{
+					return port_weight.weight;
+				}
+			}
+
+			return 1;
+		}
+
+		unsigned int get_router_port_cost(routes_message::metric_type metric, const boost::optional<boost::posix_time::time_duration>& round_trip_time, const boost::posix_time::time_duration& round_trip_time_metric_unit)
+		{
+			uint64_t cost = metric;
+
+			if (round_trip_time && (round_trip_time_metric_unit.total_microseconds() > 0))
+			{
+				cost += static_cast<uint64_t>(round_trip_time->total_microseconds() / round_trip_time_metric_unit.total_microseconds());
+			}
+
+			return static_cast<unsigned int>(std::min<uint64_t>(cost, std::numeric_limits<unsigned int>::max()));
+		}
+
 		asiotap::ip_route_set filter_routes(const asiotap::ip_route_set& routes, router_configuration::internal_route_scope_type scope, unsigned int limit, const asiotap::ip_network_address_list& network_addresses)
 		{
 			asiotap::ip_route_set result;
@@ -395,14 +430,12 @@ namespace freelan
 		m_tap_adapter_strand(m_io_service),
 		m_proxies_strand(m_io_service),
 		m_tap_write_queue_strand(m_io_service),
-		m_arp_filter(m_ethernet_filter),
-		m_ipv4_filter(m_ethernet_filter),
-		m_udp_filter(m_ipv4_filter),
-		m_bootp_filter(m_udp_filter),
-		m_dhcp_filter(m_bootp_filter),
 		m_router_strand(m_io_service),
 		m_switch(m_configuration.switch_),
 		m_router(m_configuration.router),
+		m_endpoint_ports(boost::make_shared<endpoint_port_map_type>()),
+		m_tcp_mss_clamping_mtu(0),
+		m_path_mtus(),
 		m_route_manager(m_io_service),
 		m_request_certificate_timer(m_io_service, REQUEST_CERTIFICATE_PERIOD),
 		m_request_ca_certificate_timer(m_io_service, REQUEST_CA_CERTIFICATE_PERIOD),
@@ -411,8 +444,29 @@ namespace freelan
 		m_set_contact_information_retry_timer(m_io_service),
 		m_get_contact_information_retry_timer(m_io_service)
 	{
-		m_arp_filter.add_handler(boost::bind(&core::do_handle_arp_frame, this, _1));
-		m_dhcp_filter.add_handler(boost::bind(&core::do_handle_dhcp_frame, this, _1));
+		// The tap adapter MTU already accounts for the FSCP overhead: the TCP segments must fit in it.
+		if (m_configuration.switch_.tcp_mss_clamping_enabled || m_configuration.router.tcp_mss_clamping_enabled)
+		{
+			unsigned int tcp_mss_clamping_mtu = compute_mtu(m_configuration.tap_adapter.mtu, get_auto_mtu_value());
+
+			if (tcp_mss_clamping_mtu == 0)
+			{
+				tcp_mss_clamping_mtu = get_auto_mtu_value();
+			}
+
+			// The path MTUs of the hosts can only lower it.
+			m_tcp_mss_clamping_mtu = tcp_mss_clamping_mtu;
+
+			if (m_configuration.switch_.tcp_mss_clamping_enabled)
+			{
+				m_switch.set_tcp_mss_clamping_mtu(tcp_mss_clamping_mtu);
+			}
+
+			if (m_configuration.router.tcp_mss_clamping_enabled)
+			{
+				m_router.set_tcp_mss_clamping_mtu(tcp_mss_clamping_mtu);
+			}
+		}
 
 		// Setup the route manager.
 		auto route_registration_success_handler = [this](const asiotap::route_manager::route_type& route){
@@ -498,6 +552,14 @@ namespace freelan
 		{
 			m_fscp_server->set_cipher_suites(m_configuration.fscp.cipher_suite_capabilities);
 			m_fscp_server->set_elliptic_curves(m_configuration.fscp.elliptic_curve_capabilities);
+			m_fscp_server->set_keep_alive_period(m_configuration.fscp.keep_alive_period);
+			m_fscp_server->set_session_timeout(m_configuration.fscp.session_timeout);
+			m_fscp_server->set_rekey_threshold(m_configuration.fscp.rekey_threshold);
+			m_fscp_server->set_compact_data_framing(m_configuration.fscp.compact_data_framing);
+			m_fscp_server->set_path_mtu_discovery(m_configuration.fscp.path_mtu_discovery);
+			m_fscp_server->set_fragmentation(m_configuration.fscp.fragmentation);
+			m_fscp_server->set_data_aggregation(m_configuration.fscp.data_aggregation);
+			m_fscp_server->set_data_aggregation_delay(m_configuration.fscp.data_aggregation_delay);
 
 			m_fscp_server->set_hello_message_received_callback(boost::bind(&core::do_handle_hello_received, this, _1, _2));
 			m_fscp_server->set_contact_request_received_callback(boost::bind(&core::do_handle_contact_request_received, this, _1, _2, _3, _4));
@@ -509,6 +571,7 @@ namespace freelan
 			m_fscp_server->set_session_error_callback(boost::bind(&core::do_handle_session_error, this, _1, _2, _3));
 			m_fscp_server->set_session_established_callback(boost::bind(&core::do_handle_session_established, this, _1, _2, _3, _4));
 			m_fscp_server->set_session_lost_callback(boost::bind(&core::do_handle_session_lost, this, _1, _2));
+			m_fscp_server->set_path_mtu_discovered_callback(boost::bind(&core::do_handle_path_mtu_discovered, this, _1, _2));
 			m_fscp_server->set_data_received_callback(boost::bind(&core::do_handle_data_received, this, _1, _2, _3, _4));
 
 			resolver_type resolver(m_io_service);
@@ -720,8 +783,9 @@ namespace freelan
 	{
 		const auto version = msg.version();
 		const auto routes = msg.routes();
+		const auto metric = msg.metric();
 
-		async_get_tap_addresses([this, sender, version, routes](const asiotap::ip_network_address_list& ip_addresses){
+		async_get_tap_addresses([this, sender, version, routes, metric](const asiotap::ip_network_address_list& ip_addresses){
 			m_router_strand.post(
 				boost::bind(
 					&core::do_handle_routes,
@@ -729,7 +793,8 @@ namespace freelan
 					ip_addresses,
 					sender,
 					version,
-					routes
+					routes,
+					metric
 				)
 			);
 		});
@@ -801,7 +866,8 @@ namespace freelan
 			buffer_cast<uint8_t*>(data_buffer),
 			buffer_size(data_buffer),
 			version,
-			routes
+			routes,
+			m_configuration.router.route_metric
 		);
 
 		m_fscp_server->async_send_data(
@@ -815,6 +881,27 @@ namespace freelan
 		);
 	}
 
+	void core::async_measure_round_trip_time(const ep_type& target)
+	{
+		assert(m_fscp_server);
+
+		m_fscp_server->async_greet(target, [this, target](const boost::system::error_code& ec, const boost::posix_time::time_duration& duration) {
+			if (!ec)
+			{
+				m_router_strand.post(boost::bind(&core::do_handle_round_trip_time, this, target, duration));
+			}
+			else
+			{
+				m_logger(fscp::log_level::debug) << "Unable to measure the round-trip time to " << target << ": " << ec.message();
+			}
+		});
+	}
+
+	void core::async_measure_round_trip_time_to_all()
+	{
+		m_router_strand.post(boost::bind(&core::do_measure_round_trip_time_to_all, this));
+	}
+
 	void core::do_contact(const ep_type& address, duration_handler_type handler)
 	{
 		assert(m_fscp_server);
@@ -872,6 +959,7 @@ namespace freelan
 		if (ec != boost::asio::error::operation_aborted)
 		{
 			async_send_routes_request_to_all();
+			async_measure_round_trip_time_to_all();
 
 			m_routes_request_timer.expires_from_now(ROUTES_REQUEST_PERIOD);
 			m_routes_request_timer.async_wait(boost::bind(&core::do_handle_periodic_routes_request, this, boost::asio::placeholders::error));
@@ -1106,7 +1194,14 @@ namespace freelan
 			else
 			{
 				// We register the router port without any routes, at first.
-				async_register_router_port(host, boost::bind(&core::async_send_routes_request, this, host));
+				async_register_router_port(host, [this, host] () {
+					async_send_routes_request(host);
+
+					if (m_configuration.router.round_trip_time_metric_unit.total_microseconds() > 0)
+					{
+						async_measure_round_trip_time(host);
+					}
+				});
 			}
 
 			const auto route = m_route_manager.get_route_for(host.address());
@@ -1140,6 +1235,19 @@ namespace freelan
 		async_clear_client_router_info(host, void_handler_type());
 	}
 
+	void core::do_handle_path_mtu_discovered(const ep_type& host, size_t path_mtu)
+	{
+		const unsigned int mtu = get_path_mtu_payload_value(host, path_mtu);
+
+		m_logger(fscp::log_level::information) << "Path MTU to " << host << " is " << path_mtu << " bytes: frames of up to " << mtu << " bytes reach it without being fragmented.";
+
+		// The tap adapter MTU can't change once it is open, but the TCP connections that get established from now on can still avoid the fragmentation.
+		if (m_configuration.switch_.tcp_mss_clamping_enabled || m_configuration.router.tcp_mss_clamping_enabled)
+		{
+			m_router_strand.post(boost::bind(&core::do_set_path_mtu, this, host, mtu));
+		}
+	}
+
 	void core::do_handle_data_received(const ep_type& sender, fscp::channel_number_type channel_number, fscp::SharedBuffer buffer, boost::asio::const_buffer data)
 	{
 		switch (channel_number)
@@ -1149,18 +1257,18 @@ namespace freelan
 				if (m_configuration.tap_adapter.type == tap_adapter_configuration::tap_adapter_type::tap)
 				{
 					async_write_switch(
-						make_port_index(sender),
+						get_endpoint_port(sender),
 						data,
 						make_shared_buffer_handler(
 							buffer,
-							&null_switch_write_handler
+							&null_simple_write_handler
 						)
 					);
 				}
 				else
 				{
 					async_write_router(
-						make_port_index(sender),
+						get_endpoint_port(sender),
 						data,
 						make_shared_buffer_handler(
 							buffer,
@@ -1256,7 +1364,7 @@ namespace freelan
 		}
 	}
 
-	void core::do_handle_routes(const asiotap::ip_network_address_list& tap_addresses, const ep_type& sender, routes_message::version_type version, const asiotap::ip_route_set& routes)
+	void core::do_handle_routes(const asiotap::ip_network_address_list& tap_addresses, const ep_type& sender, routes_message::version_type version, const asiotap::ip_route_set& routes, routes_message::metric_type metric)
 	{
 		// All calls to do_handle_routes() are done within the m_router_strand, so the following is safe.
 
@@ -1310,9 +1418,12 @@ namespace freelan
 
 			if (port)
 			{
+				client_router_info.metric = metric;
+
+				port->set_cost(get_router_port_cost(client_router_info.metric, client_router_info.round_trip_time, m_configuration.router.round_trip_time_metric_unit));
 				port->set_local_routes(filtered_routes);
 
-				m_logger(fscp::log_level::information) << "Received routes from " << sender << " (version " << version << ") were applied: " << filtered_routes;
+				m_logger(fscp::log_level::information) << "Received routes from " << sender << " (version " << version << ", metric " << metric << ") were applied: " << filtered_routes;
 			}
 			else
 			{
@@ -1367,6 +1478,8 @@ namespace freelan
 		client_router_info_type new_client_router_info;
 		new_client_router_info.saved_system_route = client_router_info.saved_system_route;
 		new_client_router_info.version = client_router_info.version;
+		new_client_router_info.metric = client_router_info.metric;
+		new_client_router_info.round_trip_time = client_router_info.round_trip_time;
 
 		for (auto&& route : filtered_system_routes)
 		{
@@ -1376,6 +1489,48 @@ namespace freelan
 		client_router_info = new_client_router_info;
 	}
 
+	void core::do_handle_round_trip_time(const ep_type& host, const boost::posix_time::time_duration& duration)
+	{
+		// All calls to do_handle_round_trip_time() are done within the m_router_strand, so the following is safe.
+		const auto port = m_router.get_port(make_port_index(host));
+
+		// The session may have been lost meanwhile.
+		if (!port)
+		{
+			return;
+		}
+
+		client_router_info_type& client_router_info = m_client_router_info_map[host];
+
+		// The measures are smoothed like TCP does, so that a single late reply doesn't move the flows to another peer.
+		if (client_router_info.round_trip_time)
+		{
+			client_router_info.round_trip_time = (*client_router_info.round_trip_time * 7 + duration) / 8;
+		}
+		else
+		{
+			client_router_info.round_trip_time = duration;
+		}
+
+		m_logger(fscp::log_level::debug) << "Round-trip time to " << host << ": " << duration << " (smoothed: " << *client_router_info.round_trip_time << ")";
+
+		port->set_cost(get_router_port_cost(client_router_info.metric, client_router_info.round_trip_time, m_configuration.router.round_trip_time_metric_unit));
+	}
+
+	void core::do_measure_round_trip_time_to_all()
+	{
+		// All calls to do_measure_round_trip_time_to_all() are done within the m_router_strand, so the following is safe.
+		if ((m_configuration.tap_adapter.type == tap_adapter_configuration::tap_adapter_type::tap) || (m_configuration.router.round_trip_time_metric_unit.total_microseconds() <= 0))
+		{
+			return;
+		}
+
+		for (auto&& client_router_info : m_client_router_info_map)
+		{
+			async_measure_round_trip_time(client_router_info.first);
+		}
+	}
+
 	int core::certificate_validation_callback(int ok, X509_STORE_CTX* ctx)
 	{
 		cryptoplus::x509::store_context store_context(ctx);
@@ -1588,8 +1743,8 @@ namespace freelan
 
 			if (tap_adapter_type == asiotap::tap_adapter_layer::ethernet)
 			{
-				// Registers the switch port.
-				m_switch.register_port(make_port_index(m_tap_adapter), switch_::port_type(write_func, TAP_ADAPTERS_GROUP));
+				// Registers the switch port. Its handle is kept so that the frames we read don't have to look it up.
+				m_tap_adapter_port = m_switch.register_port(make_port_index(m_tap_adapter), switch_::port_type(write_func, TAP_ADAPTERS_GROUP));
 
 				// The ARP proxy
 				if (m_configuration.tap_adapter.arp_proxy_enabled)
@@ -1602,6 +1757,17 @@ namespace freelan
 					m_arp_proxy.reset();
 				}
 
+				// The NDP proxy
+				if (m_configuration.tap_adapter.ndp_proxy_enabled)
+				{
+					m_ndp_proxy.reset(new ndp_proxy_type());
+					m_ndp_proxy->set_neighbor_solicitation_callback(boost::bind(&core::do_handle_neighbor_solicitation, this, _1, _2));
+				}
+				else
+				{
+					m_ndp_proxy.reset();
+				}
+
 				// The DHCP proxy
 				if (m_configuration.tap_adapter.dhcp_proxy_enabled)
 				{
@@ -1629,8 +1795,8 @@ namespace freelan
 			}
 			else
 			{
-				// Registers the router port.
-				m_router.register_port(make_port_index(m_tap_adapter), router::port_type(write_func, TAP_ADAPTERS_GROUP));
+				// Registers the router port. Its handle is kept so that the frames we read don't have to look it up.
+				m_tap_adapter_port = m_router.register_port(make_port_index(m_tap_adapter), router::port_type(write_func, TAP_ADAPTERS_GROUP));
 
 				// Add the routes.
 				auto local_routes = m_configuration.router.local_ip_routes;
@@ -1657,6 +1823,7 @@ namespace freelan
 				// We don't need any proxies in TUN mode.
 				m_arp_proxy.reset();
 				m_dhcp_proxy.reset();
+				m_ndp_proxy.reset();
 			}
 
 			if (m_tap_adapter_up_callback)
@@ -1679,6 +1846,7 @@ namespace freelan
 			m_client_router_info_map.clear();
 		});
 
+		m_ndp_proxy.reset();
 		m_dhcp_proxy.reset();
 		m_arp_proxy.reset();
 
@@ -1785,32 +1953,30 @@ namespace freelan
 			{
 				bool handled = false;
 
-				if (m_arp_proxy || m_dhcp_proxy)
+				// The filters call the handlers inline, which tell whether the frame was handled.
+				if (m_arp_proxy)
 				{
-					// This line will eventually call the filters callbacks.
-					m_ethernet_filter.parse(data);
+					handled = arp_filter_type::parse(data, boost::bind(&core::do_handle_arp_frame, this, _1, _2));
+				}
 
-					if (m_arp_proxy && m_arp_filter.get_last_helper())
-					{
-						handled = true;
-						m_arp_filter.clear_last_helper();
-					}
+				if (!handled && m_dhcp_proxy)
+				{
+					handled = dhcp_filter_type::parse(data, boost::bind(&core::do_handle_dhcp_frame, this, _1, _2, _3, _4, _5));
+				}
 
-					if (m_dhcp_proxy && m_dhcp_filter.get_last_helper())
-					{
-						handled = true;
-						m_dhcp_filter.clear_last_helper();
-					}
+				if (!handled && m_ndp_proxy)
+				{
+					handled = ndp_filter_type::parse(data, boost::bind(&core::do_handle_ndp_frame, this, _1, _2, _3, _4));
 				}
 
 				if (!handled)
 				{
 					async_write_switch(
-						make_port_index(m_tap_adapter),
+						m_tap_adapter_port,
 						data,
 						make_shared_buffer_handler(
 							receive_buffer,
-							&null_switch_write_handler
+							&null_simple_write_handler
 						)
 					);
 				}
@@ -1819,7 +1985,7 @@ namespace freelan
 			{
 				// This is a TUN interface. We receive either IPv4 or IPv6 frames.
 				async_write_router(
-					make_port_index(m_tap_adapter),
+					m_tap_adapter_port,
 					data,
 					make_shared_buffer_handler(
 						receive_buffer,
@@ -1845,13 +2011,13 @@ namespace freelan
 		}
 	}
 
-	void core::do_handle_arp_frame(const arp_helper_type& helper)
+	bool core::do_handle_arp_frame(const arp_helper_type& helper, const ethernet_helper_type& ethernet_helper)
 	{
 		if (m_arp_proxy)
 		{
 			const auto response_buffer = SharedBuffer(2048);
 			const boost::optional<boost::asio::const_buffer> data = m_arp_proxy->process_frame(
-				*m_arp_filter.parent().get_last_helper(),
+				ethernet_helper,
 				helper,
 				buffer(response_buffer)
 			);
@@ -1870,19 +2036,23 @@ namespace freelan
 					)
 				);
 			}
+
+			return true;
 		}
+
+		return false;
 	}
 
-	void core::do_handle_dhcp_frame(const dhcp_helper_type& helper)
+	bool core::do_handle_dhcp_frame(const dhcp_helper_type& helper, const bootp_helper_type& bootp_helper, const udp_helper_type& udp_helper, const ipv4_helper_type& ipv4_helper, const ethernet_helper_type& ethernet_helper)
 	{
 		if (m_dhcp_proxy)
 		{
 			const auto response_buffer = SharedBuffer(2048);
 			const boost::optional<boost::asio::const_buffer> data = m_dhcp_proxy->process_frame(
-				*m_dhcp_filter.parent().parent().parent().parent().get_last_helper(),
-				*m_dhcp_filter.parent().parent().parent().get_last_helper(),
-				*m_dhcp_filter.parent().parent().get_last_helper(),
-				*m_dhcp_filter.parent().get_last_helper(),
+				ethernet_helper,
+				ipv4_helper,
+				udp_helper,
+				bootp_helper,
 				helper,
 				buffer(response_buffer)
 			);
@@ -1901,7 +2071,11 @@ namespace freelan
 					)
 				);
 			}
+
+			return true;
 		}
+
+		return false;
 	}
 
 	bool core::do_handle_arp_request(const boost::asio::ip::address_v4& logical_address, ethernet_address_type& ethernet_address)
@@ -1919,10 +2093,63 @@ namespace freelan
 		return false;
 	}
 
+	bool core::do_handle_ndp_frame(const ndp_helper_type& helper, const icmpv6_helper_type& icmpv6_helper, const ipv6_helper_type& ipv6_helper, const ethernet_helper_type& ethernet_helper)
+	{
+		if (!icmpv6_helper.verify_checksum(ipv6_helper))
+		{
+			return false;
+		}
+
+		// Unlike ARP, only the answered solicitations are dropped: neighbor discovery must keep working for the addresses we don't proxy.
+		const auto response_buffer = SharedBuffer(2048);
+		const boost::optional<boost::asio::const_buffer> data = m_ndp_proxy->process_frame(
+			ethernet_helper,
+			ipv6_helper,
+			icmpv6_helper,
+			helper,
+			buffer(response_buffer)
+		);
+
+		if (data)
+		{
+			async_write_tap(
+				buffer(*data),
+				make_shared_buffer_handler(
+					response_buffer,
+					boost::bind(
+						&core::do_handle_tap_adapter_write,
+						this,
+						boost::asio::placeholders::error
+					)
+				)
+			);
+
+			return true;
+		}
+
+		return false;
+	}
+
+	bool core::do_handle_neighbor_solicitation(const boost::asio::ip::address_v6& logical_address, ethernet_address_type& ethernet_address)
+	{
+		// Link-local addresses are never proxied: they belong to the hosts of the virtual segment.
+		if (!m_configuration.tap_adapter.ipv6_address_prefix_length.is_null() && !logical_address.is_link_local())
+		{
+			if (logical_address != m_configuration.tap_adapter.ipv6_address_prefix_length.address())
+			{
+				ethernet_address = m_configuration.tap_adapter.ndp_proxy_fake_ethernet_address;
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
 	void core::do_register_switch_port(const ep_type& host, void_handler_type handler)
 	{
 		// All calls to do_register_switch_port() are done within the m_router_strand, so the following is safe.
-		m_switch.register_port(make_port_index(host), switch_::port_type(boost::bind(&fscp::server::async_send_data, m_fscp_server, host, fscp::CHANNEL_NUMBER_0, _1, _2), ENDPOINTS_GROUP));
+		set_endpoint_port(host, m_switch.register_port(make_port_index(host), switch_::port_type(boost::bind(&fscp::server::async_send_data, m_fscp_server, host, fscp::CHANNEL_NUMBER_0, _1, _2), ENDPOINTS_GROUP)));
 
 		if (handler)
 		{
@@ -1934,6 +2161,8 @@ namespace freelan
 	{
 		// All calls to do_unregister_switch_port() are done within the m_router_strand, so the following is safe.
 		m_switch.unregister_port(make_port_index(host));
+		erase_endpoint_port(host);
+		forget_path_mtu(host);
 
 		if (handler)
 		{
@@ -1944,7 +2173,9 @@ namespace freelan
 	void core::do_register_router_port(const ep_type& host, void_handler_type handler)
 	{
 		// All calls to do_register_router_port() are done within the m_router_strand, so the following is safe.
-		m_router.register_port(make_port_index(host), router::port_type(boost::bind(&fscp::server::async_send_data, m_fscp_server, host, fscp::CHANNEL_NUMBER_0, _1, _2), ENDPOINTS_GROUP));
+		const unsigned int weight = get_port_weight(m_configuration.router.port_weights, host.address());
+
+		set_endpoint_port(host, m_router.register_port(make_port_index(host), router::port_type(boost::bind(&fscp::server::async_send_data, m_fscp_server, host, fscp::CHANNEL_NUMBER_0, _1, _2), ENDPOINTS_GROUP, weight)));
 
 		if (handler)
 		{
@@ -1956,6 +2187,8 @@ namespace freelan
 	{
 		// All calls to do_unregister_router_port() are done within the m_router_strand, so the following is safe.
 		m_router.unregister_port(make_port_index(host));
+		erase_endpoint_port(host);
+		forget_path_mtu(host);
 
 		if (handler)
 		{
@@ -1988,16 +2221,107 @@ namespace freelan
 		}
 	}
 
-	void core::do_write_switch(const port_index_type& index, boost::asio::const_buffer data, switch_::multi_write_handler_type handler)
+	void core::do_set_path_mtu(const ep_type& host, unsigned int mtu)
+	{
+		// All calls to do_set_path_mtu() are done within the m_router_strand, so the following is safe.
+
+		// The port got registered before, from the same strand: if it is not anymore, the session was lost since.
+		if (!m_switch.is_registered(make_port_index(host)) && !m_router.is_registered(make_port_index(host)))
+		{
+			return;
+		}
+
+		m_path_mtus[host] = mtu;
+
+		if (m_configuration.switch_.tcp_mss_clamping_enabled)
+		{
+			update_switch_tcp_mss_clamping_mtu();
+		}
+
+		if (m_configuration.router.tcp_mss_clamping_enabled)
+		{
+			// The router sends every packet to one host only: it clamps them to the path MTU of that host.
+			router::port_type* const port = m_router.get_port(make_port_index(host));
+
+			if (port && (port->tcp_mss_clamping_mtu() != mtu))
+			{
+				m_logger(fscp::log_level::important) << "Clamping the TCP MSS of the packets routed to " << host << " to an MTU of " << std::min(mtu, m_router.tcp_mss_clamping_mtu()) << ".";
+
+				port->set_tcp_mss_clamping_mtu(mtu);
+			}
+		}
+	}
+
+	void core::forget_path_mtu(const ep_type& host)
+	{
+		// All calls to forget_path_mtu() are done within the m_router_strand, so the following is safe.
+		if ((m_path_mtus.erase(host) > 0) && m_configuration.switch_.tcp_mss_clamping_enabled)
+		{
+			// The host that had the lowest path MTU may be gone.
+			update_switch_tcp_mss_clamping_mtu();
+		}
+	}
+
+	void core::update_switch_tcp_mss_clamping_mtu()
+	{
+		// All calls to update_switch_tcp_mss_clamping_mtu() are done within the m_router_strand, so the following is safe.
+
+		// The switch floods frames to several hosts at once: its clamping MTU must suit all the hosts we have a session with.
+		unsigned int mtu = m_tcp_mss_clamping_mtu;
+
+		for (auto&& path_mtu : m_path_mtus)
+		{
+			mtu = std::min(mtu, path_mtu.second);
+		}
+
+		if (mtu != m_switch.tcp_mss_clamping_mtu())
+		{
+			m_logger(fscp::log_level::important) << "Changing the switch TCP MSS clamping MTU from " << m_switch.tcp_mss_clamping_mtu() << " to " << mtu << ".";
+
+			m_switch.set_tcp_mss_clamping_mtu(mtu);
+		}
+	}
+
+	port_handle_type core::get_endpoint_port(const ep_type& host) const
+	{
+		const boost::shared_ptr<const endpoint_port_map_type> endpoint_ports = boost::atomic_load(&m_endpoint_ports);
+		const endpoint_port_map_type::const_iterator entry = endpoint_ports->find(host);
+
+		// The frames of a host that has no port are dropped by the default handle.
+		return (entry != endpoint_ports->end()) ? entry->second : port_handle_type();
+	}
+
+	void core::set_endpoint_port(const ep_type& host, const port_handle_type& port)
+	{
+		// All calls to set_endpoint_port() are done within the m_router_strand, so the following is safe.
+		const boost::shared_ptr<endpoint_port_map_type> endpoint_ports = boost::make_shared<endpoint_port_map_type>(*m_endpoint_ports);
+		(*endpoint_ports)[host] = port;
+
+		boost::atomic_store(&m_endpoint_ports, boost::shared_ptr<const endpoint_port_map_type>(endpoint_ports));
+	}
+
+	void core::erase_endpoint_port(const ep_type& host)
+	{
+		// All calls to erase_endpoint_port() are done within the m_router_strand, so the following is safe.
+		if (m_endpoint_ports->count(host) > 0)
+		{
+			const boost::shared_ptr<endpoint_port_map_type> endpoint_ports = boost::make_shared<endpoint_port_map_type>(*m_endpoint_ports);
+			endpoint_ports->erase(host);
+
+			boost::atomic_store(&m_endpoint_ports, boost::shared_ptr<const endpoint_port_map_type>(endpoint_ports));
+		}
+	}
+
+	void core::do_write_switch(const port_handle_type& source, boost::asio::const_buffer data, switch_::port_type::write_handler_type handler)
 	{
-		// All calls to do_write_switch() are done within the m_router_strand, so the following is safe.
-		m_switch.async_write(index, data, handler);
+		// The switch is safe to use from any thread for forwarding.
+		m_switch.async_forward(source, data, handler);
 	}
 
-	void core::do_write_router(const port_index_type& index, boost::asio::const_buffer data, router::port_type::write_handler_type handler)
+	void core::do_write_router(const port_handle_type& source, boost::asio::const_buffer data, router::port_type::write_handler_type handler)
 	{
-		// All calls to do_write_router() are done within the m_router_strand, so the following is safe.
-		m_router.async_write(index, data, handler);
+		// The router is safe to use from any thread for forwarding.
+		m_router.async_write(source, data, handler);
 	}
 
 	void core::open_web_server()
@@ -63,7 +63,8 @@ namespace freelan
 	}
 
 	message::message(const void* buf, size_t buf_len) :
-		m_data(buf)
+		m_data(buf),
+		m_buf_len(buf_len)
 	{
 		if (buf_len < HEADER_LENGTH)
 		{
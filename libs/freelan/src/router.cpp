@@ -44,117 +44,431 @@
  */
 
 #include "router.hpp"
+#include "tcp_mss.hpp"
 
 #include <cassert>
+#include <cstddef>
+#include <cstring>
 
 #include <boost/foreach.hpp>
 
-#include <asiotap/osi/ipv4_helper.hpp>
-#include <asiotap/osi/ipv6_helper.hpp>
-
 namespace freelan
 {
-	void router::async_write(port_index_type index, boost::asio::const_buffer data, port_type::write_handler_type handler)
+	namespace
 	{
-		const port_list_type::const_iterator port_entry = get_target_for(index, data);
+		// The destination address offsets, in the IPv4 and IPv6 headers.
+		const size_t IPV4_DESTINATION_OFFSET = offsetof(asiotap::osi::ipv4_frame, destination);
+		const size_t IPV6_DESTINATION_OFFSET = offsetof(asiotap::osi::ipv6_frame, destination);
 
-#if FREELAN_DEBUG
-		if (port_entry != m_ports.end())
+		// The minimum IPv4 header length, in 32-bit words.
+		const uint8_t IPV4_MINIMUM_IHL = 5;
+
+		// The transport protocols whose ports are part of the flow identity.
+		bool has_ports(uint8_t protocol)
 		{
-			std::cerr << "Routing " << buffer_size(data) << " byte(s) of data from " << index << " to " << port_entry->first << std::endl;
+			switch (protocol)
+			{
+				case 6: // TCP
+				case 17: // UDP
+				case 132: // SCTP
+					return true;
+			}
+
+			return false;
 		}
-		else
+
+		// These are the MurmurHash3 mixing steps.
+		uint32_t mix_flow_hash(uint32_t hash, const uint8_t* buf, size_t len)
 		{
-			std::cerr << "Routing " << buffer_size(data) << " byte(s) of data from " << index << ": no route." << std::endl;
+			for (size_t i = 0; i + 4 <= len; i += 4)
+			{
+				uint32_t word;
+				std::memcpy(&word, buf + i, sizeof(word));
+
+				word *= 0xcc9e2d51u;
+				word = (word << 15) | (word >> 17);
+				word *= 0x1b873593u;
+
+				hash ^= word;
+				hash = (hash << 13) | (hash >> 19);
+				hash = hash * 5 + 0xe6546b64u;
+			}
+
+			return hash;
 		}
-#endif
 
-		if (port_entry != m_ports.end())
+		uint32_t finalize_flow_hash(uint32_t hash)
 		{
-			port_entry->second.async_write(data, handler);
+			hash ^= hash >> 16;
+			hash *= 0x85ebca6bu;
+			hash ^= hash >> 13;
+			hash *= 0xc2b2ae35u;
+			hash ^= hash >> 16;
+
+			return hash;
+		}
+
+		// Hashes the addresses, the protocol and, when they are available, the ports of an IP packet whose header was already validated.
+		//
+		// The ports are only taken from unfragmented packets: the other fragments don't carry them and a flow must never be split.
+		uint32_t get_flow_hash(const uint8_t* buf, size_t size)
+		{
+			uint32_t hash = 0;
+
+			if ((buf[0] >> 4) == asiotap::osi::IP_PROTOCOL_VERSION_4)
+			{
+				const size_t header_length = (buf[0] & 0x0f) * 4;
+				const uint8_t protocol = buf[offsetof(asiotap::osi::ipv4_frame, protocol)];
+				const bool is_fragment = ((buf[6] & 0x3f) != 0) || (buf[7] != 0);
+
+				hash = mix_flow_hash(protocol, buf + offsetof(asiotap::osi::ipv4_frame, source), 8);
+
+				if (!is_fragment && has_ports(protocol) && (size >= header_length + 4))
+				{
+					hash = mix_flow_hash(hash, buf + header_length, 4);
+				}
+
+				return finalize_flow_hash(hash ^ 8);
+			}
+			else
+			{
+				const size_t header_length = sizeof(asiotap::osi::ipv6_frame);
+				const uint8_t next_header = buf[offsetof(asiotap::osi::ipv6_frame, next_header)];
+
+				// The flow label is set by the source to identify its flows. The traffic class shares its word but may be re-marked along the way (DSCP, ECN): it must stay out of the hash.
+				const uint8_t flow_label[4] = { 0x00, static_cast<uint8_t>(buf[1] & 0x0f), buf[2], buf[3] };
+
+				hash = mix_flow_hash(next_header, flow_label, sizeof(flow_label));
+				hash = mix_flow_hash(hash, buf + offsetof(asiotap::osi::ipv6_frame, source), 32);
+
+				if (has_ports(next_header) && (size >= header_length + 4))
+				{
+					hash = mix_flow_hash(hash, buf + header_length, 4);
+				}
+
+				return finalize_flow_hash(hash ^ 32);
+			}
 		}
 	}
 
-	router::port_list_type::const_iterator router::get_target_for(port_index_type index, boost::asio::const_buffer data)
+	void router::async_write(const port_handle_type& source, boost::asio::const_buffer data, port_type::write_handler_type handler) const
 	{
-		// Try IPv4 first because it is more likely.
+		// The snapshot is kept alive for the whole call, even if a new one gets published meanwhile.
+		const snapshot_ptr snapshot = boost::atomic_load(&m_snapshot);
 
-		m_ipv4_filter.parse(data);
+		const port_entry_type* const port_entry = get_target_for(*snapshot, source, data);
 
-		if (m_ipv4_filter.get_last_helper())
+#if FREELAN_DEBUG
+		if (port_entry)
 		{
-			const boost::asio::ip::address_v4 destination = m_ipv4_filter.get_last_helper()->destination();
+			std::cerr << "Routing " << buffer_size(data) << " byte(s) of data from port " << source.id << " to " << port_entry->index << std::endl;
+		}
+		else
+		{
+			std::cerr << "Routing " << buffer_size(data) << " byte(s) of data from port " << source.id << ": no route." << std::endl;
+		}
+#endif
+
+		if (port_entry)
+		{
+			// The path to the target port may not carry as much as the router MTU.
+			unsigned int mtu = tcp_mss_clamping_mtu();
+			const unsigned int port_mtu = port_entry->port.tcp_mss_clamping_mtu();
+
+			if ((mtu > 0) && (port_mtu > 0) && (port_mtu < mtu))
+			{
+				mtu = port_mtu;
+			}
 
-			m_ipv4_filter.clear_last_helper();
+			const boost::optional<tcp_mss_clamped_packet_type> clamped_packet = clamp_tcp_mss(data, mtu);
 
-			return get_target_for(index, destination);
+			if (clamped_packet)
+			{
+				port_entry->port.async_write(clamped_packet->second, fscp::make_shared_buffer_handler(clamped_packet->first, handler));
+			}
+			else
+			{
+				port_entry->port.async_write(data, handler);
+			}
 		}
-		else
+	}
+
+	const router::port_entry_type* router::get_target_for(const snapshot_type& snapshot, const port_handle_type& source, boost::asio::const_buffer data) const
+	{
+		// We only need the destination address: the frames are classified straight from their first byte, without the filters.
+		const size_t size = boost::asio::buffer_size(data);
+		const uint8_t* const buf = boost::asio::buffer_cast<const uint8_t*>(data);
+
+		if (size == 0)
 		{
-			m_ipv6_filter.parse(data);
+			return nullptr;
+		}
+
+		switch (buf[0] >> 4)
+		{
+			case asiotap::osi::IP_PROTOCOL_VERSION_4:
+			{
+				if ((size < sizeof(asiotap::osi::ipv4_frame)) || ((buf[0] & 0x0f) < IPV4_MINIMUM_IHL))
+				{
+					break;
+				}
+
+				boost::asio::ip::address_v4::bytes_type destination;
+				std::memcpy(destination.data(), buf + IPV4_DESTINATION_OFFSET, destination.size());
 
-			if (m_ipv6_filter.get_last_helper())
+				return get_target_for(snapshot, source, boost::asio::ip::address_v4(destination), data);
+			}
+			case asiotap::osi::IP_PROTOCOL_VERSION_6:
 			{
-				const boost::asio::ip::address_v6 destination = m_ipv6_filter.get_last_helper()->destination();
+				if (size < sizeof(asiotap::osi::ipv6_frame))
+				{
+					break;
+				}
 
-				m_ipv6_filter.clear_last_helper();
+				boost::asio::ip::address_v6::bytes_type destination;
+				std::memcpy(destination.data(), buf + IPV6_DESTINATION_OFFSET, destination.size());
 
-				return get_target_for(index, destination);
+				return get_target_for(snapshot, source, boost::asio::ip::address_v6(destination), data);
 			}
 		}
 
-		// Frame of other types than IPv4 or IPv6 are silently dropped.
-		return m_ports.end();
+		// Frame of other types than IPv4 or IPv6, or truncated ones, are silently dropped.
+		return nullptr;
 	}
 
 	template <typename AddressType>
-	router::port_list_type::const_iterator router::get_target_for(port_index_type index, const AddressType& dest_addr)
+	const router::port_entry_type* router::get_target_for(const snapshot_type& snapshot, const port_handle_type& source, const AddressType& dest_addr, boost::asio::const_buffer data) const
 	{
-		const router::port_list_type::const_iterator source_port_entry = m_ports.find(index);
+		// A handle that outlived its port has a stale generation.
+		if ((source.id >= snapshot.ports.size()) || (snapshot.ports[source.id].generation != source.generation) || (source.generation == 0))
+		{
+			return nullptr;
+		}
+
+		// The verdict only depends on the destination and on the source port group.
+		const port_group_type source_group = snapshot.ports[source.id].port.group();
+
+		flow_cache_entry_type<AddressType>& flow_cache_entry = snapshot.get_flow_cache_entry(dest_addr, source_group);
+
+		// No route for the current frame means an invalid target.
+		verdict_type verdict;
+
+		if (!flow_cache_entry.load(dest_addr, source_group, verdict))
+		{
+			// The most specific route with an eligible port wins: its eligible ports with the lowest cost share the load.
+			snapshot.routes.get(dest_addr).find_networks(dest_addr, [this, &snapshot, source_group, &verdict](const std::vector<port_id_type>& port_ids) {
+				unsigned int eligible_count = 0;
+
+				for (auto&& port_id : port_ids)
+				{
+					if (is_eligible(snapshot, source_group, port_id))
+					{
+						const port_type& port = snapshot.ports[port_id].port;
+
+						if ((eligible_count == 0) || (port.cost() < verdict.cost))
+						{
+							verdict.target = port_id;
+							verdict.cost = port.cost();
+							verdict.total_weight = port.weight();
+							eligible_count = 1;
+						}
+						else if (port.cost() == verdict.cost)
+						{
+							verdict.target = port_id;
+							verdict.total_weight += port.weight();
+							++eligible_count;
+						}
+					}
+				}
 
-		if (source_port_entry != m_ports.end())
+				if (eligible_count > 1)
+				{
+					verdict.target = INVALID_PORT_ID;
+					verdict.candidates = &port_ids;
+				}
+
+				return (eligible_count > 0);
+			});
+
+			// Port identifiers and the candidates remain valid as long as the snapshot that holds the cache.
+			flow_cache_entry.store(dest_addr, source_group, verdict);
+		}
+
+		if (verdict.candidates)
 		{
-			const auto& routes_ports = routes();
+			// Every packet of a flow has the same hash and thus goes through the same port.
+			unsigned int remaining_weight = get_flow_hash(boost::asio::buffer_cast<const uint8_t*>(data), boost::asio::buffer_size(data)) % verdict.total_weight;
 
-			for (auto&& route_port : routes_ports)
+			for (auto&& port_id : *verdict.candidates)
 			{
-				if (has_address(route_port.first, dest_addr))
+				if (is_eligible(snapshot, source_group, port_id) && (snapshot.ports[port_id].port.cost() == verdict.cost))
 				{
-					const port_list_type::const_iterator port_entry = m_ports.find(route_port.second);
+					const unsigned int weight = snapshot.ports[port_id].port.weight();
 
-					if (m_configuration.client_routing_enabled || (source_port_entry->second.group() != port_entry->second.group()))
+					if (remaining_weight < weight)
 					{
-						return port_entry;
+						return &snapshot.ports[port_id];
 					}
+
+					remaining_weight -= weight;
 				}
 			}
+
+			assert(false);
 		}
 
-		// No route for the current frame so we return an invalid iterator.
-		return m_ports.end();
+		return (verdict.target != INVALID_PORT_ID) ? &snapshot.ports[verdict.target] : nullptr;
+	}
+
+	bool router::is_eligible(const snapshot_type& snapshot, port_group_type source_group, port_id_type port_id) const
+	{
+		return (m_configuration.client_routing_enabled || (source_group != snapshot.ports[port_id].port.group()));
+	}
+
+	template <typename AddressType>
+	typename router::flow_cache_entry_type<AddressType>::key_type router::flow_cache_entry_type<AddressType>::make_key(const AddressType& _destination, port_group_type _source_group)
+	{
+		const typename AddressType::bytes_type bytes = _destination.to_bytes();
+
+		key_type result;
+
+		std::memcpy(result.data(), bytes.data(), bytes.size());
+		result.back() = _source_group;
+
+		return result;
 	}
 
-	const router::routes_port_type& router::routes() const
+	template <typename AddressType>
+	bool router::flow_cache_entry_type<AddressType>::load(const AddressType& _destination, port_group_type _source_group, verdict_type& _verdict) const
 	{
-		if (!m_routes)
+		const key_type expected_key = make_key(_destination, _source_group);
+
+		const unsigned int start_sequence = sequence.load(std::memory_order_acquire);
+
+		if ((start_sequence == 0) || (start_sequence & 1))
+		{
+			return false;
+		}
+
+		bool match = true;
+
+		for (size_t i = 0; i < key.size(); ++i)
 		{
-			// The routes were invalidated, we recompile them.
+			match = (key[i].load(std::memory_order_relaxed) == expected_key[i]) && match;
+		}
+
+		verdict_type cached_verdict;
+		cached_verdict.target = target.load(std::memory_order_relaxed);
+		cached_verdict.candidates = candidates.load(std::memory_order_relaxed);
+		cached_verdict.cost = cost.load(std::memory_order_relaxed);
+		cached_verdict.total_weight = total_weight.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
 
-			m_routes = routes_port_type();
+		// An update happened while we were reading: the values might be torn.
+		if (!match || (sequence.load(std::memory_order_relaxed) != start_sequence))
+		{
+			return false;
+		}
 
-			// We add all the port routes to the routes list.
-			// These are sorted automatically by the container.
-			for (port_list_type::const_iterator port = m_ports.begin(); port != m_ports.end(); ++port)
+		_verdict = cached_verdict;
+
+		return true;
+	}
+
+	template <typename AddressType>
+	void router::flow_cache_entry_type<AddressType>::store(const AddressType& _destination, port_group_type _source_group, const verdict_type& _verdict)
+	{
+		const key_type new_key = make_key(_destination, _source_group);
+
+		unsigned int start_sequence = sequence.load(std::memory_order_relaxed);
+
+		// If another thread is already updating the entry, we leave it alone: the cache is only a hint.
+		if ((start_sequence & 1) || !sequence.compare_exchange_strong(start_sequence, start_sequence + 1, std::memory_order_relaxed))
+		{
+			return;
+		}
+
+		std::atomic_thread_fence(std::memory_order_release);
+
+		for (size_t i = 0; i < key.size(); ++i)
+		{
+			key[i].store(new_key[i], std::memory_order_relaxed);
+		}
+
+		target.store(_verdict.target, std::memory_order_relaxed);
+		candidates.store(_verdict.candidates, std::memory_order_relaxed);
+		cost.store(_verdict.cost, std::memory_order_relaxed);
+		total_weight.store(_verdict.total_weight, std::memory_order_relaxed);
+
+		sequence.store(start_sequence + 2, std::memory_order_release);
+	}
+
+	size_t router::get_flow_cache_slot(const boost::asio::ip::address_v4& addr, port_group_type source_group)
+	{
+		// Fibonacci hashing: the high bits of the product are the best mixed ones.
+		const uint32_t hash = (static_cast<uint32_t>(addr.to_ulong()) ^ source_group) * 2654435761u;
+
+		return (hash >> (32 - FLOW_CACHE_BITS));
+	}
+
+	size_t router::get_flow_cache_slot(const boost::asio::ip::address_v6& addr, port_group_type source_group)
+	{
+		const boost::asio::ip::address_v6::bytes_type bytes = addr.to_bytes();
+
+		uint32_t folded = source_group;
+
+		for (size_t i = 0; i < bytes.size(); i += 4)
+		{
+			folded ^= (static_cast<uint32_t>(bytes[i]) << 24) | (static_cast<uint32_t>(bytes[i + 1]) << 16) | (static_cast<uint32_t>(bytes[i + 2]) << 8) | static_cast<uint32_t>(bytes[i + 3]);
+		}
+
+		const uint32_t hash = folded * 2654435761u;
+
+		return (hash >> (32 - FLOW_CACHE_BITS));
+	}
+
+	void router::publish_snapshot()
+	{
+		const boost::shared_ptr<snapshot_type> snapshot = boost::make_shared<snapshot_type>();
+
+		snapshot->ports.resize(m_port_ids.size());
+
+		typedef std::multimap<asiotap::ip_route, port_id_type> routes_port_type;
+
+		// We add all the port routes to the routes list.
+		// These are sorted automatically by the container, which gives the order of routes that share a same network in the tries.
+		routes_port_type routes_ports;
+
+		for (auto&& port : m_ports)
+		{
+			const port_id_type port_id = m_port_ids.find(port.first);
+
+			snapshot->ports[port_id].index = port.first;
+			snapshot->ports[port_id].port = port.second;
+			snapshot->ports[port_id].generation = m_port_generations[port_id];
+
+			const auto& local_routes = port.second.local_routes();
+
+			for (auto&& route : local_routes)
 			{
-				const auto& local_routes = port->second.local_routes();
+				routes_ports.insert(std::make_pair(route, port_id));
+			}
+		}
 
-				for (auto&& route : local_routes)
-				{
-					m_routes->insert(std::make_pair(route, port->first));
-				}
+		for (auto&& route_port : routes_ports)
+		{
+			if (const asiotap::ipv4_route* const ipv4_route = boost::get<asiotap::ipv4_route>(&route_port.first))
+			{
+				snapshot->routes.ipv4.insert(ipv4_route->network_address(), route_port.second);
+			}
+			else if (const asiotap::ipv6_route* const ipv6_route = boost::get<asiotap::ipv6_route>(&route_port.first))
+			{
+				snapshot->routes.ipv6.insert(ipv6_route->network_address(), route_port.second);
 			}
 		}
 
-		return *m_routes;
+		// Forwarding threads still using the previous snapshot keep it alive until they are done.
+		boost::atomic_store(&m_snapshot, snapshot_ptr(snapshot));
 	}
 }
@@ -59,6 +59,18 @@ namespace freelan
 			INAT_IPV6_GATEWAY = 0x04
 		};
 
+		/**
+		 * \brief The extensions written in the trailer of a routes message.
+		 *
+		 * Each extension is a type byte, a length byte and length bytes of value. Unknown extensions are skipped.
+		 */
+		enum routes_message_extension_type
+		{
+			RMET_METRIC = 0x01
+		};
+
+		const size_t EXTENSION_HEADER_LENGTH = sizeof(uint8_t) + sizeof(uint8_t);
+
 		template <typename AddressType>
 		ip_network_address_type get_address_type(bool has_gateway);
 
@@ -213,7 +225,7 @@ namespace freelan
 						case INAT_IPV6:
 						case INAT_IPV6_GATEWAY:
 						{
-							ir = read_next_ip_route<boost::asio::ip::address_v6>(_type == INAT_IPV4_GATEWAY);
+							ir = read_next_ip_route<boost::asio::ip::address_v6>(_type == INAT_IPV6_GATEWAY);
 
 							break;
 						}
@@ -231,7 +243,7 @@ namespace freelan
 		};
 	}
 
-	size_t routes_message::write(void* buf, size_t buf_len, version_type _version, const asiotap::ip_route_set& routes)
+	size_t routes_message::write(void* buf, size_t buf_len, version_type _version, const asiotap::ip_route_set& routes, metric_type _metric)
 	{
 		if (buf_len < HEADER_LENGTH)
 		{
@@ -257,7 +269,24 @@ namespace freelan
 			pbuf_len -= count;
 		}
 
-		return message::write(buf, buf_len, MT_ROUTES, required_size);
+		size_t trailer_size = 0;
+
+		// The metric is an extension in the trailer: older peers never read past the payload.
+		if (_metric != 0)
+		{
+			if (pbuf_len < EXTENSION_HEADER_LENGTH + sizeof(uint32_t))
+			{
+				throw std::runtime_error("buf_len");
+			}
+
+			fscp::buffer_tools::set<uint8_t>(pbuf, 0, static_cast<uint8_t>(RMET_METRIC));
+			fscp::buffer_tools::set<uint8_t>(pbuf, 1, static_cast<uint8_t>(sizeof(uint32_t)));
+			fscp::buffer_tools::set<uint32_t>(pbuf, EXTENSION_HEADER_LENGTH, htonl(static_cast<uint32_t>(_metric)));
+
+			trailer_size += EXTENSION_HEADER_LENGTH + sizeof(uint32_t);
+		}
+
+		return message::write(buf, buf_len, MT_ROUTES, required_size) + trailer_size;
 	}
 
 	routes_message::version_type routes_message::version() const
@@ -289,15 +318,72 @@ namespace freelan
 		return *m_routes_cache;
 	}
 
+	routes_message::metric_type routes_message::metric() const
+	{
+		return m_metric;
+	}
+
+	void routes_message::read_extensions()
+	{
+		const uint8_t* pbuf = trailer();
+		size_t pbuf_len = trailer_length();
+
+		while (pbuf_len > 0)
+		{
+			if (pbuf_len < EXTENSION_HEADER_LENGTH)
+			{
+				throw std::runtime_error("Not enough bytes for the expected extension header");
+			}
+
+			const auto _type = fscp::buffer_tools::get<uint8_t>(pbuf, 0);
+			const size_t _length = fscp::buffer_tools::get<uint8_t>(pbuf, 1);
+
+			pbuf += EXTENSION_HEADER_LENGTH;
+			pbuf_len -= EXTENSION_HEADER_LENGTH;
+
+			if (pbuf_len < _length)
+			{
+				throw std::runtime_error("Not enough bytes for the expected extension");
+			}
+
+			switch (_type)
+			{
+				case RMET_METRIC:
+				{
+					if (_length != sizeof(uint32_t))
+					{
+						throw std::runtime_error("Unexpected metric length");
+					}
+
+					m_metric = ntohl(fscp::buffer_tools::get<uint32_t>(pbuf, 0));
+
+					break;
+				}
+				default:
+					// Unknown extensions come from newer peers: we skip them.
+					break;
+			}
+
+			pbuf += _length;
+			pbuf_len -= _length;
+		}
+	}
+
 	routes_message::routes_message(const void* buf, size_t buf_len) :
-		message(buf, buf_len)
+		message(buf, buf_len),
+		m_routes_cache(),
+		m_metric(0)
 	{
 		routes();
+		read_extensions();
 	}
 
 	routes_message::routes_message(const message& _message) :
-		message(_message)
+		message(_message),
+		m_routes_cache(),
+		m_metric(0)
 	{
 		routes();
+		read_extensions();
 	}
 }
@@ -44,6 +44,7 @@
  */
 
 #include "switch.hpp"
+#include "tcp_mss.hpp"
 
 #include <cassert>
 
@@ -63,6 +64,12 @@
 #include <boost/make_shared.hpp>
 
 #include <asiotap/osi/ethernet_helper.hpp>
+#include <asiotap/osi/arp_helper.hpp>
+#include <asiotap/osi/ipv4_helper.hpp>
+#include <asiotap/osi/ipv6_helper.hpp>
+#include <asiotap/osi/igmp_helper.hpp>
+#include <asiotap/osi/icmpv6_helper.hpp>
+#include <asiotap/osi/mld_helper.hpp>
 
 namespace freelan
 {
@@ -114,11 +121,72 @@ namespace freelan
 
 	const unsigned int switch_::MAX_ENTRIES_DEFAULT = 1024;
 
-	void switch_::async_write(port_index_type index, boost::asio::const_buffer data, multi_write_handler_type handler)
+	namespace
+	{
+		// The time remaining listeners have to answer the querier, after a leave message.
+		const boost::posix_time::time_duration LAST_MEMBER_QUERY_TIME = boost::posix_time::seconds(2);
+
+		template <typename MapType, typename Predicate>
+		void erase_if(MapType& map, Predicate predicate)
+		{
+			for (typename MapType::iterator entry = map.begin(); entry != map.end();)
+			{
+				if (predicate(*entry))
+				{
+					map.erase(entry++);
+				}
+				else
+				{
+					++entry;
+				}
+			}
+		}
+	}
+
+	void switch_::async_write(const port_handle_type& source, boost::asio::const_buffer data, multi_write_handler_type handler)
 	{
 		typedef results_gatherer<port_index_type, boost::system::error_code, multi_write_handler_type> results_gatherer_type;
 
-		const auto targets = get_targets_for(index, data);
+		const boost::optional<tcp_mss_clamped_packet_type> clamped_frame = clamp_ethernet_tcp_mss(data, tcp_mss_clamping_mtu());
+
+		if (clamped_frame)
+		{
+			data = clamped_frame->second;
+			handler = fscp::make_shared_buffer_handler(clamped_frame->first, handler);
+		}
+
+		// The snapshot keeps the target ports alive until we are done writing.
+		const ports_snapshot_ptr snapshot = boost::atomic_load(&m_ports_snapshot);
+
+		const port_entry_type* const source_port = find_port(*snapshot, source);
+		const port_id_type source_port_id = source_port ? source.id : INVALID_PORT_ID;
+		const port_index_type index = source_port ? source_port->index : port_index_type();
+
+		if (m_configuration.arp_suppression_enabled && source_port)
+		{
+			const boost::optional<arp_response_type> response = process_arp_frame(*snapshot, source_port_id, data);
+
+			if (response)
+			{
+				// The ARP request was answered: it goes back to the source port only.
+				boost::shared_ptr<results_gatherer_type> rg = boost::make_shared<results_gatherer_type>(handler, std::set<port_index_type>(&index, &index + 1));
+
+				source_port->port.async_write(response->second, fscp::make_shared_buffer_handler(response->first, boost::bind(&results_gatherer_type::gather, rg, index, _1)));
+
+				return;
+			}
+		}
+
+		target_list_type target_ports;
+
+		select_targets(*snapshot, source_port_id, data, target_ports);
+
+		std::set<port_index_type> targets;
+
+		for (size_t i = 0; i < target_ports.size(); ++i)
+		{
+			targets.insert(target_ports[i].index);
+		}
 
 #if FREELAN_DEBUG
 		if (!targets.empty())
@@ -131,29 +199,97 @@ namespace freelan
 		}
 #endif
 
+		// The results gatherer calls the handler right away if there is no target.
 		boost::shared_ptr<results_gatherer_type> rg = boost::make_shared<results_gatherer_type>(handler, targets);
 
-		for (auto&& target : targets)
+		for (size_t i = 0; i < target_ports.size(); ++i)
 		{
 #if FREELAN_DEBUG
-			std::cerr << index << "-> " << target << std::endl;
+			std::cerr << index << "-> " << target_ports[i].index << std::endl;
 #endif
 
-			m_ports[target].async_write(data, boost::bind(&results_gatherer_type::gather, rg, target, _1));
+			target_ports[i].port.async_write(data, boost::bind(&results_gatherer_type::gather, rg, target_ports[i].index, _1));
 		}
 	}
 
-	std::set<port_index_type> switch_::get_targets_for(port_index_type index, boost::asio::const_buffer data)
+	void switch_::async_forward(const port_handle_type& source, boost::asio::const_buffer data, port_type::write_handler_type handler)
 	{
-		const port_list_type::iterator source_port_entry = m_ports.find(index);
+#if FREELAN_DEBUG
+		std::cerr << "Switching " << buffer_size(data) << " byte(s) of data from port " << source.id << "." << std::endl;
+#endif
 
-		if (source_port_entry != m_ports.end())
+		const boost::optional<tcp_mss_clamped_packet_type> clamped_frame = clamp_ethernet_tcp_mss(data, tcp_mss_clamping_mtu());
+
+		if (clamped_frame)
 		{
+			data = clamped_frame->second;
+			handler = fscp::make_shared_buffer_handler(clamped_frame->first, handler);
+		}
+
+		// The snapshot keeps the target ports alive until we are done writing.
+		const ports_snapshot_ptr snapshot = boost::atomic_load(&m_ports_snapshot);
+
+		const port_entry_type* const source_port = find_port(*snapshot, source);
+		const port_id_type source_port_id = source_port ? source.id : INVALID_PORT_ID;
+
+		if (m_configuration.arp_suppression_enabled && source_port)
+		{
+			const boost::optional<arp_response_type> response = process_arp_frame(*snapshot, source_port_id, data);
+
+			if (response)
+			{
+				// The ARP request was answered: it goes back to the source port only.
+				source_port->port.async_write(response->second, fscp::make_shared_buffer_handler(response->first, handler));
+
+				return;
+			}
+		}
+
+		target_list_type target_ports;
+
+		// No lock is held anymore once the targets are selected: the writes of concurrent forwarding threads don't wait for each other.
+		select_targets(*snapshot, source_port_id, data, target_ports);
+
+		for (size_t i = 0; i < target_ports.size(); ++i)
+		{
+			target_ports[i].port.async_write(data, handler);
+		}
+	}
+
+	const switch_::port_entry_type* switch_::find_port(const ports_snapshot_type& snapshot, const port_ref_type& port_ref)
+	{
+		if ((port_ref.id >= snapshot.ports.size()) || (snapshot.ports[port_ref.id].state.generation != port_ref.generation) || (port_ref.generation == 0))
+		{
+			return nullptr;
+		}
+
+		return &snapshot.ports[port_ref.id];
+	}
+
+	switch_::port_ref_type switch_::get_port_ref(const ports_snapshot_type& snapshot, port_id_type port_id)
+	{
+		return port_ref_type(port_id, snapshot.ports[port_id].state.generation);
+	}
+
+	void switch_::select_targets(const ports_snapshot_type& snapshot, port_id_type source_port_id, boost::asio::const_buffer data, target_list_type& targets)
+	{
+		if (source_port_id != INVALID_PORT_ID)
+		{
+			const port_entry_type& source_port = snapshot.ports[source_port_id];
+
 			switch (m_configuration.routing_method)
 			{
 				case switch_configuration::RM_HUB:
 				{
-					return get_targets_for(source_port_entry);
+					asiotap::osi::const_helper<asiotap::osi::ethernet_frame> ethernet_helper(data);
+
+					// In hub mode, every frame is flooded and accounted for.
+					if (storm_control_admit(source_port, get_flooded_traffic_type(to_ethernet_address(ethernet_helper.target()))))
+					{
+						select_flood_targets(snapshot, source_port_id, targets);
+					}
+
+					break;
 				}
 				case switch_configuration::RM_SWITCH:
 				{
@@ -163,80 +299,694 @@ namespace freelan
 
 					if (is_multicast_address(target_address))
 					{
-						return get_targets_for(source_port_entry);
+						if (!storm_control_admit(source_port, get_flooded_traffic_type(target_address)))
+						{
+							break;
+						}
+
+						// Membership messages and reserved groups are always flooded.
+						if (m_configuration.multicast_snooping_enabled && !snoop_multicast_membership(get_port_ref(snapshot, source_port_id), data) && !is_flooded_multicast_address(target_address))
+						{
+							if (select_multicast_targets(snapshot, source_port_id, target_address, targets))
+							{
+								break;
+							}
+						}
+
+						select_flood_targets(snapshot, source_port_id, targets);
+
+						break;
 					}
-					else
-					{
-						m_ethernet_address_map[to_ethernet_address(ethernet_helper.sender())] = index;
 
-						// We exceeded the maximum count for entries: we delete random entries to fix it.
-						while (m_ethernet_address_map.size() > m_max_entries)
+					learn_ethernet_address(to_ethernet_address(ethernet_helper.sender()), get_port_ref(snapshot, source_port_id));
+
+					// The entries that reference a port which is gone or was replaced are not found.
+					const port_entry_type* const target_port = find_port(snapshot, find_ethernet_address(target_address));
+
+					if (!target_port)
+					{
+						// No target entry: we send the message to everybody.
+						if (storm_control_admit(source_port, FT_UNKNOWN_UNICAST))
 						{
-							ethernet_address_map_type::iterator entry = m_ethernet_address_map.begin();
+							select_flood_targets(snapshot, source_port_id, targets);
+						}
+
+						break;
+					}
+
+					targets.push_back(*target_port);
+
+					break;
+				}
+			}
+		}
+	}
+
+	void switch_::select_flood_targets(const ports_snapshot_type& snapshot, port_id_type source_port_id, target_list_type& targets)
+	{
+		const flood_lists_type::const_iterator flood_list = snapshot.flood_lists.find(snapshot.ports[source_port_id].port.group());
+
+		// Every registered port has its group in the flood lists.
+		assert(flood_list != snapshot.flood_lists.end());
+
+		for (auto&& port_id : flood_list->second)
+		{
+			if (port_id != source_port_id)
+			{
+				targets.push_back(snapshot.ports[port_id]);
+			}
+		}
+	}
+
+	switch_::ethernet_address_shard_type& switch_::get_ethernet_address_shard(const ethernet_address_type& address)
+	{
+		// The low-order bytes of ethernet addresses are the most random ones.
+		return m_ethernet_address_shards[(address[4] ^ address[5]) % ETHERNET_ADDRESS_SHARD_COUNT];
+	}
+
+	void switch_::learn_ethernet_address(const ethernet_address_type& address, const port_ref_type& port_ref)
+	{
+		ethernet_address_shard_type& shard = get_ethernet_address_shard(address);
+		const size_t max_entries = std::max<size_t>(m_max_entries / ETHERNET_ADDRESS_SHARD_COUNT, 1);
+
+		boost::mutex::scoped_lock lock(shard.mutex);
+
+		shard.entries[address] = port_ref;
+
+		// We exceeded the maximum count for entries: we delete random entries to fix it.
+		while (shard.entries.size() > max_entries)
+		{
+			ethernet_address_map_type::iterator entry = shard.entries.begin();
 
 #if BOOST_VERSION >= 104700
-							boost::random::mt19937 gen;
+			boost::random::mt19937 gen;
 
-							std::advance(entry, boost::random::uniform_int_distribution<>(0, static_cast<int>(m_ethernet_address_map.size()) - 1)(gen));
+			std::advance(entry, boost::random::uniform_int_distribution<>(0, static_cast<int>(shard.entries.size()) - 1)(gen));
 #else
-							boost::mt19937 gen;
+			boost::mt19937 gen;
 
-							boost::variate_generator<boost::mt19937&, boost::uniform_int<> > vgen(gen, boost::uniform_int<>(0, m_ethernet_address_map.size() - 1));
-							std::advance(entry, vgen());
+			boost::variate_generator<boost::mt19937&, boost::uniform_int<> > vgen(gen, boost::uniform_int<>(0, shard.entries.size() - 1));
+			std::advance(entry, vgen());
 #endif
 
-							m_ethernet_address_map.erase(entry);
+			shard.entries.erase(entry);
+		}
+	}
+
+	switch_::port_ref_type switch_::find_ethernet_address(const ethernet_address_type& address)
+	{
+		ethernet_address_shard_type& shard = get_ethernet_address_shard(address);
+
+		boost::mutex::scoped_lock lock(shard.mutex);
+
+		const ethernet_address_map_type::const_iterator entry = shard.entries.find(address);
+
+		return (entry != shard.entries.end()) ? entry->second : port_ref_type();
+	}
+
+	void switch_::publish_ports_snapshot()
+	{
+		const boost::shared_ptr<ports_snapshot_type> snapshot = boost::make_shared<ports_snapshot_type>();
+
+		snapshot->ports.resize(m_port_ids.size());
+
+		for (auto&& port : m_ports)
+		{
+			const port_id_type port_id = m_port_ids.find(port.first);
+
+			snapshot->ports[port_id].index = port.first;
+			snapshot->ports[port_id].port = port.second;
+			snapshot->ports[port_id].state = m_port_states[port_id];
+			snapshot->flood_lists[port.second.group()];
+		}
+
+		for (auto&& flood_list : snapshot->flood_lists)
+		{
+			for (auto&& port : m_ports)
+			{
+				if (m_configuration.relay_mode_enabled || (flood_list.first != port.second.group()))
+				{
+					flood_list.second.push_back(m_port_ids.find(port.first));
+				}
+			}
+		}
+
+		// Forwarding threads still using the previous snapshot keep it alive until they are done.
+		boost::atomic_store(&m_ports_snapshot, ports_snapshot_ptr(snapshot));
+	}
+
+	bool switch_::select_multicast_targets(const ports_snapshot_type& snapshot, port_id_type source_port_id, const ethernet_address_type& group, target_list_type& targets)
+	{
+		const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+		boost::mutex::scoped_lock lock(m_multicast_mutex);
+
+		for (multicast_port_map_type::iterator router = m_multicast_routers.begin(); router != m_multicast_routers.end();)
+		{
+			if ((router->second < now) || !find_port(snapshot, router->first))
+			{
+				m_multicast_routers.erase(router++);
+			}
+			else
+			{
+				++router;
+			}
+		}
+
+		multicast_group_map_type::iterator group_entry = m_multicast_groups.find(group);
+
+		if (group_entry != m_multicast_groups.end())
+		{
+			multicast_port_map_type& listeners = group_entry->second;
+
+			for (multicast_port_map_type::iterator listener = listeners.begin(); listener != listeners.end();)
+			{
+				if ((listener->second < now) || !find_port(snapshot, listener->first))
+				{
+					listeners.erase(listener++);
+				}
+				else
+				{
+					++listener;
+				}
+			}
+
+			if (listeners.empty())
+			{
+				m_multicast_groups.erase(group_entry);
+				group_entry = m_multicast_groups.end();
+			}
+		}
+
+		if ((group_entry == m_multicast_groups.end()) && m_multicast_routers.empty())
+		{
+			// Without a querier, we can't tell whether the group has listeners: the caller must flood.
+			return false;
+		}
+
+		const auto forward = [this, &snapshot, source_port_id, &targets](const port_ref_type& port_ref) {
+			if (port_ref.id != source_port_id)
+			{
+				if (m_configuration.relay_mode_enabled || (snapshot.ports[source_port_id].port.group() != snapshot.ports[port_ref.id].port.group()))
+				{
+					targets.push_back(snapshot.ports[port_ref.id]);
+				}
+			}
+		};
+
+		if (group_entry != m_multicast_groups.end())
+		{
+			for (auto&& listener : group_entry->second)
+			{
+				forward(listener.first);
+			}
+		}
+
+		for (auto&& router : m_multicast_routers)
+		{
+			if ((group_entry == m_multicast_groups.end()) || (group_entry->second.find(router.first) == group_entry->second.end()))
+			{
+				forward(router.first);
+			}
+		}
+
+		return true;
+	}
+
+	bool switch_::snoop_multicast_membership(const port_ref_type& port_ref, boost::asio::const_buffer data)
+	{
+		using namespace asiotap::osi;
+
+		try
+		{
+			const_helper<ethernet_frame> ethernet_helper(data);
+
+			switch (ethernet_helper.protocol())
+			{
+				case IP_PROTOCOL:
+				{
+					const_helper<ipv4_frame> ipv4_helper(ethernet_helper.payload());
+
+					if (ipv4_helper.protocol() == IGMP_PROTOCOL)
+					{
+						snoop_igmp(port_ref, ipv4_helper.payload());
+
+						return true;
+					}
+
+					break;
+				}
+				case IPV6_PROTOCOL:
+				{
+					const_helper<ipv6_frame> ipv6_helper(ethernet_helper.payload());
+
+					uint8_t next_header = ipv6_helper.next_header();
+					boost::asio::const_buffer payload = ipv6_helper.payload();
+
+					// MLD messages come after a hop-by-hop options header that holds the router alert option.
+					if ((next_header == IPV6_HOP_BY_HOP_OPTIONS_HEADER) && (boost::asio::buffer_size(payload) >= 2))
+					{
+						const uint8_t* const extension_header = boost::asio::buffer_cast<const uint8_t*>(payload);
+
+						next_header = extension_header[0];
+						payload = payload + (extension_header[1] + 1) * 8;
+					}
+
+					if (next_header == ICMPV6_PROTOCOL)
+					{
+						const_helper<icmpv6_frame> icmpv6_helper(payload);
+
+						switch (icmpv6_helper.type())
+						{
+							case MLD_LISTENER_QUERY:
+							case MLD_V1_LISTENER_REPORT:
+							case MLD_V1_LISTENER_DONE:
+							case MLD_V2_LISTENER_REPORT:
+							{
+								snoop_mld(port_ref, payload);
+
+								return true;
+							}
 						}
+					}
+
+					break;
+				}
+			}
+		}
+		catch (std::length_error&)
+		{
+			// Truncated frames are not membership messages.
+		}
+
+		return false;
+	}
+
+	void switch_::snoop_igmp(const port_ref_type& port_ref, boost::asio::const_buffer data)
+	{
+		using namespace asiotap::osi;
+
+		const_helper<igmp_frame> igmp_helper(data);
+
+		boost::mutex::scoped_lock lock(m_multicast_mutex);
+
+		switch (igmp_helper.type())
+		{
+			case IGMP_MEMBERSHIP_QUERY:
+			{
+				m_multicast_routers[port_ref] = boost::posix_time::microsec_clock::universal_time() + m_configuration.multicast_membership_timeout;
+
+				break;
+			}
+			case IGMP_V1_MEMBERSHIP_REPORT:
+			case IGMP_V2_MEMBERSHIP_REPORT:
+			{
+				if (igmp_helper.group_address().is_multicast())
+				{
+					add_multicast_listener(port_ref, to_ethernet_address(igmp_helper.group_address()));
+				}
+
+				break;
+			}
+			case IGMP_V2_LEAVE_GROUP:
+			{
+				if (igmp_helper.group_address().is_multicast())
+				{
+					remove_multicast_listener(port_ref, to_ethernet_address(igmp_helper.group_address()));
+				}
+
+				break;
+			}
+			case IGMP_V3_MEMBERSHIP_REPORT:
+			{
+				boost::asio::const_buffer records = igmp_helper.payload();
 
-						// We look in the ethernet address map
+				for (size_t i = 0; i < igmp_helper.group_record_count(); ++i)
+				{
+					const_helper<igmpv3_group_record> record_helper(records);
 
-						const ethernet_address_map_type::iterator target_entry = m_ethernet_address_map.find(target_address);
+					if (record_helper.multicast_address().is_multicast())
+					{
+						const ethernet_address_type group = to_ethernet_address(record_helper.multicast_address());
 
-						if (target_entry == m_ethernet_address_map.end())
+						switch (record_helper.record_type())
 						{
-							// No target entry: we send the message to everybody.
-							return get_targets_for(source_port_entry);
+							case IGMP_V3_MODE_IS_INCLUDE:
+							case IGMP_V3_CHANGE_TO_INCLUDE_MODE:
+							{
+								// Including no source at all means leaving the group.
+								if (record_helper.source_count() == 0)
+								{
+									remove_multicast_listener(port_ref, group);
+								}
+								else
+								{
+									add_multicast_listener(port_ref, group);
+								}
+
+								break;
+							}
+							case IGMP_V3_MODE_IS_EXCLUDE:
+							case IGMP_V3_CHANGE_TO_EXCLUDE_MODE:
+							case IGMP_V3_ALLOW_NEW_SOURCES:
+							{
+								add_multicast_listener(port_ref, group);
+
+								break;
+							}
 						}
+					}
+
+					records = records + record_helper.length();
+				}
+
+				break;
+			}
+		}
+	}
+
+	void switch_::snoop_mld(const port_ref_type& port_ref, boost::asio::const_buffer data)
+	{
+		using namespace asiotap::osi;
+
+		const_helper<icmpv6_frame> icmpv6_helper(data);
+
+		boost::mutex::scoped_lock lock(m_multicast_mutex);
+
+		switch (icmpv6_helper.type())
+		{
+			case MLD_LISTENER_QUERY:
+			{
+				m_multicast_routers[port_ref] = boost::posix_time::microsec_clock::universal_time() + m_configuration.multicast_membership_timeout;
+
+				break;
+			}
+			case MLD_V1_LISTENER_REPORT:
+			{
+				const_helper<mld_frame> mld_helper(icmpv6_helper.payload());
+
+				if (mld_helper.multicast_address().is_multicast())
+				{
+					add_multicast_listener(port_ref, to_ethernet_address(mld_helper.multicast_address()));
+				}
+
+				break;
+			}
+			case MLD_V1_LISTENER_DONE:
+			{
+				const_helper<mld_frame> mld_helper(icmpv6_helper.payload());
+
+				if (mld_helper.multicast_address().is_multicast())
+				{
+					remove_multicast_listener(port_ref, to_ethernet_address(mld_helper.multicast_address()));
+				}
+
+				break;
+			}
+			case MLD_V2_LISTENER_REPORT:
+			{
+				const_helper<mldv2_report_frame> report_helper(icmpv6_helper.payload());
+
+				boost::asio::const_buffer records = report_helper.payload();
 
-						const port_index_type target_port_index = target_entry->second;
+				for (size_t i = 0; i < report_helper.record_count(); ++i)
+				{
+					const_helper<mldv2_address_record> record_helper(records);
 
-						if (!is_registered(target_port_index))
+					if (record_helper.multicast_address().is_multicast())
+					{
+						const ethernet_address_type group = to_ethernet_address(record_helper.multicast_address());
+
+						switch (record_helper.record_type())
 						{
-							// The port does not exist: we delete the entry and send to everybody.
-							m_ethernet_address_map.erase(target_entry);
+							case MLD_V2_MODE_IS_INCLUDE:
+							case MLD_V2_CHANGE_TO_INCLUDE_MODE:
+							{
+								// Including no source at all means leaving the group.
+								if (record_helper.source_count() == 0)
+								{
+									remove_multicast_listener(port_ref, group);
+								}
+								else
+								{
+									add_multicast_listener(port_ref, group);
+								}
+
+								break;
+							}
+							case MLD_V2_MODE_IS_EXCLUDE:
+							case MLD_V2_CHANGE_TO_EXCLUDE_MODE:
+							case MLD_V2_ALLOW_NEW_SOURCES:
+							{
+								add_multicast_listener(port_ref, group);
 
-							return get_targets_for(source_port_entry);
+								break;
+							}
 						}
+					}
+
+					records = records + record_helper.length();
+				}
+
+				break;
+			}
+		}
+	}
+
+	void switch_::add_multicast_listener(const port_ref_type& port_ref, const ethernet_address_type& group)
+	{
+		multicast_group_map_type::iterator group_entry = m_multicast_groups.find(group);
+
+		if (group_entry == m_multicast_groups.end())
+		{
+			// We don't track more groups than ethernet addresses: untracked groups are flooded.
+			if (m_multicast_groups.size() >= m_max_entries)
+			{
+				return;
+			}
+
+			group_entry = m_multicast_groups.insert(std::make_pair(group, multicast_port_map_type())).first;
+		}
+
+		group_entry->second[port_ref] = boost::posix_time::microsec_clock::universal_time() + m_configuration.multicast_membership_timeout;
+	}
+
+	void switch_::remove_multicast_listener(const port_ref_type& port_ref, const ethernet_address_type& group)
+	{
+		const multicast_group_map_type::iterator group_entry = m_multicast_groups.find(group);
+
+		if (group_entry != m_multicast_groups.end())
+		{
+			const multicast_port_map_type::iterator listener = group_entry->second.find(port_ref);
+
+			if (listener != group_entry->second.end())
+			{
+				// Other listeners may live behind the same port: we give them a chance to answer the querier before we stop forwarding.
+				const boost::posix_time::ptime expiration = boost::posix_time::microsec_clock::universal_time() + LAST_MEMBER_QUERY_TIME;
+
+				listener->second = std::min(listener->second, expiration);
+			}
+		}
+	}
+
+	void switch_::forget_multicast_port(port_id_type port_id)
+	{
+		boost::mutex::scoped_lock lock(m_multicast_mutex);
+
+		const auto is_port = [port_id](const multicast_port_map_type::value_type& entry) { return entry.first.id == port_id; };
+
+		erase_if(m_multicast_routers, is_port);
+
+		for (multicast_group_map_type::iterator group_entry = m_multicast_groups.begin(); group_entry != m_multicast_groups.end();)
+		{
+			erase_if(group_entry->second, is_port);
+
+			if (group_entry->second.empty())
+			{
+				m_multicast_groups.erase(group_entry++);
+			}
+			else
+			{
+				++group_entry;
+			}
+		}
+	}
+
+	void switch_::forget_ethernet_port(port_id_type port_id)
+	{
+		for (auto&& shard : m_ethernet_address_shards)
+		{
+			boost::mutex::scoped_lock lock(shard.mutex);
+
+			erase_if(shard.entries, [port_id](const ethernet_address_map_type::value_type& entry) { return entry.second.id == port_id; });
+		}
+	}
+
+	boost::optional<switch_::arp_response_type> switch_::process_arp_frame(const ports_snapshot_type& snapshot, port_id_type source_port_id, boost::asio::const_buffer data)
+	{
+		using namespace asiotap::osi;
+
+		try
+		{
+			const_helper<ethernet_frame> ethernet_helper(data);
+
+			if (ethernet_helper.protocol() != ARP_PROTOCOL)
+			{
+				return boost::none;
+			}
+
+			const_helper<arp_frame> arp_helper(ethernet_helper.payload());
+
+			if ((arp_helper.hardware_type() != ETHERNET_HARDWARE_TYPE) || (arp_helper.protocol_type() != IP_PROTOCOL_TYPE) || (arp_helper.hardware_address_length() != ETHERNET_ADDRESS_SIZE) || (arp_helper.logical_address_length() != sizeof(in_addr)))
+			{
+				return boost::none;
+			}
+
+			const boost::asio::ip::address_v4 sender_logical_address = arp_helper.sender_logical_address();
+			const boost::asio::ip::address_v4 target_logical_address = arp_helper.target_logical_address();
+			const port_ref_type source_port_ref = get_port_ref(snapshot, source_port_id);
+
+			boost::mutex::scoped_lock lock(m_arp_mutex);
+
+			switch (arp_helper.operation())
+			{
+				case ARP_REPLY_OPERATION:
+				{
+					learn_arp_binding(source_port_ref, sender_logical_address, to_ethernet_address(arp_helper.sender_hardware_address()));
+
+					break;
+				}
+				case ARP_REQUEST_OPERATION:
+				{
+					// A gratuitous ARP announces a binding: it is flooded as usual.
+					if (sender_logical_address == target_logical_address)
+					{
+						learn_arp_binding(source_port_ref, sender_logical_address, to_ethernet_address(arp_helper.sender_hardware_address()));
+
+						break;
+					}
+
+					const arp_binding_map_type::iterator binding = m_arp_bindings.find(target_logical_address);
+
+					if (binding == m_arp_bindings.end())
+					{
+						break;
+					}
+
+					if (binding->second.expiration < boost::posix_time::microsec_clock::universal_time())
+					{
+						forget_arp_binding(binding);
+
+						break;
+					}
 
-						std::set<port_index_type> targets;
+					const port_entry_type* const target_port = find_port(snapshot, binding->second.port);
 
-						targets.insert(target_port_index);
+					// The binding references a port that is gone or was replaced.
+					if (!target_port)
+					{
+						forget_arp_binding(binding);
+
+						break;
+					}
+
+					// We only answer for hosts that the requester could reach through the switch.
+					if (binding->second.port.id == source_port_id)
+					{
+						break;
+					}
 
-						return targets;
+					if (!m_configuration.relay_mode_enabled && (snapshot.ports[source_port_id].port.group() == target_port->port.group()))
+					{
+						break;
 					}
+
+					const fscp::SharedBuffer response_buffer(sizeof(ethernet_frame) + sizeof(arp_frame));
+					const boost::optional<boost::asio::const_buffer> response = m_arp_proxy.process_frame(ethernet_helper, arp_helper, buffer(response_buffer));
+
+					if (response)
+					{
+						return std::make_pair(response_buffer, *response);
+					}
+
+					break;
 				}
 			}
 		}
+		catch (std::length_error&)
+		{
+			// Truncated frames are not ARP frames.
+		}
 
-		return std::set<port_index_type>();
+		return boost::none;
 	}
 
-	std::set<port_index_type> switch_::get_targets_for(port_list_type::const_iterator source_port_entry)
+	void switch_::learn_arp_binding(const port_ref_type& port_ref, const boost::asio::ip::address_v4& logical_address, const ethernet_address_type& hardware_address)
 	{
-		std::set<port_index_type> targets;
+		// ARP probes have no sender address.
+		if (logical_address.is_unspecified() || is_multicast_address(hardware_address))
+		{
+			return;
+		}
+
+		const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+		arp_binding_map_type::iterator binding = m_arp_bindings.find(logical_address);
 
-		for (port_list_type::const_iterator port_entry = m_ports.begin(); port_entry != m_ports.end(); ++port_entry)
+		if (binding == m_arp_bindings.end())
 		{
-			if (source_port_entry != port_entry)
+			if (m_arp_bindings.size() >= m_max_entries)
 			{
-				if (m_configuration.relay_mode_enabled || (source_port_entry->second.group() != port_entry->second.group()))
+				// We make room by removing the expired bindings, if any.
+				for (arp_binding_map_type::iterator entry = m_arp_bindings.begin(); entry != m_arp_bindings.end();)
+				{
+					if (entry->second.expiration < now)
+					{
+						forget_arp_binding(entry++);
+					}
+					else
+					{
+						++entry;
+					}
+				}
+
+				if (m_arp_bindings.size() >= m_max_entries)
 				{
-					targets.insert(port_entry->first);
+					return;
 				}
 			}
+
+			binding = m_arp_bindings.insert(std::make_pair(logical_address, arp_binding_type())).first;
 		}
 
-		return targets;
+		binding->second.port = port_ref;
+		binding->second.expiration = now + m_configuration.arp_binding_timeout;
+
+		m_arp_proxy.remove_entry(logical_address);
+		m_arp_proxy.add_entry(logical_address, asiotap::osi::ethernet_address(hardware_address));
+	}
+
+	void switch_::forget_arp_binding(arp_binding_map_type::iterator binding)
+	{
+		m_arp_proxy.remove_entry(binding->first);
+		m_arp_bindings.erase(binding);
+	}
+
+	void switch_::forget_arp_port(port_id_type port_id)
+	{
+		boost::mutex::scoped_lock lock(m_arp_mutex);
+
+		for (arp_binding_map_type::iterator binding = m_arp_bindings.begin(); binding != m_arp_bindings.end();)
+		{
+			if (binding->second.port.id == port_id)
+			{
+				forget_arp_binding(binding++);
+			}
+			else
+			{
+				++binding;
+			}
+		}
 	}
 
 	switch_::ethernet_address_type switch_::to_ethernet_address(boost::asio::const_buffer buf)
@@ -250,8 +1000,145 @@ namespace freelan
 		return result;
 	}
 
+	switch_::ethernet_address_type switch_::to_ethernet_address(const boost::asio::ip::address_v4& address)
+	{
+		const boost::asio::ip::address_v4::bytes_type bytes = address.to_bytes();
+
+		// RFC 1112: the low-order 23 bits of the group address are mapped into 01:00:5e:00:00:00.
+		const ethernet_address_type result = {{ 0x01, 0x00, 0x5e, static_cast<uint8_t>(bytes[1] & 0x7f), bytes[2], bytes[3] }};
+
+		return result;
+	}
+
+	switch_::ethernet_address_type switch_::to_ethernet_address(const boost::asio::ip::address_v6& address)
+	{
+		const boost::asio::ip::address_v6::bytes_type bytes = address.to_bytes();
+
+		// RFC 2464: the low-order 32 bits of the group address are mapped into 33:33:00:00:00:00.
+		const ethernet_address_type result = {{ 0x33, 0x33, bytes[12], bytes[13], bytes[14], bytes[15] }};
+
+		return result;
+	}
+
 	bool switch_::is_multicast_address(const switch_::ethernet_address_type& address)
 	{
 		return ((address[0] & 0x01) != 0x00);
 	}
+
+	bool switch_::is_flooded_multicast_address(const switch_::ethernet_address_type& address)
+	{
+		static const ethernet_address_type broadcast_address = {{ 0xff, 0xff, 0xff, 0xff, 0xff, 0xff }};
+		static const ethernet_address_type all_nodes_address = {{ 0x33, 0x33, 0x00, 0x00, 0x00, 0x01 }};
+
+		if ((address == broadcast_address) || (address == all_nodes_address))
+		{
+			return true;
+		}
+
+		// RFC 4541: the 224.0.0.X link-local groups must be forwarded on all ports.
+		return ((address[0] == 0x01) && (address[1] == 0x00) && (address[2] == 0x5e) && (address[3] == 0x00) && (address[4] == 0x00));
+	}
+
+	switch_::storm_control_drops_type switch_::get_storm_control_drops(port_index_type index) const
+	{
+		boost::shared_ptr<storm_control_state_type> state;
+
+		{
+			boost::mutex::scoped_lock lock(m_state_mutex);
+
+			const port_id_type port_id = m_port_ids.find(index);
+
+			if ((port_id == INVALID_PORT_ID) || (port_id >= m_port_states.size()) || !m_port_states[port_id].storm_control)
+			{
+				return storm_control_drops_type();
+			}
+
+			state = m_port_states[port_id].storm_control;
+		}
+
+		boost::mutex::scoped_lock lock(state->mutex);
+
+		return state->drops;
+	}
+
+	switch_::flooded_traffic_type switch_::get_flooded_traffic_type(const switch_::ethernet_address_type& address)
+	{
+		static const ethernet_address_type broadcast_address = {{ 0xff, 0xff, 0xff, 0xff, 0xff, 0xff }};
+
+		if (address == broadcast_address)
+		{
+			return FT_BROADCAST;
+		}
+
+		return is_multicast_address(address) ? FT_MULTICAST : FT_UNKNOWN_UNICAST;
+	}
+
+	unsigned int switch_::get_rate_limit(switch_::flooded_traffic_type traffic_type) const
+	{
+		switch (traffic_type)
+		{
+			case FT_BROADCAST:
+				return m_configuration.broadcast_rate_limit;
+			case FT_MULTICAST:
+				return m_configuration.multicast_rate_limit;
+			case FT_UNKNOWN_UNICAST:
+				return m_configuration.unknown_unicast_rate_limit;
+			case FT_COUNT:
+				break;
+		}
+
+		assert(false);
+
+		return 0;
+	}
+
+	bool switch_::storm_control_admit(const port_entry_type& port_entry, switch_::flooded_traffic_type traffic_type)
+	{
+		const unsigned int rate_limit = get_rate_limit(traffic_type);
+
+		if (rate_limit == 0)
+		{
+			return true;
+		}
+
+		// Every registered port has a storm control state.
+		assert(port_entry.state.storm_control);
+
+		storm_control_state_type& state = *port_entry.state.storm_control;
+
+		boost::mutex::scoped_lock lock(state.mutex);
+
+		token_bucket_type& bucket = state.buckets[traffic_type];
+
+		const double capacity = std::max(m_configuration.storm_control_burst_size, 1u);
+		const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+		if (bucket.last_refill.is_not_a_date_time())
+		{
+			bucket.tokens = capacity;
+		}
+		else if (now > bucket.last_refill)
+		{
+			const double elapsed = static_cast<double>((now - bucket.last_refill).total_microseconds()) / 1000000.0;
+
+			bucket.tokens = std::min(capacity, bucket.tokens + elapsed * rate_limit);
+		}
+
+		bucket.last_refill = now;
+
+		if (bucket.tokens >= 1.0)
+		{
+			bucket.tokens -= 1.0;
+
+			return true;
+		}
+
+		++state.drops[traffic_type];
+
+#if FREELAN_DEBUG
+		std::cerr << "Storm control: dropping a flooded frame from port " << port_entry.index << " (" << state.drops[traffic_type] << " so far)." << std::endl;
+#endif
+
+		return false;
+	}
 }
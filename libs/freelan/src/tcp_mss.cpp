@@ -0,0 +1,268 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file tcp_mss.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief TCP MSS clamping functions.
+ */
+
+#include "tcp_mss.hpp"
+
+#include <cstddef>
+#include <cstring>
+
+#include <asiotap/osi/ethernet_frame.hpp>
+#include <asiotap/osi/ipv4_frame.hpp>
+#include <asiotap/osi/ipv6_frame.hpp>
+#include <asiotap/osi/checksum.hpp>
+
+namespace freelan
+{
+	namespace
+	{
+		const uint8_t TCP_PROTOCOL = 0x06;
+
+		// The TCP header layout (RFC 793).
+		const size_t TCP_HEADER_LENGTH = 20;
+		const size_t TCP_DATA_OFFSET_OFFSET = 12;
+		const size_t TCP_FLAGS_OFFSET = 13;
+		const size_t TCP_CHECKSUM_OFFSET = 16;
+		const uint8_t TCP_FLAG_SYN = 0x02;
+
+		const uint8_t TCP_OPTION_END = 0;
+		const uint8_t TCP_OPTION_NOP = 1;
+		const uint8_t TCP_OPTION_MSS = 2;
+		const uint8_t TCP_OPTION_MSS_LENGTH = 4;
+
+		const size_t ETHERNET_PROTOCOL_OFFSET = offsetof(asiotap::osi::ethernet_frame, protocol);
+		const size_t IPV4_PROTOCOL_OFFSET = offsetof(asiotap::osi::ipv4_frame, protocol);
+		const size_t IPV4_FLAGS_FRAGMENT_OFFSET = offsetof(asiotap::osi::ipv4_frame, flags_fragment);
+		const size_t IPV6_NEXT_HEADER_OFFSET = offsetof(asiotap::osi::ipv6_frame, next_header);
+
+		const uint8_t IPV4_MINIMUM_IHL = 5;
+		const uint16_t IPV4_FRAGMENT_OFFSET_MASK = 0x1FFF;
+
+		uint16_t read_uint16(const uint8_t* buf)
+		{
+			return static_cast<uint16_t>((buf[0] << 8) | buf[1]);
+		}
+
+		// Get the offset of the TCP segment in an IP packet, and the biggest MSS that fits in mtu.
+		bool find_tcp_segment(const uint8_t* buf, size_t size, unsigned int mtu, size_t& tcp_offset, unsigned int& max_mss)
+		{
+			if (size == 0)
+			{
+				return false;
+			}
+
+			size_t ip_header_length = 0;
+
+			switch (buf[0] >> 4)
+			{
+				case asiotap::osi::IP_PROTOCOL_VERSION_4:
+				{
+					if ((size < sizeof(asiotap::osi::ipv4_frame)) || ((buf[0] & 0x0f) < IPV4_MINIMUM_IHL))
+					{
+						return false;
+					}
+
+					// Only the first fragment holds the TCP header.
+					if ((buf[IPV4_PROTOCOL_OFFSET] != TCP_PROTOCOL) || ((read_uint16(buf + IPV4_FLAGS_FRAGMENT_OFFSET) & IPV4_FRAGMENT_OFFSET_MASK) != 0))
+					{
+						return false;
+					}
+
+					tcp_offset = (buf[0] & 0x0f) * 4;
+					ip_header_length = sizeof(asiotap::osi::ipv4_frame);
+
+					break;
+				}
+				case asiotap::osi::IP_PROTOCOL_VERSION_6:
+				{
+					// Extension headers are not walked: SYN segments hardly ever carry any.
+					if ((size < sizeof(asiotap::osi::ipv6_frame)) || (buf[IPV6_NEXT_HEADER_OFFSET] != TCP_PROTOCOL))
+					{
+						return false;
+					}
+
+					tcp_offset = sizeof(asiotap::osi::ipv6_frame);
+					ip_header_length = sizeof(asiotap::osi::ipv6_frame);
+
+					break;
+				}
+				default:
+					return false;
+			}
+
+			if ((tcp_offset > size) || (mtu <= ip_header_length + TCP_HEADER_LENGTH))
+			{
+				return false;
+			}
+
+			max_mss = static_cast<unsigned int>(mtu - ip_header_length - TCP_HEADER_LENGTH);
+
+			return true;
+		}
+
+		// Get the offset of the MSS value in a TCP SYN segment.
+		bool find_mss_option(const uint8_t* segment, size_t size, size_t& mss_offset)
+		{
+			if ((size < TCP_HEADER_LENGTH) || !(segment[TCP_FLAGS_OFFSET] & TCP_FLAG_SYN))
+			{
+				return false;
+			}
+
+			const size_t header_length = (segment[TCP_DATA_OFFSET_OFFSET] >> 4) * 4;
+
+			if ((header_length < TCP_HEADER_LENGTH) || (header_length > size))
+			{
+				return false;
+			}
+
+			for (size_t offset = TCP_HEADER_LENGTH; offset < header_length;)
+			{
+				const uint8_t kind = segment[offset];
+
+				if (kind == TCP_OPTION_END)
+				{
+					break;
+				}
+
+				if (kind == TCP_OPTION_NOP)
+				{
+					++offset;
+
+					continue;
+				}
+
+				if (offset + 1 >= header_length)
+				{
+					break;
+				}
+
+				const uint8_t length = segment[offset + 1];
+
+				if ((length < 2) || (offset + length > header_length))
+				{
+					break;
+				}
+
+				if ((kind == TCP_OPTION_MSS) && (length == TCP_OPTION_MSS_LENGTH))
+				{
+					mss_offset = offset + 2;
+
+					return true;
+				}
+
+				offset += length;
+			}
+
+			return false;
+		}
+
+		boost::optional<tcp_mss_clamped_packet_type> clamp_tcp_mss_at(boost::asio::const_buffer data, size_t packet_offset, unsigned int mtu)
+		{
+			const size_t size = boost::asio::buffer_size(data);
+			const uint8_t* const buf = boost::asio::buffer_cast<const uint8_t*>(data);
+
+			size_t tcp_offset = 0;
+			unsigned int max_mss = 0;
+
+			if ((mtu == 0) || !find_tcp_segment(buf + packet_offset, size - packet_offset, mtu, tcp_offset, max_mss))
+			{
+				return boost::none;
+			}
+
+			const size_t segment_offset = packet_offset + tcp_offset;
+			const uint8_t* const segment = buf + segment_offset;
+			size_t mss_offset = 0;
+
+			if (!find_mss_option(segment, size - segment_offset, mss_offset) || (read_uint16(segment + mss_offset) <= max_mss))
+			{
+				return boost::none;
+			}
+
+			const fscp::SharedBuffer result(size);
+			uint8_t* const result_buf = fscp::buffer_cast<uint8_t*>(result);
+			uint8_t* const result_segment = result_buf + segment_offset;
+
+			std::memcpy(result_buf, buf, size);
+
+			result_segment[mss_offset] = static_cast<uint8_t>(max_mss >> 8);
+			result_segment[mss_offset + 1] = static_cast<uint8_t>(max_mss & 0xff);
+
+			// The MSS value starts at an odd offset when a single NOP precedes it: the checksum gets updated on the 16-bit words that cover it.
+			const size_t first_word_offset = mss_offset & ~static_cast<size_t>(1);
+			const size_t words_length = ((mss_offset + sizeof(uint16_t) + 1) & ~static_cast<size_t>(1)) - first_word_offset;
+
+			uint16_t checksum;
+			std::memcpy(&checksum, result_segment + TCP_CHECKSUM_OFFSET, sizeof(checksum));
+			checksum = asiotap::osi::update_checksum(checksum, segment + first_word_offset, result_segment + first_word_offset, words_length);
+			std::memcpy(result_segment + TCP_CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+
+			return std::make_pair(result, boost::asio::const_buffer(fscp::buffer(result)));
+		}
+	}
+
+	boost::optional<tcp_mss_clamped_packet_type> clamp_tcp_mss(boost::asio::const_buffer packet, unsigned int mtu)
+	{
+		return clamp_tcp_mss_at(packet, 0, mtu);
+	}
+
+	boost::optional<tcp_mss_clamped_packet_type> clamp_ethernet_tcp_mss(boost::asio::const_buffer frame, unsigned int mtu)
+	{
+		const size_t size = boost::asio::buffer_size(frame);
+		const uint8_t* const buf = boost::asio::buffer_cast<const uint8_t*>(frame);
+
+		if (size < sizeof(asiotap::osi::ethernet_frame))
+		{
+			return boost::none;
+		}
+
+		const uint16_t protocol = read_uint16(buf + ETHERNET_PROTOCOL_OFFSET);
+
+		if ((protocol != asiotap::osi::IP_PROTOCOL) && (protocol != asiotap::osi::IPV6_PROTOCOL))
+		{
+			return boost::none;
+		}
+
+		return clamp_tcp_mss_at(frame, sizeof(asiotap::osi::ethernet_frame), mtu);
+	}
+}
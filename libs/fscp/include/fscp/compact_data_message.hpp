@@ -0,0 +1,248 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file compact_data_message.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A compact data message class.
+ */
+
+#ifndef FSCP_COMPACT_DATA_MESSAGE_HPP
+#define FSCP_COMPACT_DATA_MESSAGE_HPP
+
+#include "buffer_tools.hpp"
+#include "constants.hpp"
+
+#include <cryptoplus/cipher/cipher_algorithm.hpp>
+
+#include <stdint.h>
+
+namespace fscp
+{
+	/**
+	 * \brief A compact data message class.
+	 *
+	 * Compact data messages carry the same payloads as the DATA, CONTACT_REQUEST, CONTACT, KEEP_ALIVE, AGGREGATED_DATA, PATH_MTU_PROBE and PATH_MTU_REPLY messages but have a smaller overhead:
+	 * - a one byte header holds the message type and the parity of the session number, so that the receiver knows which keys to use ;
+	 * - the ciphertext length is implied by the datagram length ;
+	 * - the nonce prefix is never sent: it is derived from the session keys, as for regular data messages.
+	 *
+	 * The header byte always has its most significant bit set, so that it can't be mistaken for the protocol version of a generic message.
+	 *
+	 * Those messages are only sent to hosts that advertised PROTOCOL_CAPABILITY_COMPACT_DATA.
+	 */
+	class compact_data_message
+	{
+		public:
+
+			/**
+			 * \brief The cipher algorithm type.
+			 */
+			typedef cryptoplus::cipher::cipher_algorithm calg_t;
+
+			/**
+			 * \brief Check if a buffer contains a compact data message.
+			 * \param buf The buffer.
+			 * \param buf_len The buffer length.
+			 * \return true if the buffer starts with a compact data message header.
+			 */
+			static bool is_compact_data_message(const void* buf, size_t buf_len);
+
+			/**
+			 * \brief Get the size of a compact data message, without its ciphertext.
+			 * \return The count of bytes a compact data message adds to its cleartext.
+			 */
+			static size_t overhead();
+
+			/**
+			 * \brief Write a compact data message to a buffer.
+			 * \param buf The buffer to write to.
+			 * \param buf_len The length of buf.
+			 * \param type The message type. Must be a DATA, CONTACT_REQUEST, CONTACT, KEEP_ALIVE, AGGREGATED_DATA, PATH_MTU_PROBE or PATH_MTU_REPLY message type.
+			 * \param framing The compact framing to use. Cannot be DATA_FRAMING_STANDARD.
+			 * \param sequence_number The sequence number.
+			 * \param cipher_algorithm The cipher algorithm to use.
+			 * \param cleartext The cleartext data.
+			 * \param cleartext_len The data length.
+			 * \param enc_key The encryption key.
+			 * \param enc_key_len The encryption key length.
+			 * \param nonce_prefix The nonce prefix.
+			 * \param nonce_prefix_len The nonce prefix length.
+			 * \return The count of bytes written.
+			 */
+			static size_t write(void* buf, size_t buf_len, message_type type, data_framing_type framing, sequence_number_type sequence_number, calg_t cipher_algorithm, const void* cleartext, size_t cleartext_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len);
+
+			/**
+			 * \brief Create a compact_data_message and map it on a buffer.
+			 * \param buf The buffer.
+			 * \param buf_len The buffer length.
+			 *
+			 * If the mapping fails, a std::runtime_error is thrown.
+			 */
+			compact_data_message(const void* buf, size_t buf_len);
+
+			/**
+			 * \brief Get the type.
+			 * \return The type.
+			 */
+			message_type type() const;
+
+			/**
+			 * \brief Get the framing.
+			 * \return The framing, which identifies the session keys the message was sent with.
+			 */
+			data_framing_type framing() const;
+
+			/**
+			 * \brief Get the sequence number.
+			 * \return The sequence number.
+			 */
+			sequence_number_type sequence_number() const;
+
+			/**
+			 * \brief Get the ciphertext.
+			 * \return The ciphertext.
+			 */
+			const uint8_t* ciphertext() const;
+
+			/**
+			 * \brief Get the ciphertext size.
+			 * \return The ciphertext size.
+			 */
+			size_t ciphertext_size() const;
+
+			/**
+			 * \brief Get the tag.
+			 * \return The tag.
+			 */
+			const uint8_t* tag() const;
+
+			/**
+			 * \brief Get the tag size.
+			 * \return The tag size.
+			 */
+			size_t tag_size() const;
+
+			/**
+			 * \brief Get the clear text data, using a given encryption key.
+			 * \param buf The buffer that must receive the data. If buf is NULL, the function returns the expected size of buf.
+			 * \param buf_len The length of buf.
+			 * \param cipher_algorithm The cipher algorithm to use.
+			 * \param enc_key The encryption key.
+			 * \param enc_key_len The encryption key length.
+			 * \param nonce_prefix The nonce prefix.
+			 * \param nonce_prefix_len The nonce prefix length.
+			 * \return The count of bytes deciphered.
+			 */
+			size_t get_cleartext(void* buf, size_t buf_len, calg_t cipher_algorithm, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len) const;
+
+		protected:
+
+			/**
+			 * \brief The length of the header.
+			 */
+			static const size_t HEADER_LENGTH = 1;
+
+			/**
+			 * \brief The flag that identifies a compact data message.
+			 */
+			static const uint8_t COMPACT_FLAG = 0x80;
+
+			/**
+			 * \brief The flag that is set for sessions with an odd number.
+			 */
+			static const uint8_t ODD_KEY_FLAG = 0x40;
+
+			/**
+			 * \brief The mask of the message type code.
+			 */
+			static const uint8_t TYPE_CODE_MASK = 0x3F;
+
+			/**
+			 * \brief The min length of a message.
+			 */
+			static const size_t MIN_LENGTH = HEADER_LENGTH + sizeof(sequence_number_type) + GCM_TAG_LENGTH;
+
+		private:
+
+			const uint8_t* m_data;
+			size_t m_size;
+	};
+
+	inline size_t compact_data_message::overhead()
+	{
+		return MIN_LENGTH;
+	}
+
+	inline bool compact_data_message::is_compact_data_message(const void* buf, size_t buf_len)
+	{
+		return (buf_len >= HEADER_LENGTH) && ((buffer_tools::get<uint8_t>(buf, 0) & COMPACT_FLAG) != 0);
+	}
+
+	inline data_framing_type compact_data_message::framing() const
+	{
+		return (m_data[0] & ODD_KEY_FLAG) ? DATA_FRAMING_COMPACT_ODD_KEY : DATA_FRAMING_COMPACT_EVEN_KEY;
+	}
+
+	inline sequence_number_type compact_data_message::sequence_number() const
+	{
+		return ntohl(buffer_tools::get<sequence_number_type>(m_data, HEADER_LENGTH));
+	}
+
+	inline const uint8_t* compact_data_message::ciphertext() const
+	{
+		return m_data + HEADER_LENGTH + sizeof(sequence_number_type);
+	}
+
+	inline size_t compact_data_message::ciphertext_size() const
+	{
+		return m_size - MIN_LENGTH;
+	}
+
+	inline const uint8_t* compact_data_message::tag() const
+	{
+		return m_data + m_size - tag_size();
+	}
+
+	inline size_t compact_data_message::tag_size() const
+	{
+		return GCM_TAG_LENGTH;
+	}
+}
+
+#endif /* FSCP_COMPACT_DATA_MESSAGE_HPP */
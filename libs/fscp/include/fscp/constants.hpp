@@ -214,6 +214,48 @@ namespace fscp
 	 */
 	const size_t DEFAULT_NONCE_PREFIX_SIZE = 8;
 
+	/**
+	 * \brief The protocol capabilities type.
+	 *
+	 * A bitmask of the optional protocol extensions a host supports, advertised in the signed header of its SESSION messages.
+	 */
+	typedef uint16_t protocol_capabilities_type;
+
+	/**
+	 * \brief The host understands compact DATA messages.
+	 */
+	const protocol_capabilities_type PROTOCOL_CAPABILITY_COMPACT_DATA = 0x0001;
+
+	/**
+	 * \brief The host understands AGGREGATED_DATA messages.
+	 */
+	const protocol_capabilities_type PROTOCOL_CAPABILITY_AGGREGATED_DATA = 0x0002;
+
+	/**
+	 * \brief The host answers PATH_MTU_PROBE messages.
+	 */
+	const protocol_capabilities_type PROTOCOL_CAPABILITY_PATH_MTU_PROBE = 0x0004;
+
+	/**
+	 * \brief The host reassembles FRAGMENT messages.
+	 */
+	const protocol_capabilities_type PROTOCOL_CAPABILITY_FRAGMENT = 0x0008;
+
+	/**
+	 * \brief The host keeps the previous session keys while a renewal settles and confirms the new session with a KEEP_ALIVE message.
+	 */
+	const protocol_capabilities_type PROTOCOL_CAPABILITY_SESSION_CONFIRMATION = 0x0010;
+
+	/**
+	 * \brief The different DATA message framings.
+	 */
+	enum data_framing_type
+	{
+		DATA_FRAMING_STANDARD, /**< The generic message header, followed by the sequence number, the tag, the ciphertext length and the ciphertext. */
+		DATA_FRAMING_COMPACT_EVEN_KEY, /**< A one byte header, the sequence number, the ciphertext and the tag, for a session with an even number. */
+		DATA_FRAMING_COMPACT_ODD_KEY /**< A one byte header, the sequence number, the ciphertext and the tag, for a session with an odd number. */
+	};
+
 	/**
 	 * \brief The different message types.
 	 */
@@ -240,6 +282,10 @@ namespace fscp
 		MESSAGE_TYPE_DATA_13 = 0x7D,
 		MESSAGE_TYPE_DATA_14 = 0x7E,
 		MESSAGE_TYPE_DATA_15 = 0x7F,
+		MESSAGE_TYPE_FRAGMENT = 0xF9,
+		MESSAGE_TYPE_PATH_MTU_PROBE = 0xFA,
+		MESSAGE_TYPE_PATH_MTU_REPLY = 0xFB,
+		MESSAGE_TYPE_AGGREGATED_DATA = 0xFC,
 		MESSAGE_TYPE_CONTACT_REQUEST = 0xFD,
 		MESSAGE_TYPE_CONTACT = 0xFE,
 		MESSAGE_TYPE_KEEP_ALIVE = 0xFF
@@ -268,6 +314,20 @@ namespace fscp
 		CHANNEL_NUMBER_15 = 15
 	};
 
+	/**
+	 * \brief An aggregated frame list type.
+	 *
+	 * Each item is the channel number of a frame and the frame itself.
+	 */
+	typedef std::vector<std::pair<channel_number_type, boost::asio::const_buffer> > aggregated_frame_list_type;
+
+	/**
+	 * \brief The length of the header of a frame in an AGGREGATED_DATA message.
+	 *
+	 * The header is made of the channel number (8 bits) and the frame length (16 bits).
+	 */
+	const size_t AGGREGATED_FRAME_HEADER_LENGTH = sizeof(uint8_t) + sizeof(uint16_t);
+
 	/**
 	 * \brief The endpoint type type.
 	 */
@@ -551,20 +611,112 @@ namespace fscp
 	cryptoplus::hash::message_digest_algorithm get_default_digest_algorithm();
 
 	/**
-	 * \brief The session keep-alive period.
+	 * \brief The default session keep-alive period.
 	 */
 	const boost::posix_time::time_duration SESSION_KEEP_ALIVE_PERIOD = boost::posix_time::seconds(10);
 
 	/**
-	 * \brief The session timeout.
+	 * \brief The default session timeout.
 	 */
 	const boost::posix_time::time_duration SESSION_TIMEOUT = SESSION_KEEP_ALIVE_PERIOD * 3;
 
+	/**
+	 * \brief The default maximum cleartext size of an AGGREGATED_DATA message.
+	 *
+	 * The resulting datagram fits in a 1500 bytes MTU, over IPv4 or IPv6.
+	 */
+	const size_t DEFAULT_MAX_AGGREGATED_DATA_SIZE = 1400;
+
+	/**
+	 * \brief The default maximum count of peer sessions.
+	 */
+	const size_t DEFAULT_MAX_PEER_SESSION_COUNT = 4096;
+
+	/**
+	 * \brief The default sequence number after which a session is renewed.
+	 *
+	 * The renewal starts early enough to complete long before the sequence numbers get exhausted.
+	 */
+	const sequence_number_type SESSION_REKEY_THRESHOLD = 0x40000000;
+
+	/**
+	 * \brief The time after which a session renewal that didn't complete is started again.
+	 */
+	const boost::posix_time::time_duration SESSION_REKEY_RETRY_PERIOD = boost::posix_time::seconds(5);
+
+	/**
+	 * \brief The smallest path MTU considered for IPv4 hosts.
+	 *
+	 * Every IPv4 host must accept datagrams of that size, so it is assumed to work without being probed.
+	 */
+	const size_t MIN_IPV4_PATH_MTU = 576;
+
+	/**
+	 * \brief The smallest path MTU considered for IPv6 hosts.
+	 *
+	 * Every IPv6 link must carry packets of that size, so it is assumed to work without being probed.
+	 */
+	const size_t MIN_IPV6_PATH_MTU = 1280;
+
+	/**
+	 * \brief The largest path MTU considered.
+	 */
+	const size_t MAX_PATH_MTU = 1500;
+
+	/**
+	 * \brief The path MTU discovery stops once the path MTU is known within that many bytes.
+	 */
+	const size_t PATH_MTU_PRECISION = 8;
+
+	/**
+	 * \brief The time after which an unanswered PATH_MTU_PROBE message is considered lost.
+	 */
+	const boost::posix_time::time_duration PATH_MTU_PROBE_TIMEOUT = boost::posix_time::seconds(1);
+
+	/**
+	 * \brief The count of lost PATH_MTU_PROBE messages after which a size is considered too large for the path.
+	 */
+	const unsigned int PATH_MTU_PROBE_ATTEMPTS = 2;
+
+	/**
+	 * \brief The period after which the path MTU of a peer is discovered again.
+	 */
+	const boost::posix_time::time_duration PATH_MTU_REVALIDATION_PERIOD = boost::posix_time::minutes(10);
+
+	/**
+	 * \brief The maximum count of bytes of partially received datagrams kept for a host.
+	 */
+	const size_t MAX_REASSEMBLY_BUFFER_SIZE = 256 * 1024;
+
+	/**
+	 * \brief The maximum count of fragments a datagram can be split into.
+	 *
+	 * A 65535 bytes datagram fits in 128 fragments over any IPv4 path.
+	 */
+	const size_t MAX_FRAGMENT_COUNT = 128;
+
+	/**
+	 * \brief The time after which a partially received datagram is dropped.
+	 */
+	const boost::posix_time::time_duration FRAGMENT_REASSEMBLY_TIMEOUT = boost::posix_time::seconds(2);
+
 	/**
 	 * \brief The keep-alive data size.
 	 */
 	const size_t SESSION_KEEP_ALIVE_DATA_SIZE = 32;
 
+	/**
+	 * \brief The resolution of the session and HELLO timers.
+	 */
+	const boost::posix_time::time_duration TIMER_WHEEL_RESOLUTION = boost::posix_time::milliseconds(100);
+
+	/**
+	 * \brief The count of slots of the timer wheel.
+	 *
+	 * A revolution of the wheel lasts longer than the default session keep-alive period, so that most timers fire on their first pass.
+	 */
+	const size_t TIMER_WHEEL_SLOT_COUNT = 128;
+
 	/**
 	 * \brief Check if a message type is a DATA type message.
 	 * \param type The message type.
@@ -575,6 +727,16 @@ namespace fscp
 		return (type >= MESSAGE_TYPE_DATA_0) && (type <= MESSAGE_TYPE_DATA_15);
 	}
 
+	/**
+	 * \brief Get the compact DATA framing for a session.
+	 * \param session_number The session number.
+	 * \return The compact DATA framing that identifies the session keys.
+	 */
+	inline data_framing_type to_compact_data_framing(session_number_type session_number)
+	{
+		return (session_number & 0x01) ? DATA_FRAMING_COMPACT_ODD_KEY : DATA_FRAMING_COMPACT_EVEN_KEY;
+	}
+
 	/**
 	 * \brief Convert a DATA message type to a channel number.
 	 * \param type The message type. Must be one from MESSAGE_TYPE_DATA_0 to MESSAGE_TYPE_DATA_15.
@@ -78,9 +78,10 @@ namespace fscp
 			 * \param enc_key_len The encryption key length.
 			 * \param nonce_prefix The nonce prefix.
 			 * \param nonce_prefix_len The nonce prefix length.
+			 * \param framing The framing to use.
 			 * \return The count of bytes written.
 			 */
-			static size_t write(void* buf, size_t buf_len, channel_number_type channel_number, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const void* cleartext, size_t cleartext_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len);
+			static size_t write(void* buf, size_t buf_len, channel_number_type channel_number, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const void* cleartext, size_t cleartext_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, data_framing_type framing = DATA_FRAMING_STANDARD);
 
 			/**
 			 * \brief Write a contact-request message to a buffer.
@@ -93,9 +94,10 @@ namespace fscp
 			 * \param enc_key_len The encryption key length.
 			 * \param nonce_prefix The nonce prefix.
 			 * \param nonce_prefix_len The nonce prefix length.
+			 * \param framing The framing to use.
 			 * \return The count of bytes written.
 			 */
-			static size_t write_contact_request(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const hash_list_type& hash_list, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len);
+			static size_t write_contact_request(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const hash_list_type& hash_list, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, data_framing_type framing = DATA_FRAMING_STANDARD);
 
 			/**
 			 * \brief Write a contact message to a buffer.
@@ -108,9 +110,38 @@ namespace fscp
 			 * \param enc_key_len The encryption key length.
 			 * \param nonce_prefix The nonce prefix.
 			 * \param nonce_prefix_len The nonce prefix length.
+			 * \param framing The framing to use.
 			 * \return The count of bytes written.
 			 */
-			static size_t write_contact(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const contact_map_type& contact_map, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len);
+			static size_t write_contact(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const contact_map_type& contact_map, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, data_framing_type framing = DATA_FRAMING_STANDARD);
+
+			/**
+			 * \brief Write an aggregated data message to a buffer.
+			 * \param buf The buffer to write to.
+			 * \param buf_len The length of buf.
+			 * \param sequence_number The sequence number.
+			 * \param cipher_algorithm The cipher algorithm to use.
+			 * \param frames The frames, as written by write_aggregated_frame().
+			 * \param frames_len The frames length.
+			 * \param enc_key The encryption key.
+			 * \param enc_key_len The encryption key length.
+			 * \param nonce_prefix The nonce prefix.
+			 * \param nonce_prefix_len The nonce prefix length.
+			 * \param framing The framing to use.
+			 * \return The count of bytes written.
+			 */
+			static size_t write_aggregated_data(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const void* frames, size_t frames_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, data_framing_type framing = DATA_FRAMING_STANDARD);
+
+			/**
+			 * \brief Write a frame to be aggregated to a buffer.
+			 * \param buf The buffer to write to.
+			 * \param buf_len The length of buf. Must be at least AGGREGATED_FRAME_HEADER_LENGTH + data_len.
+			 * \param channel_number The channel number.
+			 * \param data The frame data.
+			 * \param data_len The frame data length. Must fit on 16 bits.
+			 * \return The count of bytes written.
+			 */
+			static size_t write_aggregated_frame(void* buf, size_t buf_len, channel_number_type channel_number, const void* data, size_t data_len);
 
 			/**
 			 * \brief Write a keep-alive message to a buffer.
@@ -123,9 +154,50 @@ namespace fscp
 			 * \param enc_key_len The encryption key length.
 			 * \param nonce_prefix The nonce prefix.
 			 * \param nonce_prefix_len The nonce prefix length.
+			 * \param framing The framing to use.
 			 * \return The count of bytes written.
 			 */
-			static size_t write_keep_alive(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, size_t random_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len);
+			static size_t write_keep_alive(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, size_t random_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, data_framing_type framing = DATA_FRAMING_STANDARD);
+
+			/**
+			 * \brief Write a path MTU probe message to a buffer.
+			 * \param buf The buffer to write to.
+			 * \param buf_len The length of buf.
+			 * \param sequence_number The sequence number.
+			 * \param cipher_algorithm The cipher algorithm to use.
+			 * \param path_mtu The path MTU being probed for, that the peer echoes back.
+			 * \param message_len The total length of the message. The message is padded to reach it. Must be at least overhead(framing) + PATH_MTU_FIELD_LENGTH.
+			 * \param enc_key The encryption key.
+			 * \param enc_key_len The encryption key length.
+			 * \param nonce_prefix The nonce prefix.
+			 * \param nonce_prefix_len The nonce prefix length.
+			 * \param framing The framing to use.
+			 * \return The count of bytes written, which is message_len.
+			 */
+			static size_t write_path_mtu_probe(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, size_t path_mtu, size_t message_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, data_framing_type framing = DATA_FRAMING_STANDARD);
+
+			/**
+			 * \brief Write a path MTU reply message to a buffer.
+			 * \param buf The buffer to write to.
+			 * \param buf_len The length of buf.
+			 * \param sequence_number The sequence number.
+			 * \param cipher_algorithm The cipher algorithm to use.
+			 * \param path_mtu The path MTU of the probe being answered.
+			 * \param enc_key The encryption key.
+			 * \param enc_key_len The encryption key length.
+			 * \param nonce_prefix The nonce prefix.
+			 * \param nonce_prefix_len The nonce prefix length.
+			 * \param framing The framing to use.
+			 * \return The count of bytes written.
+			 */
+			static size_t write_path_mtu_reply(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, size_t path_mtu, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, data_framing_type framing = DATA_FRAMING_STANDARD);
+
+			/**
+			 * \brief Get the size of a data message, without its ciphertext.
+			 * \param framing The framing.
+			 * \return The count of bytes a data message written with the specified framing adds to its cleartext.
+			 */
+			static size_t overhead(data_framing_type framing);
 
 			/**
 			 * \brief Parse the hash list.
@@ -143,6 +215,27 @@ namespace fscp
 			 */
 			static contact_map_type parse_contact_map(const void* buf, size_t buflen);
 
+			/**
+			 * \brief Parse the aggregated frames.
+			 * \param buf The buffer to parse.
+			 * \param buflen The length of the buffer to parse.
+			 * \return The frames, which point into buf.
+			 */
+			static aggregated_frame_list_type parse_aggregated_frames(const void* buf, size_t buflen);
+
+			/**
+			 * \brief Parse the path MTU of a PATH_MTU_PROBE or PATH_MTU_REPLY message.
+			 * \param buf The buffer to parse.
+			 * \param buflen The length of the buffer to parse.
+			 * \return The path MTU.
+			 */
+			static size_t parse_path_mtu(const void* buf, size_t buflen);
+
+			/**
+			 * \brief The length of the path MTU field of PATH_MTU_PROBE and PATH_MTU_REPLY messages.
+			 */
+			static const size_t PATH_MTU_FIELD_LENGTH = sizeof(uint16_t);
+
 			/**
 			 * \brief Create a data_message and map it on a buffer.
 			 * \param buf The buffer.
@@ -221,9 +314,10 @@ namespace fscp
 			 * \param nonce_prefix The nonce prefix.
 			 * \param nonce_prefix_len The nonce prefix length.
 			 * \param type The message type.
+			 * \param framing The framing to use.
 			 * \return The count of bytes written.
 			 */
-			static size_t raw_write(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const void* cleartext, size_t cleartext_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, message_type type);
+			static size_t raw_write(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const void* cleartext, size_t cleartext_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, message_type type, data_framing_type framing);
 
 		private:
 
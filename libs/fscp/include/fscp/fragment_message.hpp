@@ -0,0 +1,173 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file fragment_message.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A fragment message class.
+ */
+
+#ifndef FSCP_FRAGMENT_MESSAGE_HPP
+#define FSCP_FRAGMENT_MESSAGE_HPP
+
+#include "message.hpp"
+
+namespace fscp
+{
+	/**
+	 * \brief A fragment message class.
+	 *
+	 * A fragment message carries a slice of a datagram that is too large for the path to the remote host. The datagram is split once it is written, ciphered and authenticated: the fragments themselves are not.
+	 */
+	class fragment_message : public message
+	{
+		public:
+
+			/**
+			 * \brief The datagram identifier type.
+			 */
+			typedef uint32_t datagram_id_type;
+
+			/**
+			 * \brief Write a fragment message to a buffer.
+			 * \param buf The buffer to write to.
+			 * \param buf_len The length of buf.
+			 * \param datagram_id The identifier of the datagram the fragment belongs to.
+			 * \param offset The offset of the fragment within the datagram.
+			 * \param total_length The length of the whole datagram. Must fit on 16 bits.
+			 * \param data The fragment data.
+			 * \param data_len The fragment data length. Cannot be zero.
+			 * \return The count of bytes written.
+			 */
+			static size_t write(void* buf, size_t buf_len, datagram_id_type datagram_id, size_t offset, size_t total_length, const void* data, size_t data_len);
+
+			/**
+			 * \brief Get the size of a fragment message, without its data.
+			 * \return The count of bytes a fragment message adds to its data.
+			 */
+			static size_t overhead();
+
+			/**
+			 * \brief Create a fragment_message and map it on a buffer.
+			 * \param buf The buffer.
+			 * \param buf_len The buffer length.
+			 *
+			 * If the mapping fails, a std::runtime_error is thrown.
+			 */
+			fragment_message(const void* buf, size_t buf_len);
+
+			/**
+			 * \brief Create a fragment_message from a message.
+			 * \param message The message.
+			 */
+			fragment_message(const message& message);
+
+			/**
+			 * \brief Get the datagram identifier.
+			 * \return The identifier of the datagram the fragment belongs to.
+			 */
+			datagram_id_type datagram_id() const;
+
+			/**
+			 * \brief Get the offset.
+			 * \return The offset of the fragment within the datagram.
+			 */
+			size_t offset() const;
+
+			/**
+			 * \brief Get the total length.
+			 * \return The length of the whole datagram.
+			 */
+			size_t total_length() const;
+
+			/**
+			 * \brief Get the fragment data.
+			 * \return The fragment data.
+			 */
+			const uint8_t* data() const;
+
+			/**
+			 * \brief Get the fragment data size.
+			 * \return The fragment data size.
+			 */
+			size_t data_size() const;
+
+		protected:
+
+			/**
+			 * \brief The min length of the body.
+			 */
+			static const size_t MIN_BODY_LENGTH = sizeof(datagram_id_type) + sizeof(uint16_t) + sizeof(uint16_t);
+
+		private:
+
+			void check_format() const;
+	};
+
+	inline size_t fragment_message::overhead()
+	{
+		return HEADER_LENGTH + MIN_BODY_LENGTH;
+	}
+
+	inline fragment_message::datagram_id_type fragment_message::datagram_id() const
+	{
+		return ntohl(buffer_tools::get<datagram_id_type>(payload(), 0));
+	}
+
+	inline size_t fragment_message::offset() const
+	{
+		return ntohs(buffer_tools::get<uint16_t>(payload(), sizeof(datagram_id_type)));
+	}
+
+	inline size_t fragment_message::total_length() const
+	{
+		return ntohs(buffer_tools::get<uint16_t>(payload(), sizeof(datagram_id_type) + sizeof(uint16_t)));
+	}
+
+	inline const uint8_t* fragment_message::data() const
+	{
+		return payload() + MIN_BODY_LENGTH;
+	}
+
+	inline size_t fragment_message::data_size() const
+	{
+		return length() - MIN_BODY_LENGTH;
+	}
+}
+
+#endif /* FSCP_FRAGMENT_MESSAGE_HPP */
@@ -0,0 +1,86 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file monotonic_clock.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A coarse monotonic clock.
+ */
+
+#ifndef FSCP_MONOTONIC_CLOCK_HPP
+#define FSCP_MONOTONIC_CLOCK_HPP
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <stdint.h>
+
+namespace fscp
+{
+	/**
+	 * \brief A coarse monotonic clock.
+	 *
+	 * Reading the clock is much cheaper than getting the local time and it is not affected by changes of the system time or of the time zone. Its resolution is a few milliseconds, which is plenty for session liveness tracking.
+	 */
+	class monotonic_clock
+	{
+		public:
+
+			/**
+			 * \brief The tick type, in milliseconds.
+			 */
+			typedef uint64_t tick_type;
+
+			/**
+			 * \brief Get the current tick.
+			 * \return The count of milliseconds elapsed since an unspecified point in time.
+			 */
+			static tick_type now();
+
+			/**
+			 * \brief Convert a duration into ticks.
+			 * \param duration The duration. Negative durations are converted to zero.
+			 * \return The count of ticks.
+			 */
+			static tick_type to_ticks(const boost::posix_time::time_duration& duration)
+			{
+				return duration.is_negative() ? 0 : static_cast<tick_type>(duration.total_milliseconds());
+			}
+	};
+}
+
+#endif /* FSCP_MONOTONIC_CLOCK_HPP */
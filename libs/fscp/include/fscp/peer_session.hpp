@@ -46,6 +46,8 @@
 #define FSCP_PEER_SESSION_HPP
 
 #include "constants.hpp"
+#include "monotonic_clock.hpp"
+#include "reassembly_buffer.hpp"
 
 #include <cryptoplus/buffer.hpp>
 #include <cryptoplus/random/random.hpp>
@@ -98,7 +100,7 @@ namespace fscp
 					remote_sequence_number()
 				{}
 
-				bool is_old() const;
+				bool is_old(sequence_number_type threshold) const;
 
 				session_parameters parameters;
 				sequence_number_type local_sequence_number;
@@ -112,7 +114,22 @@ namespace fscp
 			peer_session() :
 				m_local_host_identifier(),
 				m_remote_host_identifier(),
-				m_last_sign_of_life(boost::posix_time::microsec_clock::local_time())
+				m_remote_capabilities(0),
+				m_last_sign_of_life(monotonic_clock::now()),
+				m_has_outbound_activity(false),
+				m_rekey_pending(false),
+				m_rekey_start(),
+				m_previous_session_start(),
+				m_send_with_previous_session(false),
+				m_path_mtu(0),
+				m_path_mtu_low(0),
+				m_path_mtu_high(0),
+				m_path_mtu_precision(0),
+				m_path_mtu_probe_size(0),
+				m_path_mtu_probe_attempts(0),
+				m_path_mtu_probe_number(0),
+				m_next_datagram_id(0),
+				m_reassembly_buffer(MAX_REASSEMBLY_BUFFER_SIZE, MAX_FRAGMENT_COUNT, monotonic_clock::to_ticks(FRAGMENT_REASSEMBLY_TIMEOUT))
 			{
 				// Generate a random host identifier.
 				cryptoplus::random::get_random_bytes(m_local_host_identifier.data.data(), m_local_host_identifier.data.size());
@@ -142,6 +159,19 @@ namespace fscp
 			 */
 			boost::optional<host_identifier_type> remote_host_identifier() const { return m_remote_host_identifier; }
 
+			/**
+			 * \brief Set the protocol capabilities of the remote host.
+			 * \param capabilities The protocol capabilities, as advertised in the SESSION message that established the current session.
+			 */
+			void set_remote_capabilities(protocol_capabilities_type capabilities) { m_remote_capabilities = capabilities; }
+
+			/**
+			 * \brief Check whether the remote host supports a protocol extension.
+			 * \param capability The protocol capability.
+			 * \return true if the remote host advertised capability.
+			 */
+			bool has_remote_capability(protocol_capabilities_type capability) const { return (m_remote_capabilities & capability) == capability; }
+
 			/**
 			 * \brief Check if the session has timed out.
 			 * \param timeout The timeout value.
@@ -149,7 +179,7 @@ namespace fscp
 			 */
 			bool has_timed_out(const boost::posix_time::time_duration& timeout) const
 			{
-				return (boost::posix_time::microsec_clock::local_time() > m_last_sign_of_life + timeout);
+				return (monotonic_clock::now() > m_last_sign_of_life + monotonic_clock::to_ticks(timeout));
 			}
 
 			/**
@@ -157,7 +187,7 @@ namespace fscp
 			 */
 			void keep_alive()
 			{
-				m_last_sign_of_life = boost::posix_time::microsec_clock::local_time();
+				m_last_sign_of_life = monotonic_clock::now();
 			}
 
 			/**
@@ -169,11 +199,26 @@ namespace fscp
 			 */
 			bool prepare_session(session_number_type _session_number, cipher_suite_type _cipher_suite, elliptic_curve_type _elliptic_curve);
 
+			/**
+			 * \brief Prepare the next session with a session that was computed beforehand.
+			 * \param _next_session The next session.
+			 * \return true if _next_session is the session in preparation. If another session is already in preparation, it is kept and false is returned.
+			 */
+			bool prepare_session(boost::shared_ptr<next_session_type> _next_session);
+
+			/**
+			 * \brief Get the session in preparation.
+			 * \return The session in preparation, if any.
+			 */
+			boost::shared_ptr<next_session_type> next_session() const { return m_next_session; }
+
 			/**
 			 * \brief Complete the next session.
 			 * \param remote_public_key The remote public key.
 			 * \param remote_public_key_size The remote public key size.
 			 * \return true if the session was completed.
+			 *
+			 * The replaced session, if any, becomes the previous session: it is still used to send messages until confirm_current_session() is called, and to receive messages until clear_previous_session() is called.
 			 */
 			bool complete_session(const void* remote_public_key, size_t remote_public_key_size);
 
@@ -208,10 +253,59 @@ namespace fscp
 			const current_session_type& current_session() const { return *m_current_session; }
 
 			/**
-			 * \brief Increment the local sequence number.
+			 * \brief Check if the previous session is still kept.
+			 * \return true if the previous session is still kept.
+			 */
+			bool has_previous_session() const { return static_cast<bool>(m_previous_session); }
+
+			/**
+			 * \brief Get the previous session.
+			 * \return The previous session, if there is one. If there is no previous session, the behavior is undefined.
+			 */
+			const current_session_type& previous_session() const { return *m_previous_session; }
+
+			/**
+			 * \brief Get the session to send messages with.
+			 * \return The previous session until the current session is confirmed, the current session afterwards. If there is no current session, the behavior is undefined.
+			 */
+			const current_session_type& sending_session() const { return m_send_with_previous_session ? *m_previous_session : *m_current_session; }
+
+			/**
+			 * \brief Confirm that the remote host has the current session keys.
+			 *
+			 * Messages are sent with the current session from now on.
+			 */
+			void confirm_current_session() { m_send_with_previous_session = false; }
+
+			/**
+			 * \brief Clear the previous session if it was replaced long enough ago.
+			 * \param grace_period The time during which the previous session is kept.
+			 * \return true if there was a previous session and it was cleared.
+			 */
+			bool clear_previous_session(monotonic_clock::tick_type grace_period);
+
+			/**
+			 * \brief Increment the local sequence number of the sending session.
 			 * \return Return the current sequence number and increment it afterwards.
 			 */
-			sequence_number_type increment_local_sequence_number() { return ++m_current_session->local_sequence_number; }
+			sequence_number_type increment_local_sequence_number()
+			{
+				// Every message we send to the peer goes through here.
+				m_has_outbound_activity = true;
+
+				return m_send_with_previous_session ? ++m_previous_session->local_sequence_number : ++m_current_session->local_sequence_number;
+			}
+
+			/**
+			 * \brief Check whether a message was sent to the peer since the last call to clear_outbound_activity().
+			 * \return true if a message was sent.
+			 */
+			bool has_outbound_activity() const { return m_has_outbound_activity; }
+
+			/**
+			 * \brief Clear the outbound activity flag.
+			 */
+			void clear_outbound_activity() { m_has_outbound_activity = false; }
 
 			/**
 			 * \brief Set the remote sequence number.
@@ -220,21 +314,134 @@ namespace fscp
 			 */
 			bool set_remote_sequence_number(sequence_number_type sequence_number);
 
+			/**
+			 * \brief Set the remote sequence number of the previous session.
+			 * \param sequence_number The remote sequence number.
+			 * \return true if the sequence number was incremented with the new value, false is the current sequence number is greater than sequence_number.
+			 */
+			bool set_previous_remote_sequence_number(sequence_number_type sequence_number);
+
 			/**
 			 * \brief Clear the current session.
 			 * \return True if the session was cleared. False is there was no active session.
 			 */
 			bool clear();
 
+			/**
+			 * \brief Mark the beginning of a session renewal.
+			 * \param retry_period The time after which a renewal that didn't complete can be started again.
+			 * \return true if a renewal should be started, false if one is already in progress.
+			 *
+			 * The renewal ends when the next session is completed.
+			 */
+			bool start_rekey(monotonic_clock::tick_type retry_period);
+
+			/**
+			 * \brief Get the path MTU.
+			 * \return The path MTU, or 0 if it was not discovered yet.
+			 */
+			size_t path_mtu() const { return m_path_mtu; }
+
+			/**
+			 * \brief Check whether a path MTU discovery is in progress.
+			 * \return true if a path MTU discovery is in progress.
+			 */
+			bool is_discovering_path_mtu() const { return m_path_mtu_probe_size != 0; }
+
+			/**
+			 * \brief Start a path MTU discovery.
+			 * \param min_mtu The path MTU that is assumed to work.
+			 * \param max_mtu The largest path MTU to probe for.
+			 * \param precision The discovery completes once the path MTU is known within that many bytes.
+			 *
+			 * The current path MTU, if any, is kept until the discovery completes.
+			 */
+			void start_path_mtu_discovery(size_t min_mtu, size_t max_mtu, size_t precision);
+
+			/**
+			 * \brief Stop the path MTU discovery in progress, if any.
+			 */
+			void stop_path_mtu_discovery() { m_path_mtu_probe_size = 0; }
+
+			/**
+			 * \brief Get the path MTU to probe for next.
+			 * \return The path MTU to probe for, or 0 if no path MTU discovery is in progress.
+			 */
+			size_t path_mtu_probe_size() const { return m_path_mtu_probe_size; }
+
+			/**
+			 * \brief Mark that a probe for path_mtu_probe_size() was sent.
+			 * \return The number of the probe.
+			 */
+			unsigned int path_mtu_probe_sent()
+			{
+				++m_path_mtu_probe_attempts;
+
+				return ++m_path_mtu_probe_number;
+			}
+
+			/**
+			 * \brief Check whether a probe is the last one that was sent.
+			 * \param probe_number The number of the probe, as returned by path_mtu_probe_sent().
+			 * \return true if a path MTU discovery is in progress and no other probe was sent since that one.
+			 */
+			bool is_last_path_mtu_probe(unsigned int probe_number) const { return is_discovering_path_mtu() && (probe_number == m_path_mtu_probe_number); }
+
+			/**
+			 * \brief Handle the reply to a probe.
+			 * \param mtu The path MTU the probe was sent for.
+			 * \return true if the path MTU discovery completed.
+			 */
+			bool path_mtu_probe_replied(size_t mtu);
+
+			/**
+			 * \brief Handle the loss of the last probe.
+			 * \param max_attempts The count of lost probes after which the probed size is considered too large for the path.
+			 * \return true if the path MTU discovery completed.
+			 */
+			bool path_mtu_probe_lost(unsigned int max_attempts);
+
+			/**
+			 * \brief Get a new datagram identifier, to fragment a datagram with.
+			 * \return The datagram identifier.
+			 */
+			reassembly_buffer::datagram_id_type next_datagram_id() { return m_next_datagram_id++; }
+
+			/**
+			 * \brief Get the reassembly buffer for the fragments the remote host sends.
+			 * \return The reassembly buffer.
+			 */
+			reassembly_buffer& reassembly() { return m_reassembly_buffer; }
+
 		private:
 
+			bool next_path_mtu_probe();
+
 			host_identifier_type m_local_host_identifier;
 			boost::optional<host_identifier_type> m_remote_host_identifier;
+			protocol_capabilities_type m_remote_capabilities;
 
-			boost::posix_time::ptime m_last_sign_of_life;
+			monotonic_clock::tick_type m_last_sign_of_life;
+			bool m_has_outbound_activity;
+			bool m_rekey_pending;
+			monotonic_clock::tick_type m_rekey_start;
 
 			boost::shared_ptr<next_session_type> m_next_session;
 			boost::shared_ptr<current_session_type> m_current_session;
+			boost::shared_ptr<current_session_type> m_previous_session;
+			monotonic_clock::tick_type m_previous_session_start;
+			bool m_send_with_previous_session;
+
+			size_t m_path_mtu;
+			size_t m_path_mtu_low;
+			size_t m_path_mtu_high;
+			size_t m_path_mtu_precision;
+			size_t m_path_mtu_probe_size;
+			unsigned int m_path_mtu_probe_attempts;
+			unsigned int m_path_mtu_probe_number;
+
+			reassembly_buffer::datagram_id_type m_next_datagram_id;
+			reassembly_buffer m_reassembly_buffer;
 	};
 }
 
@@ -0,0 +1,153 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file reassembly_buffer.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A reassembly buffer for fragmented datagrams.
+ */
+
+#ifndef FSCP_REASSEMBLY_BUFFER_HPP
+#define FSCP_REASSEMBLY_BUFFER_HPP
+
+#include "monotonic_clock.hpp"
+#include "shared_buffer.hpp"
+
+#include <boost/optional.hpp>
+
+#include <map>
+
+#include <stdint.h>
+
+namespace fscp
+{
+	/**
+	 * \brief A reassembly buffer for the datagrams a host sent in several FRAGMENT messages.
+	 *
+	 * The memory it uses is bounded: to make room for a new datagram, the expired datagrams are dropped first, then the oldest ones.
+	 *
+	 * A fragment that overlaps another fragment of the same datagram drops the whole datagram, unless it is an exact duplicate, which is ignored.
+	 */
+	class reassembly_buffer
+	{
+		public:
+
+			/**
+			 * \brief The datagram identifier type.
+			 */
+			typedef uint32_t datagram_id_type;
+
+			/**
+			 * \brief Create a reassembly buffer.
+			 * \param max_size The maximum count of bytes of partially received datagrams to keep.
+			 * \param max_fragment_count The maximum count of fragments of a datagram.
+			 * \param timeout The time after which a partially received datagram is dropped.
+			 */
+			reassembly_buffer(size_t max_size, size_t max_fragment_count, monotonic_clock::tick_type timeout) :
+				m_max_size(max_size),
+				m_max_fragment_count(max_fragment_count),
+				m_timeout(timeout),
+				m_datagrams(),
+				m_size(0)
+			{}
+
+			/**
+			 * \brief Add a fragment.
+			 * \param datagram_id The identifier of the datagram the fragment belongs to.
+			 * \param offset The offset of the fragment within the datagram.
+			 * \param total_length The length of the whole datagram.
+			 * \param data The fragment data.
+			 * \param data_len The fragment data length.
+			 * \return The datagram, if the fragment completed it. The size of the buffer is the length of the datagram.
+			 */
+			boost::optional<SharedBuffer> add(datagram_id_type datagram_id, size_t offset, size_t total_length, const void* data, size_t data_len);
+
+			/**
+			 * \brief Drop the expired datagrams.
+			 * \return The count of datagrams dropped.
+			 */
+			size_t expire();
+
+			/**
+			 * \brief Drop all the datagrams.
+			 */
+			void clear()
+			{
+				m_datagrams.clear();
+				m_size = 0;
+			}
+
+			/**
+			 * \brief Get the size.
+			 * \return The count of bytes of partially received datagrams.
+			 */
+			size_t size() const { return m_size; }
+
+		private:
+
+			struct partial_datagram_type
+			{
+				partial_datagram_type(size_t total_length, monotonic_clock::tick_type _first_seen) :
+					buffer(total_length),
+					fragments(),
+					received(0),
+					first_seen(_first_seen)
+				{}
+
+				SharedBuffer buffer;
+
+				// The offset and the end of each received fragment.
+				std::map<size_t, size_t> fragments;
+				size_t received;
+				monotonic_clock::tick_type first_seen;
+			};
+
+			typedef std::map<datagram_id_type, partial_datagram_type> partial_datagram_map_type;
+
+			void drop(partial_datagram_map_type::iterator);
+			void drop_oldest();
+
+			size_t m_max_size;
+			size_t m_max_fragment_count;
+			monotonic_clock::tick_type m_timeout;
+			partial_datagram_map_type m_datagrams;
+			size_t m_size;
+	};
+}
+
+#endif /* FSCP_REASSEMBLY_BUFFER_HPP */
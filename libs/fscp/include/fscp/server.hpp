@@ -52,6 +52,7 @@
 #include "presentation_store.hpp"
 #include "peer_session.hpp"
 #include "logger.hpp"
+#include "timer_wheel.hpp"
 
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
@@ -61,6 +62,7 @@
 #include <map>
 #include <queue>
 #include <iostream>
+#include <atomic>
 
 #include <stdint.h>
 
@@ -73,6 +75,8 @@ namespace fscp
 	class session_message;
 	class clear_session_message;
 	class data_message;
+	class compact_data_message;
+	class fragment_message;
 
 	/**
 	 * \brief A FSCP server.
@@ -233,6 +237,13 @@ namespace fscp
 			 */
 			typedef boost::function<void (const ep_type& host, session_loss_reason)> session_lost_handler_type;
 
+			/**
+			 * \brief A handler for when the path MTU to a host was discovered.
+			 * \param host The host.
+			 * \param path_mtu The path MTU, in bytes. It accounts for the IP and UDP headers.
+			 */
+			typedef boost::function<void (const ep_type& host, size_t path_mtu)> path_mtu_discovered_handler_type;
+
 			/**
 			 * \brief A handler for when data is available.
 			 * \param sender The endpoint that sent the data message.
@@ -351,6 +362,8 @@ namespace fscp
 			/**
 			 * \brief Close the server.
 			 *
+			 * All the pending timers are cancelled, so that the io_service can run out of work. The sessions that survive are given new timers by the next call to open().
+			 *
 			 * This method can be called from another thread.
 			 */
 			void close();
@@ -676,6 +689,117 @@ namespace fscp
 			 */
 			void sync_set_cipher_suites(const cipher_suite_list_type& cipher_suites);
 
+			/**
+			 * \brief Set the session keep-alive period.
+			 * \param keep_alive_period The period after which a keep-alive is sent to a peer we didn't send anything to.
+			 * \warning This method is *NOT* thread-safe and should be called only before the server is started.
+			 */
+			void set_keep_alive_period(const boost::posix_time::time_duration& keep_alive_period)
+			{
+				m_keep_alive_period = keep_alive_period;
+			}
+
+			/**
+			 * \brief Set the session timeout.
+			 * \param session_timeout The time after which a silent peer loses its session. Should be several times the keep-alive period of the peers.
+			 * \warning This method is *NOT* thread-safe and should be called only before the server is started.
+			 */
+			void set_session_timeout(const boost::posix_time::time_duration& session_timeout)
+			{
+				m_session_timeout = session_timeout;
+			}
+
+			/**
+			 * \brief Enable or disable the aggregation of outgoing data.
+			 * \param data_aggregation If true, small frames sent in a row to a host that advertised PROTOCOL_CAPABILITY_AGGREGATED_DATA are packed into a single AGGREGATED_DATA message.
+			 * \warning This method is *NOT* thread-safe and should be called only before the server is started.
+			 */
+			void set_data_aggregation(bool data_aggregation)
+			{
+				m_data_aggregation = data_aggregation;
+			}
+
+			/**
+			 * \brief Set the data aggregation delay.
+			 * \param data_aggregation_delay The time during which outgoing frames are held so that they can be aggregated. If zero, frames are only aggregated with those sent in the same burst, without any additional delay.
+			 * \warning This method is *NOT* thread-safe and should be called only before the server is started.
+			 */
+			void set_data_aggregation_delay(const boost::posix_time::time_duration& data_aggregation_delay)
+			{
+				m_data_aggregation_delay = data_aggregation_delay;
+			}
+
+			/**
+			 * \brief Set the maximum cleartext size of aggregated data.
+			 * \param max_aggregated_data_size The maximum size. The aggregates sent to a host are also kept within its path MTU. Frames that don't fit are sent in regular DATA messages.
+			 * \warning This method is *NOT* thread-safe and should be called only before the server is started.
+			 */
+			void set_max_aggregated_data_size(size_t max_aggregated_data_size)
+			{
+				m_max_aggregated_data_size = max_aggregated_data_size;
+			}
+
+			/**
+			 * \brief Enable or disable the compact framing of data messages.
+			 * \param compact_data_framing If true, PROTOCOL_CAPABILITY_COMPACT_DATA is advertised and data messages are sent with the compact framing to the hosts that advertised it too. Compact data messages are accepted in any case.
+			 * \warning This method is *NOT* thread-safe and should be called only before the server is started.
+			 */
+			void set_compact_data_framing(bool compact_data_framing)
+			{
+				m_compact_data_framing = compact_data_framing;
+			}
+
+			/**
+			 * \brief Enable or disable the path MTU discovery.
+			 * \param path_mtu_discovery If true, the path MTU to the hosts that advertised PROTOCOL_CAPABILITY_PATH_MTU_PROBE is discovered once a session is established with them, and discovered again periodically. PATH_MTU_PROBE messages are answered in any case.
+			 * \warning This method is *NOT* thread-safe and should be called only before the server is started.
+			 */
+			void set_path_mtu_discovery(bool path_mtu_discovery)
+			{
+				m_path_mtu_discovery = path_mtu_discovery;
+			}
+
+			/**
+			 * \brief Enable or disable the fragmentation of oversized datagrams.
+			 * \param fragmentation If true, PROTOCOL_CAPABILITY_FRAGMENT is advertised and the datagrams that don't fit in the path MTU to a host that advertised it too are sent in several FRAGMENT messages instead of being left to IP fragmentation.
+			 * \warning This method is *NOT* thread-safe and should be called only before the server is started.
+			 */
+			void set_fragmentation(bool fragmentation)
+			{
+				m_fragmentation = fragmentation;
+			}
+
+			/**
+			 * \brief Set the maximum count of peer sessions.
+			 * \param max_peer_session_count The maximum count of hosts the server keeps a session state for. Messages that would require more are rejected.
+			 * \warning This method is *NOT* thread-safe and should be called only before the server is started.
+			 */
+			void set_max_peer_session_count(size_t max_peer_session_count)
+			{
+				m_max_peer_session_count = max_peer_session_count;
+			}
+
+			/**
+			 * \brief Get the count of rejected messages.
+			 * \return The count of messages that were dropped because they came from a host with no session, or because the session table was full.
+			 *
+			 * This method is thread-safe.
+			 */
+			uint64_t rejected_message_count() const
+			{
+				return m_rejected_message_count.load(std::memory_order_relaxed);
+			}
+
+			/**
+			 * \brief Set the session renewal threshold.
+			 * \param rekey_threshold The sequence number after which a session is renewed.
+			 * \warning This method is *NOT* thread-safe and should be called only before the server is started.
+			 */
+			void set_rekey_threshold(sequence_number_type rekey_threshold)
+			{
+				m_rekey_threshold = rekey_threshold;
+			}
+
 			/**
 			 * \brief Set the elliptic curves.
 			 * \param elliptic_curves The elliptic curves.
@@ -900,6 +1024,34 @@ namespace fscp
 			 */
 			void sync_set_session_lost_callback(session_lost_handler_type callback);
 
+			/**
+			 * \brief Set the path MTU discovered callback.
+			 * \param callback The callback.
+			 * \warning This method is *NOT* thread-safe and should be called only before the server is started.
+			 */
+			void set_path_mtu_discovered_callback(path_mtu_discovered_handler_type callback)
+			{
+				m_path_mtu_discovered_handler = callback;
+			}
+
+			/**
+			 * \brief Set the path MTU discovered callback.
+			 * \param callback The callback.
+			 * \param handler The handler to call when the change was made effective.
+			 */
+			void async_set_path_mtu_discovered_callback(path_mtu_discovered_handler_type callback, void_handler_type handler = void_handler_type())
+			{
+				m_session_strand.post(boost::bind(&server::do_set_path_mtu_discovered_callback, this, callback, handler));
+			}
+
+			/**
+			 * \brief Set the path MTU discovered callback.
+			 * \param callback The callback.
+			 * \warning If the io_service is not being run, the call will block undefinitely.
+			 * \warning This function must **NEVER** be called from inside a thread that runs one of the server's handlers.
+			 */
+			void sync_set_path_mtu_discovered_callback(path_mtu_discovered_handler_type callback);
+
 			/**
 			 * \brief Send data to a host.
 			 * \param target The target host.
@@ -1283,6 +1435,20 @@ namespace fscp
 				m_write_queue_strand.post(boost::bind(&server::push_write, this, write_handler));
 			}
 
+			class path_mtu_probe_sender
+			{
+				public:
+					void operator()(socket_type* socket, boost::asio::const_buffer data, const ep_type& target, simple_handler_type handler) const;
+			};
+
+			void async_send_path_mtu_probe_to(boost::asio::const_buffer data, const ep_type& target, simple_handler_type handler)
+			{
+				// The probe is written synchronously with the fragmentation disabled: the write queue ensures no other write sees that socket option.
+				const void_handler_type write_handler = boost::bind<void>(path_mtu_probe_sender(), &m_socket, data, to_socket_format(target), handler);
+
+				m_write_queue_strand.post(boost::bind(&server::push_write, this, write_handler));
+			}
+
 			void push_write(void_handler_type);
 			void pop_write();
 
@@ -1293,6 +1459,11 @@ namespace fscp
 			std::queue<void_handler_type> m_write_queue;
 			boost::asio::strand m_write_queue_strand;
 
+		private: // Timers
+
+			// Session keep-alives and HELLO reply timeouts all share this wheel.
+			timer_wheel m_timer_wheel;
+
 		private: // HELLO messages
 
 			/**
@@ -1321,28 +1492,29 @@ namespace fscp
 
 					/**
 					 * @brief Asynchronously waits for a hello reply.
-					 * @param io_service The io_service instance to use for the wait.
+					 * @param wheel The timer wheel to use for the wait.
 					 * @param hello_unique_number The unique hello number.
 					 * @param timeout The time to wait for the reply.
 					 * @param handler The handler to call upon timeout or cancellation.
 					 */
-					template <typename WaitHandler>
-					void async_wait_reply(boost::asio::io_service& io_service, uint32_t hello_unique_number, const boost::posix_time::time_duration& timeout, WaitHandler handler);
+					void async_wait_reply(timer_wheel& wheel, uint32_t hello_unique_number, const boost::posix_time::time_duration& timeout, timer_wheel::handler_type handler);
 
 					/**
 					 * @brief Cancel a hello reply wait timer.
+					 * @param wheel The timer wheel used for the wait.
 					 * @param hello_unique_number The hello reply number.
 					 * @param success Whether the cancel is the result of a received reply.
 					 * @return true if the timer was cancelled or false if it was too late to do so.
 					 */
-					bool cancel_reply_wait(uint32_t hello_unique_number, bool success);
+					bool cancel_reply_wait(timer_wheel& wheel, uint32_t hello_unique_number, bool success);
 
 					/**
 					 * @brief Cancel all pending hello request wait timers.
+					 * @param wheel The timer wheel used for the waits.
 					 *
 					 * This call is similar to calling cancel_reply_wait(<num>, false) for all hello unique numbers.
 					 */
-					void cancel_all_reply_wait();
+					void cancel_all_reply_wait(timer_wheel& wheel);
 
 					/**
 					 * @brief Remove a hello reply wait from the pending list.
@@ -1357,18 +1529,18 @@ namespace fscp
 					struct pending_request_status
 					{
 						pending_request_status() :
-							timer(),
+							timer_id(timer_wheel::INVALID_TIMER_ID),
 							start_date(boost::posix_time::microsec_clock::universal_time()),
 							success(false)
 						{}
 
-						pending_request_status(boost::shared_ptr<boost::asio::deadline_timer> _timer) :
-							timer(_timer),
+						pending_request_status(timer_wheel::timer_id_type _timer_id) :
+							timer_id(_timer_id),
 							start_date(boost::posix_time::microsec_clock::universal_time()),
 							success(false)
 						{}
 
-						boost::shared_ptr<boost::asio::deadline_timer> timer;
+						timer_wheel::timer_id_type timer_id;
 						boost::posix_time::ptime start_date;
 						bool success;
 					};
@@ -1430,6 +1602,8 @@ namespace fscp
 			void do_handle_session_request(SharedBuffer, const identity_store&, const ep_type&, const session_request_message&);
 			void do_handle_verified_session_request(const identity_store&, const ep_type&, const session_request_message&);
 
+			protocol_capabilities_type get_local_capabilities() const;
+
 			std::set<ep_type> get_session_endpoints() const;
 			bool has_session_with_endpoint(const ep_type&);
 			void do_get_session_endpoints(endpoints_handler_type);
@@ -1439,10 +1613,15 @@ namespace fscp
 			void do_set_elliptic_curves(elliptic_curve_list_type, void_handler_type);
 			void do_set_session_request_message_received_callback(session_request_received_handler_type, void_handler_type);
 
+			peer_session* get_peer_session(const ep_type&);
+			peer_session* get_or_create_peer_session(const ep_type&);
+
 			// This strand is common to session requests, session messages and data messages.
 			boost::asio::strand m_session_strand;
 
 			peer_session_map_type m_peer_sessions;
+			size_t m_max_peer_session_count;
+			std::atomic<uint64_t> m_rejected_message_count;
 
 			bool m_accept_session_request_messages_default;
 			cipher_suite_list_type m_cipher_suites;
@@ -1452,6 +1631,8 @@ namespace fscp
 		private: // SESSION messages
 
 			void do_send_session(const identity_store&, const ep_type&, const peer_session::session_parameters&);
+			void do_rekey(const identity_store&, const ep_type&, const host_identifier_type&, boost::shared_ptr<peer_session::next_session_type>, session_number_type, cipher_suite_type, elliptic_curve_type);
+			void do_handle_rekey(const ep_type&, boost::shared_ptr<peer_session::next_session_type>, SharedBuffer, size_t);
 			void do_handle_session(SharedBuffer, const identity_store&, const ep_type&, const session_message&);
 			void do_handle_verified_session(const identity_store&, const ep_type&, const session_message&);
 
@@ -1468,6 +1649,7 @@ namespace fscp
 			session_error_handler_type m_session_error_handler;
 			session_established_handler_type m_session_established_handler;
 			session_lost_handler_type m_session_lost_handler;
+			sequence_number_type m_rekey_threshold;
 
 		private: // DATA messages
 
@@ -1484,11 +1666,26 @@ namespace fscp
 			void do_send_contact_to_all(const contact_map_type&, multiple_endpoints_handler_type);
 			void do_send_contact_to_session(peer_session&, const ep_type&, const contact_map_type&, simple_handler_type);
 			void handle_data_message_from(const identity_store&, SharedBuffer, const data_message&, const ep_type&);
-			void do_handle_data(const identity_store&, const ep_type&, const data_message&);
+			template <typename DataMessageType>
+			void do_handle_data(const identity_store&, const ep_type&, const DataMessageType&);
+			data_framing_type get_data_framing(const peer_session&) const;
+			size_t get_max_aggregated_data_size(const peer_session&, const ep_type&) const;
 			void do_handle_data_message(const ep_type&, message_type, SharedBuffer, boost::asio::const_buffer);
 			void do_handle_contact_request(const ep_type&, const std::set<hash_type>&);
 			void do_handle_contact(const ep_type&, const contact_map_type&);
 
+			struct pending_aggregate_type
+			{
+				std::vector<uint8_t> frames;
+				std::vector<simple_handler_type> handlers;
+			};
+
+			typedef std::map<ep_type, pending_aggregate_type> pending_aggregate_map_type;
+
+			void do_aggregate_data(peer_session&, const ep_type&, channel_number_type, boost::asio::const_buffer, simple_handler_type);
+			void do_flush_aggregated_data(peer_session&, const ep_type&);
+			void do_flush_all_aggregated_data();
+
 			void do_set_data_received_callback(data_received_handler_type, void_handler_type);
 			void do_set_contact_request_received_callback(contact_request_received_handler_type, void_handler_type);
 			void do_set_contact_received_callback(contact_received_handler_type, void_handler_type);
@@ -1500,12 +1697,56 @@ namespace fscp
 			contact_request_received_handler_type m_contact_request_message_received_handler;
 			contact_received_handler_type m_contact_message_received_handler;
 
+			bool m_compact_data_framing;
+			bool m_data_aggregation;
+			boost::posix_time::time_duration m_data_aggregation_delay;
+			size_t m_max_aggregated_data_size;
+
+			// The frames waiting to be aggregated. Only accessed from within the session strand.
+			pending_aggregate_map_type m_pending_aggregates;
+			bool m_aggregation_flush_scheduled;
+			boost::asio::deadline_timer m_aggregation_timer;
+
 		private: // Keep-alive
 
-			void do_check_keep_alive(const boost::system::error_code&);
+			void do_schedule_keep_alive(const ep_type&);
+			void do_schedule_all_keep_alives();
+			void do_forget_session_timers();
+			void do_check_keep_alive(const ep_type&, const boost::system::error_code&);
 			void do_send_keep_alive(const ep_type&, simple_handler_type);
 
-			boost::asio::deadline_timer m_keep_alive_timer;
+			boost::posix_time::time_duration m_keep_alive_period;
+			boost::posix_time::time_duration m_session_timeout;
+
+			// The endpoints whose keep-alive timer is pending. Only accessed from within the session strand.
+			std::set<ep_type> m_keep_alive_endpoints;
+
+		private: // Path MTU discovery
+
+			void do_schedule_path_mtu_discovery(const ep_type&, const boost::posix_time::time_duration&, bool);
+			void do_schedule_all_path_mtu_discoveries();
+			void do_check_path_mtu_discovery(const ep_type&, bool, const boost::system::error_code&);
+			void do_start_path_mtu_discovery(const ep_type&);
+			void do_send_path_mtu_probe(const ep_type&);
+			void do_handle_path_mtu_probe_sent(const ep_type&, unsigned int, const boost::system::error_code&);
+			void do_check_path_mtu_probe(const ep_type&, unsigned int, const boost::system::error_code&);
+			void do_handle_path_mtu_reply(const ep_type&, size_t);
+			void do_handle_path_mtu_discovered(const ep_type&);
+			void do_send_path_mtu_reply(const ep_type&, size_t);
+			void do_set_path_mtu_discovered_callback(path_mtu_discovered_handler_type, void_handler_type);
+
+			bool m_path_mtu_discovery;
+			path_mtu_discovered_handler_type m_path_mtu_discovered_handler;
+
+			// The endpoints whose path MTU revalidation timer is pending. Only accessed from within the session strand.
+			std::set<ep_type> m_path_mtu_revalidation_endpoints;
+
+		private: // FRAGMENT messages
+
+			void do_send_datagram_to_session(peer_session&, const ep_type&, SharedBuffer, size_t, simple_handler_type);
+			void do_handle_fragment(const identity_store&, const ep_type&, const fragment_message&);
+
+			bool m_fragmentation;
 
 		private: // Misc
 
@@ -72,7 +72,8 @@ namespace fscp
 			hello_request_timed_out,
 			no_presentation_for_host,
 			session_already_exist,
-			no_session_for_host
+			no_session_for_host,
+			too_many_sessions
 		};
 
 		/**
@@ -76,9 +76,10 @@ namespace fscp
 			 * \param pub_key The public key.
 			 * \param pub_key_len The public key length.
 			 * \param sig_key The private key to use to sign the ciphertext.
+			 * \param capabilities The protocol capabilities. They are written in the signed header, in place of bytes that older hosts write as zero and ignore.
 			 * \return The count of bytes written.
 			 */
-			static size_t write(void* buf, size_t buf_len, session_number_type session_number, const host_identifier_type& host_identifier, cipher_suite_type cs, elliptic_curve_type ec, const void* pub_key, size_t pub_key_len, cryptoplus::pkey::pkey sig_key);
+			static size_t write(void* buf, size_t buf_len, session_number_type session_number, const host_identifier_type& host_identifier, cipher_suite_type cs, elliptic_curve_type ec, const void* pub_key, size_t pub_key_len, cryptoplus::pkey::pkey sig_key, protocol_capabilities_type capabilities = 0);
 
 			/**
 			 * \brief Create a session_message from a message.
@@ -110,6 +111,12 @@ namespace fscp
 			 */
 			elliptic_curve_type elliptic_curve() const;
 
+			/**
+			 * \brief Get the protocol capabilities.
+			 * \return The protocol capabilities. Older hosts always send 0.
+			 */
+			protocol_capabilities_type capabilities() const;
+
 			/**
 			 * \brief Get the public key.
 			 * \return The public key.
@@ -179,6 +186,11 @@ namespace fscp
 		return buffer_tools::get<uint8_t>(payload(), sizeof(session_number_type) + host_identifier_type::data_type::static_size + sizeof(uint8_t));
 	}
 
+	inline protocol_capabilities_type session_message::capabilities() const
+	{
+		return ntohs(buffer_tools::get<protocol_capabilities_type>(payload(), sizeof(session_number_type) + host_identifier_type::data_type::static_size + sizeof(uint8_t) * 2));
+	}
+
 	inline const uint8_t* session_message::public_key() const
 	{
 		return payload() + sizeof(session_number_type) + host_identifier_type::data_type::static_size + sizeof(uint8_t) * 2 + 2 + sizeof(uint16_t);
@@ -0,0 +1,162 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file timer_wheel.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A hashed timer wheel.
+ */
+
+#ifndef FSCP_TIMER_WHEEL_HPP
+#define FSCP_TIMER_WHEEL_HPP
+
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+#include <stdint.h>
+
+namespace fscp
+{
+	/**
+	 * \brief A hashed timer wheel.
+	 *
+	 * Many timers can share a single underlying asio timer: they are hashed into slots according to their expiration tick, and the wheel only visits the current slot on each tick. Scheduling and cancelling a timer are both done in O(1).
+	 *
+	 * The expiration of a timer is rounded up to the resolution of the wheel. The wheel only ticks while some timers are pending, so that it never keeps its io_service busy for nothing.
+	 *
+	 * A timer_wheel instance is thread-safe.
+	 */
+	class timer_wheel
+	{
+		public:
+
+			/**
+			 * \brief The handler type.
+			 *
+			 * The handler gets no error if the timer expired, and boost::asio::error::operation_aborted if it was cancelled.
+			 */
+			typedef boost::function<void (const boost::system::error_code&)> handler_type;
+
+			/**
+			 * \brief The timer identifier type.
+			 */
+			typedef uint64_t timer_id_type;
+
+			/**
+			 * \brief An invalid timer identifier.
+			 */
+			static const timer_id_type INVALID_TIMER_ID = 0;
+
+			/**
+			 * \brief Create a timer wheel.
+			 * \param io_service The io_service to use.
+			 * \param resolution The duration of a tick.
+			 * \param slot_count The count of slots. Timers that expire further than slot_count ticks away just go around the wheel several times.
+			 */
+			timer_wheel(boost::asio::io_service& io_service, const boost::posix_time::time_duration& resolution, size_t slot_count);
+
+			/**
+			 * \brief Schedule a timer.
+			 * \param timeout The time to wait for.
+			 * \param handler The handler to call when the timer expires or is cancelled. It is never called from within async_wait() or cancel().
+			 * \return The identifier of the timer.
+			 */
+			timer_id_type async_wait(const boost::posix_time::time_duration& timeout, handler_type handler);
+
+			/**
+			 * \brief Cancel a timer.
+			 * \param timer_id The timer identifier.
+			 * \return true if the timer was pending, in which case its handler gets called with boost::asio::error::operation_aborted. false if it was too late to cancel it.
+			 */
+			bool cancel(timer_id_type timer_id);
+
+			/**
+			 * \brief Cancel all the pending timers.
+			 * \return The count of cancelled timers.
+			 */
+			size_t cancel_all();
+
+			/**
+			 * \brief Get the count of pending timers.
+			 * \return The count of pending timers.
+			 */
+			size_t pending_count() const;
+
+		private:
+
+			struct entry_type
+			{
+				entry_type(uint64_t _expiration_tick, handler_type _handler) :
+					expiration_tick(_expiration_tick),
+					handler(_handler)
+				{}
+
+				uint64_t expiration_tick;
+				handler_type handler;
+			};
+
+			typedef boost::unordered_map<timer_id_type, entry_type> entry_map_type;
+
+			// Cancelled timers are only removed from the entry map: their slot gets cleaned up when the wheel reaches it.
+			typedef std::vector<timer_id_type> slot_type;
+
+			void start_ticking();
+			void stop_ticking();
+			void handle_tick(uint64_t, const boost::system::error_code&);
+
+			boost::asio::io_service& m_io_service;
+			boost::asio::deadline_timer m_timer;
+			const boost::posix_time::time_duration m_resolution;
+
+			mutable boost::mutex m_mutex;
+			std::vector<slot_type> m_slots;
+			entry_map_type m_entries;
+			uint64_t m_current_tick;
+			timer_id_type m_next_timer_id;
+			bool m_ticking;
+			uint64_t m_ticking_generation;
+	};
+}
+
+#endif /* FSCP_TIMER_WHEEL_HPP */
@@ -0,0 +1,188 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file compact_data_message.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A compact data message class.
+ */
+
+#include "compact_data_message.hpp"
+
+#include <cryptoplus/cipher/cipher_context.hpp>
+#include <cryptoplus/error/helpers.hpp>
+
+#include <cassert>
+#include <stdexcept>
+#include <vector>
+
+namespace fscp
+{
+	namespace
+	{
+		typedef std::vector<uint8_t> iv_type;
+
+		iv_type compute_iv(const void* nonce_prefix, size_t nonce_prefix_len, sequence_number_type sequence_number)
+		{
+			iv_type result(nonce_prefix_len + sizeof(sequence_number_type));
+
+			std::copy(static_cast<const uint8_t*>(nonce_prefix), static_cast<const uint8_t*>(nonce_prefix) + nonce_prefix_len, result.begin());
+			buffer_tools::set<sequence_number_type>(result.data(), nonce_prefix_len, htonl(sequence_number));
+
+			return result;
+		}
+
+		void update_aad(cryptoplus::cipher::cipher_context& cipher_context, const void* aad, size_t aad_len)
+		{
+			int len = 0;
+
+			cryptoplus::throw_error_if_not(EVP_CipherUpdate(&cipher_context.raw(), NULL, &len, static_cast<const unsigned char*>(aad), static_cast<int>(aad_len)) != 0);
+		}
+
+		// DATA message types map to the codes 0x00 to 0x0F, the other data message types (0xFA to 0xFF) to the codes 0x3A to 0x3F.
+		const uint8_t DATA_TYPE_CODE_COUNT = 0x10;
+		const uint8_t FIRST_CONTROL_TYPE_CODE = static_cast<uint8_t>(MESSAGE_TYPE_PATH_MTU_PROBE) & 0x3F;
+	}
+
+	size_t compact_data_message::write(void* buf, size_t buf_len, message_type type, data_framing_type framing, sequence_number_type _sequence_number, calg_t cipher_algorithm, const void* cleartext, size_t cleartext_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len)
+	{
+		assert(enc_key);
+		assert(framing != DATA_FRAMING_STANDARD);
+		assert(is_data_message_type(type) || (type >= MESSAGE_TYPE_PATH_MTU_PROBE));
+
+		const iv_type iv = compute_iv(nonce_prefix, nonce_prefix_len, _sequence_number);
+
+		if (buf_len < MIN_LENGTH + cleartext_len + cipher_algorithm.block_size())
+		{
+			throw std::runtime_error("buf_len");
+		}
+
+		uint8_t* const header = static_cast<uint8_t*>(buf);
+		uint8_t* const _ciphertext = header + HEADER_LENGTH + sizeof(sequence_number_type);
+
+		const uint8_t type_code = is_data_message_type(type) ? static_cast<uint8_t>(type - MESSAGE_TYPE_DATA_0) : (static_cast<uint8_t>(type) & TYPE_CODE_MASK);
+
+		buffer_tools::set<uint8_t>(header, 0, COMPACT_FLAG | ((framing == DATA_FRAMING_COMPACT_ODD_KEY) ? ODD_KEY_FLAG : 0) | type_code);
+		buffer_tools::set<sequence_number_type>(header, HEADER_LENGTH, htonl(_sequence_number));
+
+		cryptoplus::cipher::cipher_context cipher_context;
+
+		// First initialization - required to set GCM specific attributes
+		cipher_context.initialize(cipher_algorithm, cryptoplus::cipher::cipher_context::encrypt, NULL, 0, NULL);
+		cipher_context.ctrl_set(EVP_CTRL_GCM_SET_IVLEN, static_cast<int>(iv.size()));
+
+		cipher_context.initialize(calg_t(), cryptoplus::cipher::cipher_context::unchanged, enc_key, enc_key_len, iv.data());
+
+		// The header is authenticated so that the message type can't be tampered with.
+		update_aad(cipher_context, header, HEADER_LENGTH + sizeof(sequence_number_type));
+
+		const size_t max_ciphertext_len = buf_len - MIN_LENGTH - cipher_algorithm.block_size();
+
+		size_t ciphertext_len = cipher_context.update(_ciphertext, max_ciphertext_len, cleartext, cleartext_len);
+		ciphertext_len += cipher_context.finalize(_ciphertext + ciphertext_len, max_ciphertext_len - ciphertext_len);
+
+		cipher_context.ctrl(EVP_CTRL_GCM_GET_TAG, GCM_TAG_LENGTH, _ciphertext + ciphertext_len);
+
+		return MIN_LENGTH + ciphertext_len;
+	}
+
+	compact_data_message::compact_data_message(const void* buf, size_t buf_len) :
+		m_data(static_cast<const uint8_t*>(buf)),
+		m_size(buf_len)
+	{
+		if (buf_len < MIN_LENGTH)
+		{
+			throw std::runtime_error("buf_len");
+		}
+
+		if (!is_compact_data_message(buf, buf_len))
+		{
+			throw std::runtime_error("Invalid message structure");
+		}
+
+		const uint8_t type_code = m_data[0] & TYPE_CODE_MASK;
+
+		if ((type_code >= DATA_TYPE_CODE_COUNT) && (type_code < FIRST_CONTROL_TYPE_CODE))
+		{
+			throw std::runtime_error("Invalid message structure");
+		}
+	}
+
+	message_type compact_data_message::type() const
+	{
+		const uint8_t type_code = m_data[0] & TYPE_CODE_MASK;
+
+		if (type_code < DATA_TYPE_CODE_COUNT)
+		{
+			return static_cast<message_type>(MESSAGE_TYPE_DATA_0 + type_code);
+		}
+
+		return static_cast<message_type>(static_cast<uint8_t>(~TYPE_CODE_MASK) | type_code);
+	}
+
+	size_t compact_data_message::get_cleartext(void* buf, size_t buf_len, calg_t cipher_algorithm, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len) const
+	{
+		assert(enc_key);
+
+		if (buf)
+		{
+			const iv_type iv = compute_iv(nonce_prefix, nonce_prefix_len, sequence_number());
+
+			cryptoplus::cipher::cipher_context cipher_context;
+
+			// First initialization - required to set GCM specific attributes
+			cipher_context.initialize(cipher_algorithm, cryptoplus::cipher::cipher_context::decrypt, NULL, 0, NULL);
+			cipher_context.ctrl_set(EVP_CTRL_GCM_SET_IVLEN, static_cast<int>(iv.size()));
+			cipher_context.ctrl(EVP_CTRL_GCM_SET_TAG, static_cast<int>(tag_size()), const_cast<uint8_t*>(tag()));
+
+			cipher_context.initialize(calg_t(), cryptoplus::cipher::cipher_context::unchanged, enc_key, enc_key_len, iv.data());
+
+			update_aad(cipher_context, m_data, HEADER_LENGTH + sizeof(sequence_number_type));
+
+			size_t cnt = cipher_context.update(buf, buf_len, ciphertext(), ciphertext_size());
+
+			cnt += cipher_context.finalize(static_cast<uint8_t*>(buf) + cnt, buf_len - cnt);
+
+			return cnt;
+		}
+		else
+		{
+			return ciphertext_size();
+		}
+	}
+}
@@ -44,6 +44,8 @@
 
 #include "data_message.hpp"
 
+#include "compact_data_message.hpp"
+
 #include <cryptoplus/cipher/cipher_context.hpp>
 #include <cryptoplus/hash/hmac.hpp>
 #include <cryptoplus/random/random.hpp>
@@ -51,6 +53,8 @@
 #include <boost/iterator/transform_iterator.hpp>
 
 #include <cassert>
+#include <cstring>
+#include <limits>
 #include <stdexcept>
 
 namespace fscp
@@ -77,26 +81,26 @@ namespace fscp
 
 	using boost::make_transform_iterator;
 
-	size_t data_message::write(void* buf, size_t buf_len, channel_number_type channel_number, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, const void* _cleartext, size_t cleartext_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len)
+	size_t data_message::write(void* buf, size_t buf_len, channel_number_type channel_number, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, const void* _cleartext, size_t cleartext_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, data_framing_type framing)
 	{
-		return raw_write(buf, buf_len, _sequence_number, cipher_algorithm, _cleartext, cleartext_len, enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, to_data_message_type(channel_number));
+		return raw_write(buf, buf_len, _sequence_number, cipher_algorithm, _cleartext, cleartext_len, enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, to_data_message_type(channel_number), framing);
 	}
 
-	size_t data_message::write_keep_alive(void* buf, size_t buf_len, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, size_t random_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len)
+	size_t data_message::write_keep_alive(void* buf, size_t buf_len, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, size_t random_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, data_framing_type framing)
 	{
 		const cryptoplus::buffer random = cryptoplus::random::get_random_bytes(random_len);
 
-		return raw_write(buf, buf_len, _sequence_number, cipher_algorithm, cryptoplus::buffer_cast<const uint8_t*>(random), cryptoplus::buffer_size(random), enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_KEEP_ALIVE);
+		return raw_write(buf, buf_len, _sequence_number, cipher_algorithm, cryptoplus::buffer_cast<const uint8_t*>(random), cryptoplus::buffer_size(random), enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_KEEP_ALIVE, framing);
 	}
 
-	size_t data_message::write_contact_request(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const hash_list_type& hash_list, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len)
+	size_t data_message::write_contact_request(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const hash_list_type& hash_list, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, data_framing_type framing)
 	{
 		const std::vector<hash_type::data_type> hash_vec(make_transform_iterator(hash_list.begin(), hash_to_data), make_transform_iterator(hash_list.end(), hash_to_data));
 
-		return raw_write(buf, buf_len, sequence_number, cipher_algorithm, reinterpret_cast<const char*>(&hash_vec[0]), hash_vec.size() * hash_type::data_type::static_size, enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_CONTACT_REQUEST);
+		return raw_write(buf, buf_len, sequence_number, cipher_algorithm, reinterpret_cast<const char*>(&hash_vec[0]), hash_vec.size() * hash_type::data_type::static_size, enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_CONTACT_REQUEST, framing);
 	}
 
-	size_t data_message::write_contact(void* buf, size_t buf_len, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, const contact_map_type& contact_map, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len)
+	size_t data_message::write_contact(void* buf, size_t buf_len, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, const contact_map_type& contact_map, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, data_framing_type framing)
 	{
 		std::vector<uint8_t> cleartext;
 		cleartext.resize(contact_map.size() * 49);
@@ -136,7 +140,67 @@ namespace fscp
 
 		cleartext.resize(std::distance(cleartext.begin(), ptr));
 
-		return raw_write(buf, buf_len, _sequence_number, cipher_algorithm, &cleartext[0], cleartext.size(), enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_CONTACT);
+		return raw_write(buf, buf_len, _sequence_number, cipher_algorithm, &cleartext[0], cleartext.size(), enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_CONTACT, framing);
+	}
+
+	size_t data_message::write_aggregated_data(void* buf, size_t buf_len, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, const void* frames, size_t frames_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, data_framing_type framing)
+	{
+		return raw_write(buf, buf_len, _sequence_number, cipher_algorithm, frames, frames_len, enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_AGGREGATED_DATA, framing);
+	}
+
+	size_t data_message::write_path_mtu_probe(void* buf, size_t buf_len, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, size_t path_mtu, size_t message_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, data_framing_type framing)
+	{
+		if ((path_mtu > std::numeric_limits<uint16_t>::max()) || (message_len < overhead(framing) + PATH_MTU_FIELD_LENGTH))
+		{
+			throw std::runtime_error("message_len");
+		}
+
+		// The padding is what actually probes the path: its content doesn't matter.
+		std::vector<uint8_t> cleartext(message_len - overhead(framing), 0x00);
+
+		buffer_tools::set<uint16_t>(&cleartext[0], 0, htons(static_cast<uint16_t>(path_mtu)));
+
+		return raw_write(buf, buf_len, _sequence_number, cipher_algorithm, &cleartext[0], cleartext.size(), enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_PATH_MTU_PROBE, framing);
+	}
+
+	size_t data_message::write_path_mtu_reply(void* buf, size_t buf_len, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, size_t path_mtu, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, data_framing_type framing)
+	{
+		if (path_mtu > std::numeric_limits<uint16_t>::max())
+		{
+			throw std::runtime_error("path_mtu");
+		}
+
+		uint8_t cleartext[PATH_MTU_FIELD_LENGTH];
+
+		buffer_tools::set<uint16_t>(cleartext, 0, htons(static_cast<uint16_t>(path_mtu)));
+
+		return raw_write(buf, buf_len, _sequence_number, cipher_algorithm, cleartext, sizeof(cleartext), enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_PATH_MTU_REPLY, framing);
+	}
+
+	size_t data_message::overhead(data_framing_type framing)
+	{
+		if (framing != DATA_FRAMING_STANDARD)
+		{
+			return compact_data_message::overhead();
+		}
+
+		return HEADER_LENGTH + MIN_BODY_LENGTH;
+	}
+
+	size_t data_message::write_aggregated_frame(void* buf, size_t buf_len, channel_number_type channel_number, const void* data, size_t data_len)
+	{
+		if ((data_len > std::numeric_limits<uint16_t>::max()) || (buf_len < AGGREGATED_FRAME_HEADER_LENGTH + data_len))
+		{
+			throw std::runtime_error("buf_len");
+		}
+
+		uint8_t* const ptr = static_cast<uint8_t*>(buf);
+
+		buffer_tools::set<uint8_t>(ptr, 0, static_cast<uint8_t>(channel_number));
+		buffer_tools::set<uint16_t>(ptr, sizeof(uint8_t), htons(static_cast<uint16_t>(data_len)));
+		std::memcpy(ptr + AGGREGATED_FRAME_HEADER_LENGTH, data, data_len);
+
+		return AGGREGATED_FRAME_HEADER_LENGTH + data_len;
 	}
 
 	hash_list_type data_message::parse_hash_list(const void* buf, size_t buflen)
@@ -233,6 +297,48 @@ namespace fscp
 		return result;
 	}
 
+	aggregated_frame_list_type data_message::parse_aggregated_frames(const void* buf, size_t buflen)
+	{
+		aggregated_frame_list_type result;
+
+		const uint8_t* const end = static_cast<const uint8_t*>(buf) + buflen;
+
+		for (const uint8_t* ptr = static_cast<const uint8_t*>(buf); ptr < end;)
+		{
+			if (end - ptr < static_cast<ptrdiff_t>(AGGREGATED_FRAME_HEADER_LENGTH))
+			{
+				throw std::runtime_error("Invalid message structure");
+			}
+
+			const uint8_t channel_number = buffer_tools::get<uint8_t>(ptr, 0);
+			const size_t data_len = ntohs(buffer_tools::get<uint16_t>(ptr, sizeof(uint8_t)));
+
+			ptr += AGGREGATED_FRAME_HEADER_LENGTH;
+
+			if ((channel_number > CHANNEL_NUMBER_15) || (end - ptr < static_cast<ptrdiff_t>(data_len)))
+			{
+				throw std::runtime_error("Invalid message structure");
+			}
+
+			result.push_back(std::make_pair(static_cast<channel_number_type>(channel_number), boost::asio::const_buffer(ptr, data_len)));
+
+			ptr += data_len;
+		}
+
+		return result;
+	}
+
+	size_t data_message::parse_path_mtu(const void* buf, size_t buflen)
+	{
+		// PATH_MTU_PROBE messages are padded: anything past the path MTU field is ignored.
+		if (buflen < PATH_MTU_FIELD_LENGTH)
+		{
+			throw std::runtime_error("Invalid message structure");
+		}
+
+		return ntohs(buffer_tools::get<uint16_t>(buf, 0));
+	}
+
 	data_message::data_message(const void* buf, size_t buf_len) :
 		message(buf, buf_len)
 	{
@@ -287,8 +393,13 @@ namespace fscp
 		}
 	}
 
-	size_t data_message::raw_write(void* buf, size_t buf_len, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, const void* _cleartext, size_t cleartext_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, message_type type)
+	size_t data_message::raw_write(void* buf, size_t buf_len, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, const void* _cleartext, size_t cleartext_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, message_type type, data_framing_type framing)
 	{
+		if (framing != DATA_FRAMING_STANDARD)
+		{
+			return compact_data_message::write(buf, buf_len, type, framing, _sequence_number, cipher_algorithm, _cleartext, cleartext_len, enc_key, enc_key_len, nonce_prefix, nonce_prefix_len);
+		}
+
 		assert(enc_key);
 
 		const iv_type iv = compute_iv(nonce_prefix, nonce_prefix_len, _sequence_number);
@@ -0,0 +1,101 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file fragment_message.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A fragment message class.
+ */
+
+#include "fragment_message.hpp"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace fscp
+{
+	size_t fragment_message::write(void* buf, size_t buf_len, datagram_id_type _datagram_id, size_t _offset, size_t _total_length, const void* _data, size_t data_len)
+	{
+		if ((data_len == 0) || (_total_length > std::numeric_limits<uint16_t>::max()) || (_offset + data_len > _total_length))
+		{
+			throw std::runtime_error("data_len");
+		}
+
+		if (buf_len < HEADER_LENGTH + MIN_BODY_LENGTH + data_len)
+		{
+			throw std::runtime_error("buf_len");
+		}
+
+		uint8_t* const payload = static_cast<uint8_t*>(buf) + HEADER_LENGTH;
+
+		buffer_tools::set<datagram_id_type>(payload, 0, htonl(_datagram_id));
+		buffer_tools::set<uint16_t>(payload, sizeof(datagram_id_type), htons(static_cast<uint16_t>(_offset)));
+		buffer_tools::set<uint16_t>(payload, sizeof(datagram_id_type) + sizeof(uint16_t), htons(static_cast<uint16_t>(_total_length)));
+		std::memcpy(payload + MIN_BODY_LENGTH, _data, data_len);
+
+		const size_t length = MIN_BODY_LENGTH + data_len;
+
+		return message::write(buf, buf_len, CURRENT_PROTOCOL_VERSION, MESSAGE_TYPE_FRAGMENT, length) + length;
+	}
+
+	fragment_message::fragment_message(const void* buf, size_t buf_len) :
+		message(buf, buf_len)
+	{
+		check_format();
+	}
+
+	fragment_message::fragment_message(const message& _message) :
+		message(_message)
+	{
+		check_format();
+	}
+
+	void fragment_message::check_format() const
+	{
+		if (length() <= MIN_BODY_LENGTH)
+		{
+			throw std::runtime_error("buf_len");
+		}
+
+		if (offset() + data_size() > total_length())
+		{
+			throw std::runtime_error("Invalid message structure");
+		}
+	}
+}
@@ -0,0 +1,139 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file monotonic_clock.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A coarse monotonic clock.
+ */
+
+#include "monotonic_clock.hpp"
+
+#include <cryptoplus/os.hpp>
+
+#if defined(WINDOWS)
+#include <windows.h>
+#if _WIN32_WINNT < 0x0600
+#include <atomic>
+#endif
+#elif defined(MACINTOSH)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+namespace fscp
+{
+#if defined(WINDOWS)
+#if _WIN32_WINNT >= 0x0600
+	monotonic_clock::tick_type monotonic_clock::now()
+	{
+		return static_cast<tick_type>(::GetTickCount64());
+	}
+#else
+	monotonic_clock::tick_type monotonic_clock::now()
+	{
+		// GetTickCount64() is not available on Windows XP: we extend the 32-bit tick count ourselves. It wraps every 49.7 days.
+		// The state holds the wrap count in its high part and the last tick count in its low part, so that both are updated at once.
+		static std::atomic<uint64_t> state(0);
+
+		const DWORD tick_count = ::GetTickCount();
+		uint64_t last_state = state.load(std::memory_order_relaxed);
+
+		for (;;)
+		{
+			const DWORD last_tick_count = static_cast<DWORD>(last_state);
+			uint64_t high_part = last_state & ~static_cast<uint64_t>(0xffffffff);
+
+			// Another thread may have stored a tick count read after ours: only a large step back is a wrap.
+			if (tick_count < last_tick_count)
+			{
+				if (last_tick_count - tick_count < 0x80000000)
+				{
+					return high_part + tick_count;
+				}
+
+				high_part += (static_cast<tick_type>(1) << 32);
+			}
+			else if ((tick_count - last_tick_count >= 0x80000000) && (high_part > 0))
+			{
+				// Our tick count was read before a wrap that another thread already accounted for.
+				return high_part - (static_cast<tick_type>(1) << 32) + tick_count;
+			}
+			else if (tick_count == last_tick_count)
+			{
+				return high_part + tick_count;
+			}
+
+			const uint64_t new_state = high_part + tick_count;
+
+			if (state.compare_exchange_weak(last_state, new_state, std::memory_order_relaxed))
+			{
+				return new_state;
+			}
+		}
+	}
+#endif
+#elif defined(MACINTOSH)
+	monotonic_clock::tick_type monotonic_clock::now()
+	{
+		static mach_timebase_info_data_t timebase = { 0, 0 };
+
+		if (timebase.denom == 0)
+		{
+			::mach_timebase_info(&timebase);
+		}
+
+		return ::mach_absolute_time() * timebase.numer / timebase.denom / 1000000;
+	}
+#else
+	monotonic_clock::tick_type monotonic_clock::now()
+	{
+		struct timespec ts;
+
+#ifdef CLOCK_MONOTONIC_COARSE
+		// The coarse clock is read from the vDSO without a system call and without reading the hardware clock.
+		::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+		::clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+
+		return static_cast<tick_type>(ts.tv_sec) * 1000 + static_cast<tick_type>(ts.tv_nsec) / 1000000;
+	}
+#endif
+}
@@ -46,12 +46,13 @@
 
 #include <cryptoplus/tls/tls.hpp>
 
+#include <cassert>
+
 namespace fscp
 {
-	bool peer_session::current_session_type::is_old() const
+	bool peer_session::current_session_type::is_old(sequence_number_type threshold) const
 	{
-		const auto max = std::numeric_limits<sequence_number_type>::max() / 2;
-		return ((local_sequence_number > max) || (remote_sequence_number > max));
+		return ((local_sequence_number > threshold) || (remote_sequence_number > threshold));
 	}
 
 	bool peer_session::set_first_remote_host_identifier(const host_identifier_type& _host_identifier)
@@ -82,6 +83,18 @@ namespace fscp
 		return true;
 	}
 
+	bool peer_session::prepare_session(boost::shared_ptr<next_session_type> _next_session)
+	{
+		assert(_next_session);
+
+		if (!m_next_session)
+		{
+			m_next_session = _next_session;
+		}
+
+		return (m_next_session == _next_session);
+	}
+
 	bool peer_session::complete_session(const void* _remote_public_key, size_t remote_public_key_size)
 	{
 		using cryptoplus::buffer_cast;
@@ -141,6 +154,12 @@ namespace fscp
 
 		m_next_session.reset();
 		swap(m_current_session, _current_session);
+		m_rekey_pending = false;
+
+		// The remote host may still send messages with the replaced session for a while, and may not be able to read the new one yet.
+		m_previous_session = _current_session;
+		m_previous_session_start = monotonic_clock::now();
+		m_send_with_previous_session = has_previous_session();
 
 		keep_alive();
 
@@ -189,6 +208,31 @@ namespace fscp
 		return false;
 	}
 
+	bool peer_session::set_previous_remote_sequence_number(sequence_number_type sequence_number)
+	{
+		if (sequence_number > m_previous_session->remote_sequence_number)
+		{
+			m_previous_session->remote_sequence_number = sequence_number;
+
+			return true;
+		}
+
+		return false;
+	}
+
+	bool peer_session::clear_previous_session(monotonic_clock::tick_type grace_period)
+	{
+		if (!m_previous_session || (monotonic_clock::now() < m_previous_session_start + grace_period))
+		{
+			return false;
+		}
+
+		m_previous_session.reset();
+		m_send_with_previous_session = false;
+
+		return true;
+	}
+
 	bool peer_session::clear()
 	{
 		clear_remote_host_identifier();
@@ -197,7 +241,90 @@ namespace fscp
 
 		m_current_session.reset();
 		m_next_session.reset();
+		m_previous_session.reset();
+		m_rekey_pending = false;
+		m_send_with_previous_session = false;
+		m_remote_capabilities = 0;
+		m_path_mtu = 0;
+		m_path_mtu_probe_size = 0;
+		m_reassembly_buffer.clear();
 
 		return result;
 	}
+
+	bool peer_session::start_rekey(monotonic_clock::tick_type retry_period)
+	{
+		const monotonic_clock::tick_type now = monotonic_clock::now();
+
+		if (m_rekey_pending && (now < m_rekey_start + retry_period))
+		{
+			return false;
+		}
+
+		m_rekey_pending = true;
+		m_rekey_start = now;
+
+		return true;
+	}
+
+	void peer_session::start_path_mtu_discovery(size_t min_mtu, size_t max_mtu, size_t precision)
+	{
+		assert(min_mtu <= max_mtu);
+
+		m_path_mtu_low = min_mtu;
+		m_path_mtu_high = max_mtu;
+		m_path_mtu_precision = precision;
+		m_path_mtu_probe_attempts = 0;
+
+		// Most paths carry full-sized datagrams: probing for the largest size first usually completes the discovery at once.
+		m_path_mtu_probe_size = max_mtu;
+	}
+
+	bool peer_session::path_mtu_probe_replied(size_t mtu)
+	{
+		// A late reply to an earlier probe still proves that the path carries its size.
+		if (!is_discovering_path_mtu() || (mtu <= m_path_mtu_low) || (mtu > m_path_mtu_high))
+		{
+			return false;
+		}
+
+		m_path_mtu_low = mtu;
+
+		return next_path_mtu_probe();
+	}
+
+	bool peer_session::path_mtu_probe_lost(unsigned int max_attempts)
+	{
+		if (!is_discovering_path_mtu())
+		{
+			return false;
+		}
+
+		if (m_path_mtu_probe_attempts < max_attempts)
+		{
+			// The probe may have been lost for an unrelated reason: we try the same size again.
+			return false;
+		}
+
+		m_path_mtu_high = m_path_mtu_probe_size - 1;
+
+		return next_path_mtu_probe();
+	}
+
+	bool peer_session::next_path_mtu_probe()
+	{
+		m_path_mtu_probe_attempts = 0;
+
+		if (m_path_mtu_high - m_path_mtu_low < m_path_mtu_precision)
+		{
+			m_path_mtu = m_path_mtu_low;
+			m_path_mtu_probe_size = 0;
+
+			return true;
+		}
+
+		m_path_mtu_probe_size = m_path_mtu_low + (m_path_mtu_high - m_path_mtu_low + 1) / 2;
+
+		return false;
+	}
 }
@@ -0,0 +1,183 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file reassembly_buffer.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A reassembly buffer for fragmented datagrams.
+ */
+
+#include "reassembly_buffer.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <iterator>
+
+namespace fscp
+{
+	boost::optional<SharedBuffer> reassembly_buffer::add(datagram_id_type datagram_id, size_t offset, size_t total_length, const void* data, size_t data_len)
+	{
+		if ((data_len == 0) || (total_length > m_max_size) || (offset + data_len > total_length))
+		{
+			return boost::none;
+		}
+
+		const monotonic_clock::tick_type now = monotonic_clock::now();
+
+		partial_datagram_map_type::iterator datagram = m_datagrams.find(datagram_id);
+
+		// An expired datagram can't be completed anymore: its identifier may even have been reused since.
+		if ((datagram != m_datagrams.end()) && (now >= datagram->second.first_seen + m_timeout))
+		{
+			drop(datagram);
+			datagram = m_datagrams.end();
+		}
+
+		if (datagram == m_datagrams.end())
+		{
+			expire();
+
+			while (m_size + total_length > m_max_size)
+			{
+				drop_oldest();
+			}
+
+			datagram = m_datagrams.insert(std::make_pair(datagram_id, partial_datagram_type(total_length, now))).first;
+			m_size += total_length;
+		}
+
+		partial_datagram_type& partial_datagram = datagram->second;
+
+		if ((buffer_size(partial_datagram.buffer) != total_length) || (partial_datagram.fragments.size() >= m_max_fragment_count))
+		{
+			drop(datagram);
+
+			return boost::none;
+		}
+
+		const size_t end = offset + data_len;
+		const std::map<size_t, size_t>::iterator next = partial_datagram.fragments.upper_bound(offset);
+
+		if (next != partial_datagram.fragments.begin())
+		{
+			const std::map<size_t, size_t>::iterator previous = std::prev(next);
+
+			if ((previous->first == offset) && (previous->second == end))
+			{
+				// The same fragment was received twice.
+				return boost::none;
+			}
+
+			if (previous->second > offset)
+			{
+				drop(datagram);
+
+				return boost::none;
+			}
+		}
+
+		if ((next != partial_datagram.fragments.end()) && (next->first < end))
+		{
+			drop(datagram);
+
+			return boost::none;
+		}
+
+		partial_datagram.fragments.insert(next, std::make_pair(offset, end));
+		std::memcpy(buffer_cast<uint8_t*>(partial_datagram.buffer) + offset, data, data_len);
+		partial_datagram.received += data_len;
+
+		// The fragments don't overlap: once they add up to the datagram length, they cover it entirely.
+		if (partial_datagram.received == total_length)
+		{
+			const SharedBuffer result = partial_datagram.buffer;
+
+			drop(datagram);
+
+			return result;
+		}
+
+		return boost::none;
+	}
+
+	size_t reassembly_buffer::expire()
+	{
+		const monotonic_clock::tick_type now = monotonic_clock::now();
+		size_t count = 0;
+
+		for (partial_datagram_map_type::iterator datagram = m_datagrams.begin(); datagram != m_datagrams.end();)
+		{
+			if (now >= datagram->second.first_seen + m_timeout)
+			{
+				drop(datagram++);
+				++count;
+			}
+			else
+			{
+				++datagram;
+			}
+		}
+
+		return count;
+	}
+
+	void reassembly_buffer::drop(partial_datagram_map_type::iterator datagram)
+	{
+		assert(m_size >= buffer_size(datagram->second.buffer));
+
+		m_size -= buffer_size(datagram->second.buffer);
+		m_datagrams.erase(datagram);
+	}
+
+	void reassembly_buffer::drop_oldest()
+	{
+		assert(!m_datagrams.empty());
+
+		partial_datagram_map_type::iterator oldest = m_datagrams.begin();
+
+		for (partial_datagram_map_type::iterator datagram = m_datagrams.begin(); datagram != m_datagrams.end(); ++datagram)
+		{
+			if (datagram->second.first_seen < oldest->second.first_seen)
+			{
+				oldest = datagram;
+			}
+		}
+
+		drop(oldest);
+	}
+}
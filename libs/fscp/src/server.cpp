@@ -52,6 +52,8 @@
 #include "session_request_message.hpp"
 #include "session_message.hpp"
 #include "data_message.hpp"
+#include "compact_data_message.hpp"
+#include "fragment_message.hpp"
 
 #include <boost/random.hpp>
 #include <boost/make_shared.hpp>
@@ -59,6 +61,9 @@
 #include <boost/thread/future.hpp>
 #include <boost/iterator/transform_iterator.hpp>
 
+#include <algorithm>
+#include <limits>
+
 #include <cassert>
 
 namespace fscp
@@ -72,6 +77,52 @@ namespace fscp
 		void null_simple_handler(const boost::system::error_code&) {}
 		void null_multiple_endpoints_handler(const std::map<server::ep_type, boost::system::error_code>&) {}
 
+		void call_all_handlers(const std::vector<server::simple_handler_type>& handlers, const boost::system::error_code& ec)
+		{
+			for (auto&& handler: handlers)
+			{
+				handler(ec);
+			}
+		}
+
+		bool may_be_sent_with(const data_message&, const peer_session::current_session_type&)
+		{
+			// Regular data messages don't tell which session they were sent with.
+			return true;
+		}
+
+		bool may_be_sent_with(const compact_data_message& _data_message, const peer_session::current_session_type& session)
+		{
+			return (_data_message.framing() == to_compact_data_framing(session.parameters.session_number));
+		}
+
+		template <typename DataMessageType>
+		boost::optional<size_t> get_cleartext(const DataMessageType& _data_message, const peer_session::current_session_type& session, SharedBuffer cleartext_buffer)
+		{
+			if (!may_be_sent_with(_data_message, session))
+			{
+				return boost::none;
+			}
+
+			try
+			{
+				return _data_message.get_cleartext(
+					buffer_cast<uint8_t*>(cleartext_buffer),
+					buffer_size(cleartext_buffer),
+					session.parameters.cipher_suite.to_cipher_algorithm(),
+					buffer_cast<const uint8_t*>(session.remote_session_key),
+					buffer_size(session.remote_session_key),
+					buffer_cast<const uint8_t*>(session.remote_nonce_prefix),
+					buffer_size(session.remote_nonce_prefix)
+				);
+			}
+			catch (const boost::system::system_error&)
+			{
+				// The message was not sent with this session keys.
+				return boost::none;
+			}
+		}
+
 		server::ep_type normalize(const server::ep_type& ep)
 		{
 			server::ep_type result = ep;
@@ -201,6 +252,71 @@ namespace fscp
 				map_type m_results;
 		};
 
+		size_t get_ip_udp_header_length(const server::ep_type& host)
+		{
+			return (host.address().is_v4() ? 20 : 40) + 8;
+		}
+
+		size_t get_min_path_mtu(const server::ep_type& host)
+		{
+			return host.address().is_v4() ? MIN_IPV4_PATH_MTU : MIN_IPV6_PATH_MTU;
+		}
+
+		template <typename DontFragmentOption>
+		void send_with_option(server::socket_type& socket, boost::asio::const_buffer data, const server::ep_type& target, const DontFragmentOption& option, boost::system::error_code& ec)
+		{
+			DontFragmentOption previous_option;
+
+			socket.get_option(previous_option, ec);
+
+			if (!ec)
+			{
+				socket.set_option(option, ec);
+			}
+
+			if (!ec)
+			{
+				socket.send_to(boost::asio::buffer(data), target, 0, ec);
+
+				// The other messages must still be fragmented if they need to.
+				boost::system::error_code restore_ec;
+				socket.set_option(previous_option, restore_ec);
+			}
+		}
+
+		void send_without_fragmentation(server::socket_type& socket, boost::asio::const_buffer data, const server::ep_type& target, boost::system::error_code& ec)
+		{
+			using boost::asio::detail::socket_option::integer;
+
+			if (target.address().is_v4())
+			{
+#if defined(IP_MTU_DISCOVER) && defined(IP_PMTUDISC_PROBE)
+				// The probe mode also ignores the path MTU the system already knows, which is what we want to validate.
+				send_with_option(socket, data, target, integer<IPPROTO_IP, IP_MTU_DISCOVER>(IP_PMTUDISC_PROBE), ec);
+#elif defined(IP_DONTFRAGMENT)
+				send_with_option(socket, data, target, integer<IPPROTO_IP, IP_DONTFRAGMENT>(1), ec);
+#elif defined(IP_DONTFRAG)
+				send_with_option(socket, data, target, integer<IPPROTO_IP, IP_DONTFRAG>(1), ec);
+#else
+				static_cast<void>(socket);
+				static_cast<void>(data);
+				ec = boost::asio::error::operation_not_supported;
+#endif
+			}
+			else
+			{
+#if defined(IPV6_MTU_DISCOVER) && defined(IPV6_PMTUDISC_PROBE)
+				send_with_option(socket, data, target, integer<IPPROTO_IPV6, IPV6_MTU_DISCOVER>(IPV6_PMTUDISC_PROBE), ec);
+#elif defined(IPV6_DONTFRAG)
+				send_with_option(socket, data, target, integer<IPPROTO_IPV6, IPV6_DONTFRAG>(1), ec);
+#else
+				static_cast<void>(socket);
+				static_cast<void>(data);
+				ec = boost::asio::error::operation_not_supported;
+#endif
+			}
+		}
+
 		bool compare_certificates(const server::cert_type& lhs, const server::cert_type& rhs)
 		{
 			assert(!!lhs);
@@ -218,12 +334,16 @@ namespace fscp
 		m_socket(io_service),
 		m_socket_strand(io_service),
 		m_write_queue_strand(io_service),
+		m_timer_wheel(io_service, TIMER_WHEEL_RESOLUTION, TIMER_WHEEL_SLOT_COUNT),
 		m_greet_strand(io_service),
 		m_accept_hello_messages_default(true),
 		m_hello_message_received_handler(),
 		m_presentation_strand(io_service),
 		m_presentation_message_received_handler(),
 		m_session_strand(io_service),
+		m_peer_sessions(),
+		m_max_peer_session_count(DEFAULT_MAX_PEER_SESSION_COUNT),
+		m_rejected_message_count(0),
 		m_accept_session_request_messages_default(true),
 		m_cipher_suites(get_default_cipher_suites()),
 		m_elliptic_curves(get_default_elliptic_curves()),
@@ -234,12 +354,26 @@ namespace fscp
 		m_session_error_handler(),
 		m_session_established_handler(),
 		m_session_lost_handler(),
+		m_rekey_threshold(SESSION_REKEY_THRESHOLD),
 		m_data_strand(io_service),
 		m_contact_strand(io_service),
 		m_data_received_handler(),
 		m_contact_request_message_received_handler(),
 		m_contact_message_received_handler(),
-		m_keep_alive_timer(io_service, SESSION_KEEP_ALIVE_PERIOD)
+		m_compact_data_framing(false),
+		m_data_aggregation(false),
+		m_data_aggregation_delay(),
+		m_max_aggregated_data_size(DEFAULT_MAX_AGGREGATED_DATA_SIZE),
+		m_pending_aggregates(),
+		m_aggregation_flush_scheduled(false),
+		m_aggregation_timer(io_service),
+		m_keep_alive_period(SESSION_KEEP_ALIVE_PERIOD),
+		m_session_timeout(SESSION_TIMEOUT),
+		m_keep_alive_endpoints(),
+		m_path_mtu_discovery(true),
+		m_path_mtu_discovered_handler(),
+		m_path_mtu_revalidation_endpoints(),
+		m_fragmentation(true)
 	{
 		// These calls are needed in C++03 to ensure that static initializations are done in a single thread.
 		server_category();
@@ -281,14 +415,18 @@ namespace fscp
 
 		async_receive_from();
 
-		m_keep_alive_timer.async_wait(m_session_strand.wrap(boost::bind(&server::do_check_keep_alive, this, boost::asio::placeholders::error)));
+		// Sessions may have survived a previous close().
+		m_session_strand.post(boost::bind(&server::do_schedule_all_keep_alives, this));
+		m_session_strand.post(boost::bind(&server::do_schedule_all_path_mtu_discoveries, this));
 	}
 
 	void server::close()
 	{
 		cancel_all_greetings();
 
-		m_keep_alive_timer.cancel();
+		// The cancelled session timers don't clean up after themselves: a later open() could otherwise see them as still pending.
+		m_session_strand.post(boost::bind(&server::do_forget_session_timers, this));
+		m_timer_wheel.cancel_all();
 
 		m_socket.close();
 	}
@@ -595,6 +733,16 @@ namespace fscp
 		return promise.get_future().wait();
 	}
 
+	void server::sync_set_path_mtu_discovered_callback(path_mtu_discovered_handler_type callback)
+	{
+		typedef boost::promise<void> promise_type;
+		promise_type promise;
+
+		async_set_path_mtu_discovered_callback(callback, boost::bind(&promise_type::set_value, &promise));
+
+		return promise.get_future().wait();
+	}
+
 	void server::async_send_data(const ep_type& target, channel_number_type channel_number, boost::asio::const_buffer data, simple_handler_type handler)
 	{
 		m_session_strand.post(boost::bind(&server::do_send_data, this, normalize(target), channel_number, data, handler));
@@ -840,6 +988,27 @@ namespace fscp
 			{
 				try
 				{
+					if (compact_data_message::is_compact_data_message(buffer_cast<const uint8_t*>(data), bytes_received))
+					{
+						// Compact data messages have no generic message header.
+						compact_data_message _compact_data_message(buffer_cast<const uint8_t*>(data), bytes_received);
+
+						m_session_strand.post(
+							make_shared_buffer_handler(
+								data,
+								boost::bind(
+									&server::do_handle_data<compact_data_message>,
+									this,
+									identity,
+									*sender,
+									_compact_data_message
+								)
+							)
+						);
+
+						return;
+					}
+
 					message message(buffer_cast<const uint8_t*>(data), bytes_received);
 
 					switch (message.type())
@@ -863,6 +1032,9 @@ namespace fscp
 						case MESSAGE_TYPE_CONTACT_REQUEST:
 						case MESSAGE_TYPE_CONTACT:
 						case MESSAGE_TYPE_KEEP_ALIVE:
+						case MESSAGE_TYPE_AGGREGATED_DATA:
+						case MESSAGE_TYPE_PATH_MTU_PROBE:
+						case MESSAGE_TYPE_PATH_MTU_REPLY:
 						{
 							data_message data_message(message);
 
@@ -870,7 +1042,7 @@ namespace fscp
 								make_shared_buffer_handler(
 									data,
 									boost::bind(
-										&server::do_handle_data,
+										&server::do_handle_data<fscp::data_message>,
 										this,
 										identity,
 										*sender,
@@ -881,6 +1053,25 @@ namespace fscp
 
 							break;
 						}
+						case MESSAGE_TYPE_FRAGMENT:
+						{
+							fragment_message fragment_message(message);
+
+							m_session_strand.post(
+								make_shared_buffer_handler(
+									data,
+									boost::bind(
+										&server::do_handle_fragment,
+										this,
+										identity,
+										*sender,
+										fragment_message
+									)
+								)
+							);
+
+							break;
+						}
 						case MESSAGE_TYPE_HELLO_REQUEST:
 						case MESSAGE_TYPE_HELLO_RESPONSE:
 						{
@@ -992,6 +1183,17 @@ namespace fscp
 #endif
 	}
 
+	void server::path_mtu_probe_sender::operator()(socket_type* socket, boost::asio::const_buffer data, const ep_type& target, simple_handler_type handler) const
+	{
+		assert(socket);
+
+		boost::system::error_code ec;
+
+		send_without_fragmentation(*socket, data, target, ec);
+
+		handler(ec);
+	}
+
 	uint32_t server::ep_hello_context_type::generate_unique_number()
 	{
 		// The first call to this function is *NOT* thread-safe in C++03 !
@@ -1010,23 +1212,22 @@ namespace fscp
 		return m_current_hello_unique_number++;
 	}
 
-	template <typename WaitHandler>
-	void server::ep_hello_context_type::async_wait_reply(boost::asio::io_service& io_service, uint32_t hello_unique_number, const boost::posix_time::time_duration& timeout, WaitHandler handler)
+	void server::ep_hello_context_type::async_wait_reply(timer_wheel& wheel, uint32_t hello_unique_number, const boost::posix_time::time_duration& timeout, timer_wheel::handler_type handler)
 	{
-		const boost::shared_ptr<boost::asio::deadline_timer> timer = boost::make_shared<boost::asio::deadline_timer>(boost::ref(io_service), timeout);
-
-		m_pending_requests[hello_unique_number] = pending_request_status(timer);
+		// The request must be registered before the timer can possibly fire.
+		pending_request_status& request = m_pending_requests[hello_unique_number];
 
-		timer->async_wait(handler);
+		request = pending_request_status();
+		request.timer_id = wheel.async_wait(timeout, handler);
 	}
 
-	bool server::ep_hello_context_type::cancel_reply_wait(uint32_t hello_unique_number, bool success)
+	bool server::ep_hello_context_type::cancel_reply_wait(timer_wheel& wheel, uint32_t hello_unique_number, bool success)
 	{
 		pending_requests_map::iterator request = m_pending_requests.find(hello_unique_number);
 
 		if (request != m_pending_requests.end())
 		{
-			if (request->second.timer->cancel() > 0)
+			if (wheel.cancel(request->second.timer_id))
 			{
 				// At least one handler was cancelled which means we can set the success flag.
 				request->second.success = success;
@@ -1038,11 +1239,11 @@ namespace fscp
 		return false;
 	}
 
-	void server::ep_hello_context_type::cancel_all_reply_wait()
+	void server::ep_hello_context_type::cancel_all_reply_wait(timer_wheel& wheel)
 	{
 		for (pending_requests_map::iterator request = m_pending_requests.begin(); request != m_pending_requests.end(); ++request)
 		{
-			if (request->second.timer->cancel() > 0)
+			if (wheel.cancel(request->second.timer_id))
 			{
 				// At least one handler was cancelled which means we can set the success flag.
 				request->second.success = false;
@@ -1117,7 +1318,7 @@ namespace fscp
 		// All do_greet() calls are done in the same strand so the following is thread-safe.
 		ep_hello_context_type& ep_hello_context = m_ep_hello_contexts[target];
 
-		ep_hello_context.async_wait_reply(get_io_service(), hello_unique_number, timeout, m_greet_strand.wrap(boost::bind(&server::do_greet_timeout, this, target, hello_unique_number, handler, _1)));
+		ep_hello_context.async_wait_reply(m_timer_wheel, hello_unique_number, timeout, m_greet_strand.wrap(boost::bind(&server::do_greet_timeout, this, target, hello_unique_number, handler, _1)));
 	}
 
 	void server::do_greet_timeout(const ep_type& target, uint32_t hello_unique_number, duration_handler_type handler, const boost::system::error_code& ec)
@@ -1156,7 +1357,7 @@ namespace fscp
 		// All do_cancel_all_greetings() calls are done in the same strand so the following is thread-safe.
 		for (ep_hello_context_map::iterator hello_context = m_ep_hello_contexts.begin(); hello_context != m_ep_hello_contexts.end(); ++hello_context)
 		{
-			hello_context->second.cancel_all_reply_wait();
+			hello_context->second.cancel_all_reply_wait(m_timer_wheel);
 		}
 	}
 
@@ -1224,7 +1425,7 @@ namespace fscp
 		// All do_handle_hello_response() calls are done in the same strand so the following is thread-safe.
 		ep_hello_context_type& ep_hello_context = m_ep_hello_contexts[sender];
 
-		ep_hello_context.cancel_reply_wait(hello_unique_number, true);
+		ep_hello_context.cancel_reply_wait(m_timer_wheel, hello_unique_number, true);
 	}
 
 	void server::do_set_accept_hello_messages_default(bool value, void_handler_type handler)
@@ -1444,7 +1645,16 @@ namespace fscp
 			return;
 		}
 
-		peer_session& p_session = m_peer_sessions[target];
+		peer_session* const session = get_or_create_peer_session(target);
+
+		if (!session)
+		{
+			handler(server_error::too_many_sessions);
+
+			return;
+		}
+
+		peer_session& p_session = *session;
 
 		if (p_session.has_current_session())
 		{
@@ -1494,7 +1704,9 @@ namespace fscp
 	{
 		// All do_close_session() calls are done in the same strand so the following is thread-safe.
 
-		if (m_peer_sessions[target].clear())
+		peer_session* const p_session = get_peer_session(target);
+
+		if (p_session && p_session->clear())
 		{
 			handler(server_error::success);
 
@@ -1549,7 +1761,18 @@ namespace fscp
 		// All do_handle_verified_session_request() calls are done in the session strand so the following is thread-safe.
 
 		// Get the associated session, creating one if none exists.
-		peer_session& p_session = m_peer_sessions[sender];
+		peer_session* const session = get_or_create_peer_session(sender);
+
+		if (!session)
+		{
+			m_logger(log_level::warning) << "Received a SESSION_REQUEST from " << sender << " but the maximum count of sessions was reached. Ignoring.";
+
+			++m_rejected_message_count;
+
+			return;
+		}
+
+		peer_session& p_session = *session;
 
 		if (!p_session.set_first_remote_host_identifier(_session_request_message.host_identifier()))
 		{
@@ -1615,6 +1838,48 @@ namespace fscp
 		}
 	}
 
+	protocol_capabilities_type server::get_local_capabilities() const
+	{
+		// AGGREGATED_DATA messages are always understood and PATH_MTU_PROBE messages always answered, even if we don't send them.
+		return PROTOCOL_CAPABILITY_AGGREGATED_DATA | PROTOCOL_CAPABILITY_PATH_MTU_PROBE | PROTOCOL_CAPABILITY_SESSION_CONFIRMATION | (m_compact_data_framing ? PROTOCOL_CAPABILITY_COMPACT_DATA : 0) | (m_fragmentation ? PROTOCOL_CAPABILITY_FRAGMENT : 0);
+	}
+
+	peer_session* server::get_peer_session(const ep_type& host)
+	{
+		// All get_peer_session() calls are done in the same strand so the following is thread-safe.
+		const peer_session_map_type::iterator p_session = m_peer_sessions.find(host);
+
+		return (p_session != m_peer_sessions.end()) ? &p_session->second : nullptr;
+	}
+
+	peer_session* server::get_or_create_peer_session(const ep_type& host)
+	{
+		// All get_or_create_peer_session() calls are done in the same strand so the following is thread-safe.
+		peer_session* const p_session = get_peer_session(host);
+
+		if (p_session)
+		{
+			return p_session;
+		}
+
+		if (m_peer_sessions.size() >= m_max_peer_session_count)
+		{
+			// Make room by forgetting a host we have no session nor handshake with.
+			const peer_session_map_type::iterator idle_session = std::find_if(m_peer_sessions.begin(), m_peer_sessions.end(), [](const peer_session_map_type::value_type& item) {
+				return !item.second.has_current_session() && !item.second.next_session();
+			});
+
+			if (idle_session == m_peer_sessions.end())
+			{
+				return nullptr;
+			}
+
+			m_peer_sessions.erase(idle_session);
+		}
+
+		return &m_peer_sessions[host];
+	}
+
 	std::set<server::ep_type> server::get_session_endpoints() const
 	{
 		// All get_session_endpoints() calls are done in the same strand so the following is thread-safe.
@@ -1705,7 +1970,11 @@ namespace fscp
 		// All do_send_session() calls are done in the session strand so the following is thread-safe.
 		m_logger(log_level::trace) << "Sending session message to " << target << " (session number: " << parameters.session_number << ", cipher suite: " << parameters.cipher_suite << ", elliptic curve: " << parameters.elliptic_curve << ").";
 
-		peer_session& p_session = m_peer_sessions[target];
+		peer_session* const p_session = get_peer_session(target);
+
+		// The session state is always created before a session is sent.
+		assert(p_session);
+
 		const auto send_buffer = SharedBuffer(65536);
 
 		try
@@ -1714,12 +1983,13 @@ namespace fscp
 				buffer_cast<uint8_t*>(send_buffer),
 				buffer_size(send_buffer),
 				parameters.session_number,
-				p_session.local_host_identifier(),
+				p_session->local_host_identifier(),
 				parameters.cipher_suite,
 				parameters.elliptic_curve,
 				buffer_cast<const void*>(parameters.public_key),
 				buffer_size(parameters.public_key),
-				identity.signature_key()
+				identity.signature_key(),
+				get_local_capabilities()
 			);
 
 			async_send_to(
@@ -1742,6 +2012,84 @@ namespace fscp
 		}
 	}
 
+	void server::do_rekey(const identity_store& identity, const ep_type& target, const host_identifier_type& local_host_identifier, boost::shared_ptr<peer_session::next_session_type> next_session, session_number_type session_number, cipher_suite_type cipher_suite, elliptic_curve_type elliptic_curve)
+	{
+		// This is called outside of any strand: it must not access the peer sessions.
+		try
+		{
+			if (!next_session)
+			{
+				next_session = boost::make_shared<peer_session::next_session_type>(session_number, cipher_suite, elliptic_curve);
+			}
+
+			const peer_session::session_parameters& parameters = next_session->parameters;
+			const auto send_buffer = SharedBuffer(65536);
+
+			const size_t size = session_message::write(
+				buffer_cast<uint8_t*>(send_buffer),
+				buffer_size(send_buffer),
+				parameters.session_number,
+				local_host_identifier,
+				parameters.cipher_suite,
+				parameters.elliptic_curve,
+				buffer_cast<const void*>(parameters.public_key),
+				buffer_size(parameters.public_key),
+				identity.signature_key()
+			);
+
+			m_session_strand.post(boost::bind(&server::do_handle_rekey, this, target, next_session, send_buffer, size));
+		}
+		catch (const std::exception& ex)
+		{
+			// The renewal will be started again after SESSION_REKEY_RETRY_PERIOD.
+			m_logger(log_level::error) << "Error renewing the session with " << target << ": " << ex.what() << ".";
+		}
+	}
+
+	void server::do_handle_rekey(const ep_type& target, boost::shared_ptr<peer_session::next_session_type> next_session, SharedBuffer send_buffer, size_t size)
+	{
+		// All do_handle_rekey() calls are done in the session strand so the following is thread-safe.
+		const peer_session_map_type::iterator p_session = m_peer_sessions.find(target);
+
+		if ((p_session == m_peer_sessions.end()) || !p_session->second.has_current_session())
+		{
+			m_logger(log_level::trace) << "Renewed a session with " << target << " but the session was lost in the meantime. Ignoring.";
+
+			return;
+		}
+
+		if (next_session->parameters.session_number <= p_session->second.current_session().parameters.session_number)
+		{
+			m_logger(log_level::trace) << "Renewed a session with " << target << " but it was renewed in the meantime. Ignoring.";
+
+			return;
+		}
+
+		if (!p_session->second.prepare_session(next_session))
+		{
+			// The peer started a renewal too and we already replied to it: the current keys stay in use until it completes.
+			m_logger(log_level::trace) << "Renewed a session with " << target << " but another renewal is in progress. Ignoring.";
+
+			return;
+		}
+
+		m_logger(log_level::trace) << "Sending session message to " << target << " (session number: " << next_session->parameters.session_number << ", cipher suite: " << next_session->parameters.cipher_suite << ", elliptic curve: " << next_session->parameters.elliptic_curve << ").";
+
+		async_send_to(
+			buffer(send_buffer, size),
+			target,
+			make_shared_buffer_handler(
+				send_buffer,
+				boost::bind(
+					&server::handle_send_to,
+					this,
+					boost::asio::placeholders::error,
+					boost::asio::placeholders::bytes_transferred
+				)
+			)
+		);
+	}
+
 	void server::do_handle_session(SharedBuffer data, const identity_store& identity, const ep_type& sender, const session_message& _session_message)
 	{
 		// All do_handle_session() calls are done in the same strand so the following is thread-safe.
@@ -1780,7 +2128,18 @@ namespace fscp
 	void server::do_handle_verified_session(const identity_store& identity, const ep_type& sender, const session_message& _session_message)
 	{
 		// All do_handle_verified_session() calls are done in the session strand so the following is thread-safe.
-		peer_session& p_session = m_peer_sessions[sender];
+		peer_session* const session = get_or_create_peer_session(sender);
+
+		if (!session)
+		{
+			m_logger(log_level::warning) << "Received a SESSION from " << sender << " but the maximum count of sessions was reached. Ignoring.";
+
+			++m_rejected_message_count;
+
+			return;
+		}
+
+		peer_session& p_session = *session;
 
 		if (!p_session.set_first_remote_host_identifier(_session_message.host_identifier()))
 		{
@@ -1846,10 +2205,16 @@ namespace fscp
 		else
 		{
 			bool session_completed = true;
+			bool session_confirmed = false;
 
 			try
 			{
-				if (!p_session.complete_session(_session_message.public_key(), _session_message.public_key_size()))
+				if (p_session.complete_session(_session_message.public_key(), _session_message.public_key_size()))
+				{
+					// We had sent our public key already: the remote host replied with its own so it has the session keys too.
+					session_confirmed = true;
+				}
+				else
 				{
 					m_logger(log_level::trace) << "Received a SESSION from " << sender << " with session number " << _session_message.session_number() << " but no session was prepared yet. Preparing a new one.";
 
@@ -1879,9 +2244,33 @@ namespace fscp
 
 			if (session_completed)
 			{
+				// The capabilities are covered by the signature and are only taken from the SESSION that established the session: replayed ones were ignored above.
+				p_session.set_remote_capabilities(_session_message.capabilities());
+
+				// Older hosts drop the previous keys as soon as they complete the session and never confirm the new one: we must not wait for them.
+				if (!p_session.has_remote_capability(PROTOCOL_CAPABILITY_SESSION_CONFIRMATION))
+				{
+					p_session.confirm_current_session();
+				}
+
 				m_logger(log_level::trace) << "Session established with " << sender << ". Sending acknowledgement session message back.";
 
 				do_send_session(identity, sender, p_session.current_session_parameters());
+				do_schedule_keep_alive(sender);
+
+				if (m_path_mtu_discovery && p_session.has_remote_capability(PROTOCOL_CAPABILITY_PATH_MTU_PROBE) && (p_session.path_mtu() == 0))
+				{
+					// The remote host may not have the session keys yet: the first probe would be lost for no reason.
+					do_schedule_path_mtu_discovery(sender, PATH_MTU_PROBE_TIMEOUT, false);
+				}
+
+				if (session_confirmed && p_session.has_previous_session())
+				{
+					p_session.confirm_current_session();
+
+					// The remote host keeps sending with the previous session until it receives something with the current one.
+					do_send_keep_alive(sender, &null_simple_handler);
+				}
 
 				if (m_session_established_handler)
 				{
@@ -1957,12 +2346,30 @@ namespace fscp
 		}
 	}
 
+	void server::do_set_path_mtu_discovered_callback(path_mtu_discovered_handler_type callback, void_handler_type handler)
+	{
+		// All do_set_path_mtu_discovered_callback() calls are done in the same strand so the following is thread-safe.
+		set_path_mtu_discovered_callback(callback);
+
+		if (handler)
+		{
+			handler();
+		}
+	}
+
 	void server::do_send_data(const ep_type& target, channel_number_type channel_number, boost::asio::const_buffer data, simple_handler_type handler)
 	{
 		// All do_send_data() calls are done in the session strand so the following is thread-safe.
-		peer_session& p_session = m_peer_sessions[target];
+		peer_session* const p_session = get_peer_session(target);
 
-		do_send_data_to_session(p_session, target, channel_number, data, handler);
+		if (!p_session)
+		{
+			handler(server_error::no_session_for_host);
+
+			return;
+		}
+
+		do_send_data_to_session(*p_session, target, channel_number, data, handler);
 	}
 
 	void server::do_send_data_to_list(const std::set<ep_type>& targets, channel_number_type channel_number, boost::asio::const_buffer data, multiple_endpoints_handler_type handler)
@@ -2004,6 +2411,19 @@ namespace fscp
 			return;
 		}
 
+		if (m_data_aggregation)
+		{
+			if (p_session.has_remote_capability(PROTOCOL_CAPABILITY_AGGREGATED_DATA) && (AGGREGATED_FRAME_HEADER_LENGTH + buffer_size(data) <= get_max_aggregated_data_size(p_session, target)))
+			{
+				do_aggregate_data(p_session, target, channel_number, data, handler);
+
+				return;
+			}
+
+			// The frames that are waiting must go first.
+			do_flush_aggregated_data(p_session, target);
+		}
+
 		const auto send_buffer = SharedBuffer(65536);
 
 		try
@@ -2013,26 +2433,17 @@ namespace fscp
 				buffer_size(send_buffer),
 				channel_number,
 				p_session.increment_local_sequence_number(),
-				p_session.current_session().parameters.cipher_suite.to_cipher_algorithm(),
+				p_session.sending_session().parameters.cipher_suite.to_cipher_algorithm(),
 				buffer_cast<const uint8_t*>(data),
 				buffer_size(data),
-				buffer_cast<const uint8_t*>(p_session.current_session().local_session_key),
-				buffer_size(p_session.current_session().local_session_key),
-				buffer_cast<const uint8_t*>(p_session.current_session().local_nonce_prefix),
-				buffer_size(p_session.current_session().local_nonce_prefix)
+				buffer_cast<const uint8_t*>(p_session.sending_session().local_session_key),
+				buffer_size(p_session.sending_session().local_session_key),
+				buffer_cast<const uint8_t*>(p_session.sending_session().local_nonce_prefix),
+				buffer_size(p_session.sending_session().local_nonce_prefix),
+				get_data_framing(p_session)
 			);
 
-			async_send_to(
-				buffer(send_buffer, size),
-				target,
-				make_shared_buffer_handler(
-					send_buffer,
-					boost::bind(
-						handler,
-						boost::asio::placeholders::error
-					)
-				)
-			);
+			do_send_datagram_to_session(p_session, target, send_buffer, size, handler);
 		}
 		catch (const boost::system::system_error& ex)
 		{
@@ -2040,22 +2451,174 @@ namespace fscp
 		}
 	}
 
-	void server::do_send_contact_request(const ep_type& target, const hash_list_type& hash_list, simple_handler_type handler)
+	void server::do_aggregate_data(peer_session& p_session, const ep_type& target, channel_number_type channel_number, boost::asio::const_buffer data, simple_handler_type handler)
 	{
-		// All do_send_contact_request() calls are done in the session strand so the following is thread-safe.
-		peer_session& p_session = m_peer_sessions[target];
+		// All do_aggregate_data() calls are done in the session strand so the following is thread-safe.
+		const size_t frame_len = AGGREGATED_FRAME_HEADER_LENGTH + buffer_size(data);
+		pending_aggregate_map_type::iterator aggregate = m_pending_aggregates.find(target);
 
-		do_send_contact_request_to_session(p_session, target, hash_list, handler);
-	}
+		if ((aggregate != m_pending_aggregates.end()) && (aggregate->second.frames.size() + frame_len > get_max_aggregated_data_size(p_session, target)))
+		{
+			// The frame doesn't fit anymore: we send what we have and start a new aggregate.
+			do_flush_aggregated_data(p_session, target);
+			aggregate = m_pending_aggregates.end();
+		}
 
-	void server::do_send_contact_request_to_list(const std::set<ep_type>& targets, const hash_list_type& hash_list, multiple_endpoints_handler_type handler)
-	{
-		// All do_send_contact_request_to_list() calls are done in the same strand so the following is thread-safe.
-		typedef results_gatherer<ep_type, boost::system::error_code, multiple_endpoints_handler_type> results_gatherer_type;
+		if (aggregate == m_pending_aggregates.end())
+		{
+			aggregate = m_pending_aggregates.insert(std::make_pair(target, pending_aggregate_type())).first;
+		}
 
-		boost::shared_ptr<results_gatherer_type> rg = boost::make_shared<results_gatherer_type>(handler, targets);
+		std::vector<uint8_t>& frames = aggregate->second.frames;
+		const size_t offset = frames.size();
 
-		for (auto&& item: m_peer_sessions)
+		frames.resize(offset + frame_len);
+		data_message::write_aggregated_frame(&frames[offset], frame_len, channel_number, buffer_cast<const uint8_t*>(data), buffer_size(data));
+
+		// The handlers are called once the aggregate is sent, so that the caller keeps the ownership of its buffers as long as it would without aggregation.
+		aggregate->second.handlers.push_back(handler);
+
+		if (!m_aggregation_flush_scheduled)
+		{
+			m_aggregation_flush_scheduled = true;
+
+			if (m_data_aggregation_delay <= boost::posix_time::time_duration())
+			{
+				// This runs after the sends that are already queued in the strand, which is where the frames to aggregate come from.
+				m_session_strand.post(boost::bind(&server::do_flush_all_aggregated_data, this));
+			}
+			else
+			{
+				m_aggregation_timer.expires_from_now(m_data_aggregation_delay);
+				m_aggregation_timer.async_wait(m_session_strand.wrap(boost::bind(&server::do_flush_all_aggregated_data, this)));
+			}
+		}
+	}
+
+	void server::do_flush_aggregated_data(peer_session& p_session, const ep_type& target)
+	{
+		// All do_flush_aggregated_data() calls are done in the session strand so the following is thread-safe.
+		const pending_aggregate_map_type::iterator aggregate = m_pending_aggregates.find(target);
+
+		if (aggregate == m_pending_aggregates.end())
+		{
+			return;
+		}
+
+		pending_aggregate_type pending;
+		std::swap(pending, aggregate->second);
+		m_pending_aggregates.erase(aggregate);
+
+		if (!m_socket.is_open())
+		{
+			call_all_handlers(pending.handlers, server_error::server_offline);
+
+			return;
+		}
+
+		if (!p_session.has_current_session())
+		{
+			call_all_handlers(pending.handlers, server_error::no_session_for_host);
+
+			return;
+		}
+
+		const auto send_buffer = SharedBuffer(65536);
+
+		try
+		{
+			size_t size = 0;
+
+			if (pending.handlers.size() == 1)
+			{
+				// A lone frame is sent as a regular DATA message, which is smaller.
+				const aggregated_frame_list_type frame_list = data_message::parse_aggregated_frames(&pending.frames[0], pending.frames.size());
+
+				size = data_message::write(
+					buffer_cast<uint8_t*>(send_buffer),
+					buffer_size(send_buffer),
+					frame_list.front().first,
+					p_session.increment_local_sequence_number(),
+					p_session.sending_session().parameters.cipher_suite.to_cipher_algorithm(),
+					boost::asio::buffer_cast<const uint8_t*>(frame_list.front().second),
+					boost::asio::buffer_size(frame_list.front().second),
+					buffer_cast<const uint8_t*>(p_session.sending_session().local_session_key),
+					buffer_size(p_session.sending_session().local_session_key),
+					buffer_cast<const uint8_t*>(p_session.sending_session().local_nonce_prefix),
+					buffer_size(p_session.sending_session().local_nonce_prefix),
+					get_data_framing(p_session)
+				);
+			}
+			else
+			{
+				size = data_message::write_aggregated_data(
+					buffer_cast<uint8_t*>(send_buffer),
+					buffer_size(send_buffer),
+					p_session.increment_local_sequence_number(),
+					p_session.sending_session().parameters.cipher_suite.to_cipher_algorithm(),
+					&pending.frames[0],
+					pending.frames.size(),
+					buffer_cast<const uint8_t*>(p_session.sending_session().local_session_key),
+					buffer_size(p_session.sending_session().local_session_key),
+					buffer_cast<const uint8_t*>(p_session.sending_session().local_nonce_prefix),
+					buffer_size(p_session.sending_session().local_nonce_prefix),
+					get_data_framing(p_session)
+				);
+			}
+
+			do_send_datagram_to_session(p_session, target, send_buffer, size, boost::bind(&call_all_handlers, pending.handlers, _1));
+		}
+		catch (const boost::system::system_error& ex)
+		{
+			call_all_handlers(pending.handlers, ex.code());
+		}
+	}
+
+	void server::do_flush_all_aggregated_data()
+	{
+		// All do_flush_all_aggregated_data() calls are done in the session strand so the following is thread-safe.
+		m_aggregation_flush_scheduled = false;
+
+		while (!m_pending_aggregates.empty())
+		{
+			const ep_type target = m_pending_aggregates.begin()->first;
+			peer_session* const p_session = get_peer_session(target);
+
+			if (p_session)
+			{
+				do_flush_aggregated_data(*p_session, target);
+			}
+			else
+			{
+				call_all_handlers(m_pending_aggregates.begin()->second.handlers, server_error::no_session_for_host);
+				m_pending_aggregates.erase(m_pending_aggregates.begin());
+			}
+		}
+	}
+
+	void server::do_send_contact_request(const ep_type& target, const hash_list_type& hash_list, simple_handler_type handler)
+	{
+		// All do_send_contact_request() calls are done in the session strand so the following is thread-safe.
+		peer_session* const p_session = get_peer_session(target);
+
+		if (!p_session)
+		{
+			handler(server_error::no_session_for_host);
+
+			return;
+		}
+
+		do_send_contact_request_to_session(*p_session, target, hash_list, handler);
+	}
+
+	void server::do_send_contact_request_to_list(const std::set<ep_type>& targets, const hash_list_type& hash_list, multiple_endpoints_handler_type handler)
+	{
+		// All do_send_contact_request_to_list() calls are done in the same strand so the following is thread-safe.
+		typedef results_gatherer<ep_type, boost::system::error_code, multiple_endpoints_handler_type> results_gatherer_type;
+
+		boost::shared_ptr<results_gatherer_type> rg = boost::make_shared<results_gatherer_type>(handler, targets);
+
+		for (auto&& item: m_peer_sessions)
 		{
 			if (targets.count(item.first) > 0)
 			{
@@ -2095,12 +2658,13 @@ namespace fscp
 				buffer_cast<uint8_t*>(send_buffer),
 				buffer_size(send_buffer),
 				p_session.increment_local_sequence_number(),
-				p_session.current_session().parameters.cipher_suite.to_cipher_algorithm(),
+				p_session.sending_session().parameters.cipher_suite.to_cipher_algorithm(),
 				hash_list,
-				buffer_cast<const uint8_t*>(p_session.current_session().local_session_key),
-				buffer_size(p_session.current_session().local_session_key),
-				buffer_cast<const uint8_t*>(p_session.current_session().local_nonce_prefix),
-				buffer_size(p_session.current_session().local_nonce_prefix)
+				buffer_cast<const uint8_t*>(p_session.sending_session().local_session_key),
+				buffer_size(p_session.sending_session().local_session_key),
+				buffer_cast<const uint8_t*>(p_session.sending_session().local_nonce_prefix),
+				buffer_size(p_session.sending_session().local_nonce_prefix),
+				get_data_framing(p_session)
 			);
 
 			async_send_to(
@@ -2124,9 +2688,16 @@ namespace fscp
 	void server::do_send_contact(const ep_type& target, const contact_map_type& contact_map, simple_handler_type handler)
 	{
 		// All do_send_contact() calls are done in the same strand so the following is thread-safe.
-		peer_session& p_session = m_peer_sessions[target];
+		peer_session* const p_session = get_peer_session(target);
 
-		do_send_contact_to_session(p_session, target, contact_map, handler);
+		if (!p_session)
+		{
+			handler(server_error::no_session_for_host);
+
+			return;
+		}
+
+		do_send_contact_to_session(*p_session, target, contact_map, handler);
 	}
 
 	void server::do_send_contact_to_list(const std::set<ep_type>& targets, const contact_map_type& contact_map, multiple_endpoints_handler_type handler)
@@ -2176,12 +2747,13 @@ namespace fscp
 				buffer_cast<uint8_t*>(send_buffer),
 				buffer_size(send_buffer),
 				p_session.increment_local_sequence_number(),
-				p_session.current_session().parameters.cipher_suite.to_cipher_algorithm(),
+				p_session.sending_session().parameters.cipher_suite.to_cipher_algorithm(),
 				contact_map,
-				buffer_cast<const uint8_t*>(p_session.current_session().local_session_key),
-				buffer_size(p_session.current_session().local_session_key),
-				buffer_cast<const uint8_t*>(p_session.current_session().local_nonce_prefix),
-				buffer_size(p_session.current_session().local_nonce_prefix)
+				buffer_cast<const uint8_t*>(p_session.sending_session().local_session_key),
+				buffer_size(p_session.sending_session().local_session_key),
+				buffer_cast<const uint8_t*>(p_session.sending_session().local_nonce_prefix),
+				buffer_size(p_session.sending_session().local_nonce_prefix),
+				get_data_framing(p_session)
 			);
 
 			async_send_to(
@@ -2202,75 +2774,154 @@ namespace fscp
 		}
 	}
 
-	void server::do_handle_data(const identity_store& identity, const ep_type& sender, const data_message& _data_message)
+	data_framing_type server::get_data_framing(const peer_session& p_session) const
+	{
+		if (m_compact_data_framing && p_session.has_remote_capability(PROTOCOL_CAPABILITY_COMPACT_DATA))
+		{
+			// The framing tells the remote host which of its sessions the message belongs to.
+			return to_compact_data_framing(p_session.sending_session().parameters.session_number);
+		}
+
+		return DATA_FRAMING_STANDARD;
+	}
+
+	size_t server::get_max_aggregated_data_size(const peer_session& p_session, const ep_type& target) const
+	{
+		// An aggregate that exceeds the path MTU gets fragmented, which defeats the purpose of aggregating.
+		const size_t path_mtu = (p_session.path_mtu() > 0) ? p_session.path_mtu() : MAX_PATH_MTU;
+		const size_t overhead = get_ip_udp_header_length(target) + data_message::overhead(get_data_framing(p_session));
+
+		return (path_mtu > overhead) ? std::min(m_max_aggregated_data_size, path_mtu - overhead) : 0;
+	}
+
+	template <typename DataMessageType>
+	void server::do_handle_data(const identity_store& identity, const ep_type& sender, const DataMessageType& _data_message)
 	{
 		// All do_handle_data() calls are done in the same strand so the following is thread-safe.
-		peer_session& p_session = m_peer_sessions[sender];
+		peer_session* const session = get_peer_session(sender);
 
-		if (!p_session.has_current_session())
+		// Unknown hosts are dropped early: anyone can send these messages so they must not create any state.
+		if (!session || !session->has_current_session())
 		{
 			m_logger(log_level::trace) << "Received a data message from " << sender << " but no session exists. Ignoring.";
 
-			return;
-		}
-
-		if (_data_message.sequence_number() <= p_session.current_session().remote_sequence_number)
-		{
-			// The message is outdated: we ignore it.
-			m_logger(log_level::trace) << "Received a data message from " << sender << " but its sequence number is outdated (received: " << _data_message.sequence_number() << ", expecting: " << p_session.current_session().remote_sequence_number << "). Ignoring.";
+			++m_rejected_message_count;
 
 			return;
 		}
 
+		peer_session& p_session = *session;
+
 		const auto cleartext_buffer = SharedBuffer(65536);
+		boost::optional<size_t> cleartext_len;
+		bool is_outdated = true;
 
-		try
+		if (_data_message.sequence_number() > p_session.current_session().remote_sequence_number)
 		{
-			const size_t cleartext_len = _data_message.get_cleartext(
-				buffer_cast<uint8_t*>(cleartext_buffer),
-				buffer_size(cleartext_buffer),
-				p_session.current_session().parameters.cipher_suite.to_cipher_algorithm(),
-				buffer_cast<const uint8_t*>(p_session.current_session().remote_session_key),
-				buffer_size(p_session.current_session().remote_session_key),
-				buffer_cast<const uint8_t*>(p_session.current_session().remote_nonce_prefix),
-				buffer_size(p_session.current_session().remote_nonce_prefix)
-			);
-
-			p_session.set_remote_sequence_number(_data_message.sequence_number());
-			p_session.keep_alive();
+			is_outdated = false;
+			cleartext_len = get_cleartext(_data_message, p_session.current_session(), cleartext_buffer);
 
-			if (p_session.current_session().is_old())
+			if (cleartext_len)
 			{
-				// do_send_clear_session() and do_handle_data() are to be invoked through the same strand, so this is fine.
-				p_session.prepare_session(p_session.next_session_number(), p_session.current_session().parameters.cipher_suite, p_session.current_session().parameters.elliptic_curve);
-				do_send_session(identity, sender, p_session.next_session_parameters());
+				p_session.set_remote_sequence_number(_data_message.sequence_number());
+
+				// The remote host sends with the current session: it has its keys.
+				p_session.confirm_current_session();
 			}
+		}
 
-			const message_type type = _data_message.type();
+		if (!cleartext_len && p_session.has_previous_session() && (_data_message.sequence_number() > p_session.previous_session().remote_sequence_number))
+		{
+			// The message may have been sent before the remote host switched to the current session.
+			is_outdated = false;
+			cleartext_len = get_cleartext(_data_message, p_session.previous_session(), cleartext_buffer);
 
-			if (type == MESSAGE_TYPE_KEEP_ALIVE)
+			if (cleartext_len)
 			{
-				// If the message is a keep alive then nothing is to be done and we avoid posting an empty call into the data strand.
-				return;
+				p_session.set_previous_remote_sequence_number(_data_message.sequence_number());
+			}
+		}
+
+		if (!cleartext_len)
+		{
+			if (is_outdated)
+			{
+				// The message is outdated: we ignore it.
+				m_logger(log_level::trace) << "Received a data message from " << sender << " but its sequence number is outdated (received: " << _data_message.sequence_number() << ", expecting: " << p_session.current_session().remote_sequence_number << "). Ignoring.";
 			}
+			else
+			{
+				m_logger(log_level::error) << "Error deciphering data message from " << sender << ": no session key matches. Ignoring.";
+			}
+
+			return;
+		}
 
-			// We don't need the original buffer at this point, so we just defer handling in another call so that it will free the buffer sooner and that it will allow parallel processing.
-			m_data_strand.post(
+		p_session.keep_alive();
+
+		if (p_session.current_session().is_old(m_rekey_threshold) && p_session.start_rekey(monotonic_clock::to_ticks(SESSION_REKEY_RETRY_PERIOD)))
+		{
+			m_logger(log_level::trace) << "Session with " << sender << " reached the renewal threshold. Renewing it in the background.";
+
+			// Generating the keys and signing the SESSION message are expensive: we don't do it in the session strand so that the data keeps flowing with the current keys.
+			get_io_service().post(
 				boost::bind(
-					&server::do_handle_data_message,
+					&server::do_rekey,
 					this,
+					identity,
 					sender,
-					type,
-					cleartext_buffer,
-					buffer(cleartext_buffer, cleartext_len)
+					p_session.local_host_identifier(),
+					p_session.next_session(),
+					p_session.next_session_number(),
+					p_session.current_session().parameters.cipher_suite,
+					p_session.current_session().parameters.elliptic_curve
 				)
 			);
 		}
-		catch (const boost::system::system_error& ex)
+
+		const message_type type = _data_message.type();
+
+		if (type == MESSAGE_TYPE_KEEP_ALIVE)
 		{
-			// This can happen if a message is decoded after a session rekeying.
-			m_logger(log_level::error) << "Error deciphering data message from " << sender << ": " << ex.what();
+			// If the message is a keep alive then nothing is to be done and we avoid posting an empty call into the data strand.
+			return;
 		}
+
+		if ((type == MESSAGE_TYPE_PATH_MTU_PROBE) || (type == MESSAGE_TYPE_PATH_MTU_REPLY))
+		{
+			// Those are about the session itself: they are handled right away, in the session strand.
+			try
+			{
+				const size_t path_mtu = data_message::parse_path_mtu(buffer_cast<const uint8_t*>(cleartext_buffer), *cleartext_len);
+
+				if (type == MESSAGE_TYPE_PATH_MTU_PROBE)
+				{
+					do_send_path_mtu_reply(sender, path_mtu);
+				}
+				else
+				{
+					do_handle_path_mtu_reply(sender, path_mtu);
+				}
+			}
+			catch (const std::runtime_error& ex)
+			{
+				m_logger(log_level::warning) << "Received an invalid path MTU message from " << sender << ": " << ex.what() << ". Ignoring.";
+			}
+
+			return;
+		}
+
+		// We don't need the original buffer at this point, so we just defer handling in another call so that it will free the buffer sooner and that it will allow parallel processing.
+		m_data_strand.post(
+			boost::bind(
+				&server::do_handle_data_message,
+				this,
+				sender,
+				type,
+				cleartext_buffer,
+				buffer(cleartext_buffer, *cleartext_len)
+			)
+		);
 	}
 
 	void server::do_handle_data_message(const ep_type& sender, message_type type, SharedBuffer buffer, boost::asio::const_buffer data)
@@ -2286,6 +2937,25 @@ namespace fscp
 				m_data_received_handler(sender, channel_number, buffer, data);
 			}
 		}
+		else if (type == MESSAGE_TYPE_AGGREGATED_DATA)
+		{
+			try
+			{
+				const aggregated_frame_list_type frame_list = data_message::parse_aggregated_frames(buffer_cast<const uint8_t*>(data), buffer_size(data));
+
+				if (m_data_received_handler)
+				{
+					for (auto&& frame: frame_list)
+					{
+						m_data_received_handler(sender, frame.first, buffer, frame.second);
+					}
+				}
+			}
+			catch (const std::runtime_error& ex)
+			{
+				m_logger(log_level::warning) << "Received an invalid aggregated data message from " << sender << ": " << ex.what() << ". Ignoring.";
+			}
+		}
 		else if (type == MESSAGE_TYPE_CONTACT_REQUEST)
 		{
 			const hash_list_type hash_list = data_message::parse_hash_list(buffer_cast<const uint8_t*>(data), buffer_size(data));
@@ -2388,31 +3058,87 @@ namespace fscp
 		}
 	}
 
-	void server::do_check_keep_alive(const boost::system::error_code& ec)
+	void server::do_schedule_keep_alive(const ep_type& target)
+	{
+		// All do_schedule_keep_alive() calls are done in the same strand so the following is thread-safe.
+		if (m_keep_alive_endpoints.insert(target).second)
+		{
+			m_timer_wheel.async_wait(m_keep_alive_period, m_session_strand.wrap(boost::bind(&server::do_check_keep_alive, this, target, _1)));
+		}
+	}
+
+	void server::do_schedule_all_keep_alives()
+	{
+		// All do_schedule_all_keep_alives() calls are done in the same strand so the following is thread-safe.
+		for (auto&& p_session: m_peer_sessions)
+		{
+			if (p_session.second.has_current_session())
+			{
+				do_schedule_keep_alive(p_session.first);
+			}
+		}
+	}
+
+	void server::do_forget_session_timers()
+	{
+		// All do_forget_session_timers() calls are done in the same strand so the following is thread-safe.
+		m_keep_alive_endpoints.clear();
+		m_path_mtu_revalidation_endpoints.clear();
+	}
+
+	void server::do_check_keep_alive(const ep_type& target, const boost::system::error_code& ec)
 	{
 		// All do_check_keep_alive() calls are done in the same strand so the following is thread-safe.
-		if (ec != boost::asio::error::operation_aborted)
+
+		// Keep-alive timers are only cancelled by close(), which forgets them all.
+		if (ec == boost::asio::error::operation_aborted)
+		{
+			return;
+		}
+
+		m_keep_alive_endpoints.erase(target);
+
+		if (!m_socket.is_open())
 		{
-			for (auto&& p_session: m_peer_sessions)
+			return;
+		}
+
+		const peer_session_map_type::iterator p_session = m_peer_sessions.find(target);
+
+		// Each session has its own timer, which stops once the session is gone.
+		if ((p_session == m_peer_sessions.end()) || !p_session->second.has_current_session())
+		{
+			return;
+		}
+
+		if (p_session->second.has_timed_out(m_session_timeout))
+		{
+			if (p_session->second.clear())
 			{
-				if (p_session.second.has_timed_out(SESSION_TIMEOUT))
-				{
-					if (p_session.second.clear())
-					{
-						if (m_session_lost_handler)
-						{
-							m_session_lost_handler(p_session.first, session_loss_reason::timeout);
-						}
-					}
-				}
-				else
+				if (m_session_lost_handler)
 				{
-					do_send_keep_alive(p_session.first, &null_simple_handler);
+					m_session_lost_handler(target, session_loss_reason::timeout);
 				}
 			}
+		}
+		else
+		{
+			// Any message sent during the period already told the peer that the session is alive.
+			if (!p_session->second.has_outbound_activity())
+			{
+				do_send_keep_alive(target, &null_simple_handler);
+			}
+
+			// The keep-alive itself must not count for the next period.
+			p_session->second.clear_outbound_activity();
+
+			// Messages sent with the previous session can't still be in flight after that long.
+			p_session->second.clear_previous_session(monotonic_clock::to_ticks(m_session_timeout));
+
+			// The datagrams that will never be completed must not hold memory until the next fragment comes.
+			p_session->second.reassembly().expire();
 
-			m_keep_alive_timer.expires_from_now(SESSION_KEEP_ALIVE_PERIOD);
-			m_keep_alive_timer.async_wait(m_session_strand.wrap(boost::bind(&server::do_check_keep_alive, this, boost::asio::placeholders::error)));
+			do_schedule_keep_alive(target);
 		}
 	}
 
@@ -2426,15 +3152,16 @@ namespace fscp
 			return;
 		}
 
-		peer_session& p_session = m_peer_sessions[target];
+		peer_session* const session = get_peer_session(target);
 
-		if (!p_session.has_current_session())
+		if (!session || !session->has_current_session())
 		{
 			handler(server_error::no_session_for_host);
 
 			return;
 		}
 
+		peer_session& p_session = *session;
 		const auto send_buffer = SharedBuffer(1024);
 
 		try
@@ -2443,12 +3170,13 @@ namespace fscp
 				buffer_cast<uint8_t*>(send_buffer),
 				buffer_size(send_buffer),
 				p_session.increment_local_sequence_number(),
-				p_session.current_session().parameters.cipher_suite.to_cipher_algorithm(),
+				p_session.sending_session().parameters.cipher_suite.to_cipher_algorithm(),
 				SESSION_KEEP_ALIVE_DATA_SIZE, // This is the count of random data to send.
-				buffer_cast<const uint8_t*>(p_session.current_session().local_session_key),
-				buffer_size(p_session.current_session().local_session_key),
-				buffer_cast<const uint8_t*>(p_session.current_session().local_nonce_prefix),
-				buffer_size(p_session.current_session().local_nonce_prefix)
+				buffer_cast<const uint8_t*>(p_session.sending_session().local_session_key),
+				buffer_size(p_session.sending_session().local_session_key),
+				buffer_cast<const uint8_t*>(p_session.sending_session().local_nonce_prefix),
+				buffer_size(p_session.sending_session().local_nonce_prefix),
+				get_data_framing(p_session)
 			);
 
 			async_send_to(
@@ -2469,6 +3197,419 @@ namespace fscp
 		}
 	}
 
+	void server::do_schedule_path_mtu_discovery(const ep_type& target, const boost::posix_time::time_duration& delay, bool is_revalidation)
+	{
+		// All do_schedule_path_mtu_discovery() calls are done in the same strand so the following is thread-safe.
+		if (!is_revalidation || m_path_mtu_revalidation_endpoints.insert(target).second)
+		{
+			m_timer_wheel.async_wait(delay, m_session_strand.wrap(boost::bind(&server::do_check_path_mtu_discovery, this, target, is_revalidation, _1)));
+		}
+	}
+
+	void server::do_schedule_all_path_mtu_discoveries()
+	{
+		// All do_schedule_all_path_mtu_discoveries() calls are done in the same strand so the following is thread-safe.
+		for (auto&& p_session: m_peer_sessions)
+		{
+			if (!p_session.second.has_current_session())
+			{
+				continue;
+			}
+
+			// The probe timers of a discovery that was in progress were cancelled: it starts over.
+			p_session.second.stop_path_mtu_discovery();
+
+			if (p_session.second.path_mtu() > 0)
+			{
+				do_schedule_path_mtu_discovery(p_session.first, PATH_MTU_REVALIDATION_PERIOD, true);
+			}
+			else if (m_path_mtu_discovery && p_session.second.has_remote_capability(PROTOCOL_CAPABILITY_PATH_MTU_PROBE))
+			{
+				do_schedule_path_mtu_discovery(p_session.first, PATH_MTU_PROBE_TIMEOUT, false);
+			}
+		}
+	}
+
+	void server::do_check_path_mtu_discovery(const ep_type& target, bool is_revalidation, const boost::system::error_code& ec)
+	{
+		// All do_check_path_mtu_discovery() calls are done in the same strand so the following is thread-safe.
+
+		// Path MTU discovery timers are only cancelled by close(), which forgets them all.
+		if (ec == boost::asio::error::operation_aborted)
+		{
+			return;
+		}
+
+		if (is_revalidation)
+		{
+			m_path_mtu_revalidation_endpoints.erase(target);
+		}
+
+		if (!m_socket.is_open())
+		{
+			return;
+		}
+
+		do_start_path_mtu_discovery(target);
+	}
+
+	void server::do_start_path_mtu_discovery(const ep_type& target)
+	{
+		// All do_start_path_mtu_discovery() calls are done in the same strand so the following is thread-safe.
+		peer_session* const session = get_peer_session(target);
+
+		// The discovery stops with the session: a new session starts its own.
+		if (!session || !session->has_current_session() || session->is_discovering_path_mtu())
+		{
+			return;
+		}
+
+		session->start_path_mtu_discovery(get_min_path_mtu(target), MAX_PATH_MTU, PATH_MTU_PRECISION);
+
+		do_send_path_mtu_probe(target);
+	}
+
+	void server::do_send_path_mtu_probe(const ep_type& target)
+	{
+		// All do_send_path_mtu_probe() calls are done in the same strand so the following is thread-safe.
+		peer_session* const session = get_peer_session(target);
+
+		if (!m_socket.is_open() || !session || !session->has_current_session() || !session->is_discovering_path_mtu())
+		{
+			return;
+		}
+
+		peer_session& p_session = *session;
+		const size_t path_mtu = p_session.path_mtu_probe_size();
+		const auto send_buffer = SharedBuffer(65536);
+
+		try
+		{
+			// The probe is padded so that the whole IP packet is exactly the size being probed for.
+			const size_t size = data_message::write_path_mtu_probe(
+				buffer_cast<uint8_t*>(send_buffer),
+				buffer_size(send_buffer),
+				p_session.increment_local_sequence_number(),
+				p_session.sending_session().parameters.cipher_suite.to_cipher_algorithm(),
+				path_mtu,
+				path_mtu - get_ip_udp_header_length(target),
+				buffer_cast<const uint8_t*>(p_session.sending_session().local_session_key),
+				buffer_size(p_session.sending_session().local_session_key),
+				buffer_cast<const uint8_t*>(p_session.sending_session().local_nonce_prefix),
+				buffer_size(p_session.sending_session().local_nonce_prefix),
+				get_data_framing(p_session)
+			);
+
+			const unsigned int probe_number = p_session.path_mtu_probe_sent();
+
+			async_send_path_mtu_probe_to(
+				buffer(send_buffer, size),
+				target,
+				make_shared_buffer_handler(
+					send_buffer,
+					m_session_strand.wrap(
+						boost::bind(
+							&server::do_handle_path_mtu_probe_sent,
+							this,
+							target,
+							probe_number,
+							boost::asio::placeholders::error
+						)
+					)
+				)
+			);
+
+			m_timer_wheel.async_wait(PATH_MTU_PROBE_TIMEOUT, m_session_strand.wrap(boost::bind(&server::do_check_path_mtu_probe, this, target, probe_number, _1)));
+		}
+		catch (const boost::system::system_error& ex)
+		{
+			m_logger(log_level::warning) << "Unable to send a path MTU probe to " << target << ": " << ex.what() << ". Stopping the path MTU discovery.";
+
+			p_session.stop_path_mtu_discovery();
+		}
+	}
+
+	void server::do_handle_path_mtu_probe_sent(const ep_type& target, unsigned int probe_number, const boost::system::error_code& ec)
+	{
+		// All do_handle_path_mtu_probe_sent() calls are done in the same strand so the following is thread-safe.
+
+		// Other errors, like a probe that is too large for the local interface, just count as a lost probe once it times out.
+		if (ec == boost::asio::error::operation_not_supported)
+		{
+			peer_session* const session = get_peer_session(target);
+
+			if (session && session->is_last_path_mtu_probe(probe_number))
+			{
+				m_logger(log_level::warning) << "Unable to send unfragmented datagrams to " << target << " on this system. Stopping the path MTU discovery.";
+
+				session->stop_path_mtu_discovery();
+			}
+		}
+	}
+
+	void server::do_check_path_mtu_probe(const ep_type& target, unsigned int probe_number, const boost::system::error_code& ec)
+	{
+		// All do_check_path_mtu_probe() calls are done in the same strand so the following is thread-safe.
+		if ((ec == boost::asio::error::operation_aborted) || !m_socket.is_open())
+		{
+			return;
+		}
+
+		peer_session* const session = get_peer_session(target);
+
+		// The probe was answered, or another one was sent since.
+		if (!session || !session->has_current_session() || !session->is_last_path_mtu_probe(probe_number))
+		{
+			return;
+		}
+
+		if (session->path_mtu_probe_lost(PATH_MTU_PROBE_ATTEMPTS))
+		{
+			do_handle_path_mtu_discovered(target);
+		}
+		else
+		{
+			do_send_path_mtu_probe(target);
+		}
+	}
+
+	void server::do_handle_path_mtu_reply(const ep_type& sender, size_t path_mtu)
+	{
+		// All do_handle_path_mtu_reply() calls are done in the same strand so the following is thread-safe.
+		peer_session* const session = get_peer_session(sender);
+
+		if (!session)
+		{
+			return;
+		}
+
+		const size_t probe_size = session->path_mtu_probe_size();
+
+		if (session->path_mtu_probe_replied(path_mtu))
+		{
+			do_handle_path_mtu_discovered(sender);
+		}
+		else if (session->path_mtu_probe_size() != probe_size)
+		{
+			// The reply was useful: we can move on to the next size without waiting for the pending probe to time out.
+			do_send_path_mtu_probe(sender);
+		}
+	}
+
+	void server::do_handle_path_mtu_discovered(const ep_type& target)
+	{
+		// All do_handle_path_mtu_discovered() calls are done in the same strand so the following is thread-safe.
+		peer_session* const session = get_peer_session(target);
+
+		assert(session);
+
+		const size_t path_mtu = session->path_mtu();
+
+		m_logger(log_level::debug) << "Path MTU to " << target << " is " << path_mtu << " bytes.";
+
+		if (m_path_mtu_discovered_handler)
+		{
+			m_path_mtu_discovered_handler(target, path_mtu);
+		}
+
+		// Routes change: the path MTU gets discovered again from time to time.
+		do_schedule_path_mtu_discovery(target, PATH_MTU_REVALIDATION_PERIOD, true);
+	}
+
+	void server::do_send_path_mtu_reply(const ep_type& target, size_t path_mtu)
+	{
+		// All do_send_path_mtu_reply() calls are done in the same strand so the following is thread-safe.
+		peer_session* const session = get_peer_session(target);
+
+		if (!m_socket.is_open() || !session || !session->has_current_session())
+		{
+			return;
+		}
+
+		peer_session& p_session = *session;
+		const auto send_buffer = SharedBuffer(1024);
+
+		try
+		{
+			const size_t size = data_message::write_path_mtu_reply(
+				buffer_cast<uint8_t*>(send_buffer),
+				buffer_size(send_buffer),
+				p_session.increment_local_sequence_number(),
+				p_session.sending_session().parameters.cipher_suite.to_cipher_algorithm(),
+				path_mtu,
+				buffer_cast<const uint8_t*>(p_session.sending_session().local_session_key),
+				buffer_size(p_session.sending_session().local_session_key),
+				buffer_cast<const uint8_t*>(p_session.sending_session().local_nonce_prefix),
+				buffer_size(p_session.sending_session().local_nonce_prefix),
+				get_data_framing(p_session)
+			);
+
+			async_send_to(
+				buffer(send_buffer, size),
+				target,
+				make_shared_buffer_handler(
+					send_buffer,
+					boost::bind(
+						&null_simple_handler,
+						boost::asio::placeholders::error
+					)
+				)
+			);
+		}
+		catch (const boost::system::system_error& ex)
+		{
+			m_logger(log_level::warning) << "Unable to answer a path MTU probe from " << target << ": " << ex.what() << ".";
+		}
+	}
+
+	void server::do_send_datagram_to_session(peer_session& p_session, const ep_type& target, SharedBuffer datagram, size_t datagram_len, simple_handler_type handler)
+	{
+		// All do_send_datagram_to_session() calls are done in the session strand so the following is thread-safe.
+		const size_t max_datagram_len = (p_session.path_mtu() > 0 ? p_session.path_mtu() : MAX_PATH_MTU) - get_ip_udp_header_length(target);
+
+		if (!m_fragmentation || !p_session.has_remote_capability(PROTOCOL_CAPABILITY_FRAGMENT) || (datagram_len <= max_datagram_len) || (datagram_len > std::numeric_limits<uint16_t>::max()))
+		{
+			async_send_to(
+				buffer(datagram, datagram_len),
+				target,
+				make_shared_buffer_handler(
+					datagram,
+					boost::bind(
+						handler,
+						boost::asio::placeholders::error
+					)
+				)
+			);
+
+			return;
+		}
+
+		// The fragments are made as even as possible so that none of them is tiny.
+		const size_t max_fragment_len = max_datagram_len - fragment_message::overhead();
+		const size_t fragment_count = (datagram_len + max_fragment_len - 1) / max_fragment_len;
+		const size_t fragment_len = (datagram_len + fragment_count - 1) / fragment_count;
+		const reassembly_buffer::datagram_id_type datagram_id = p_session.next_datagram_id();
+		const auto send_buffer = SharedBuffer(datagram_len + fragment_count * fragment_message::overhead());
+
+		size_t send_offset = 0;
+
+		for (size_t offset = 0; offset < datagram_len; offset += fragment_len)
+		{
+			const size_t data_len = std::min(fragment_len, datagram_len - offset);
+			const size_t size = fragment_message::write(
+				buffer_cast<uint8_t*>(send_buffer) + send_offset,
+				buffer_size(send_buffer) - send_offset,
+				datagram_id,
+				offset,
+				datagram_len,
+				buffer_cast<const uint8_t*>(datagram) + offset,
+				data_len
+			);
+
+			// The datagram is lost if any of its fragments is: reporting the result of the last one is as good as any.
+			const simple_handler_type fragment_handler = (offset + data_len == datagram_len) ? handler : simple_handler_type(&null_simple_handler);
+
+			async_send_to(
+				buffer(buffer_cast<uint8_t*>(send_buffer) + send_offset, size),
+				target,
+				make_shared_buffer_handler(
+					send_buffer,
+					boost::bind(
+						fragment_handler,
+						boost::asio::placeholders::error
+					)
+				)
+			);
+
+			send_offset += size;
+		}
+	}
+
+	void server::do_handle_fragment(const identity_store& identity, const ep_type& sender, const fragment_message& _fragment_message)
+	{
+		// All do_handle_fragment() calls are done in the same strand so the following is thread-safe.
+		peer_session* const session = get_peer_session(sender);
+
+		// Reassembly buffers hold memory: only the hosts we have a session with get one.
+		if (!session || !session->has_current_session())
+		{
+			m_logger(log_level::trace) << "Received a fragment from " << sender << " but no session exists. Ignoring.";
+
+			++m_rejected_message_count;
+
+			return;
+		}
+
+		const boost::optional<SharedBuffer> datagram = session->reassembly().add(
+			_fragment_message.datagram_id(),
+			_fragment_message.offset(),
+			_fragment_message.total_length(),
+			_fragment_message.data(),
+			_fragment_message.data_size()
+		);
+
+		if (!datagram)
+		{
+			return;
+		}
+
+		// The fragments are not authenticated: the reassembled datagram is, like any other DATA message.
+		const uint8_t* const buf = buffer_cast<const uint8_t*>(*datagram);
+		const size_t buf_len = buffer_size(*datagram);
+
+		try
+		{
+			if (compact_data_message::is_compact_data_message(buf, buf_len))
+			{
+				do_handle_data(identity, sender, compact_data_message(buf, buf_len));
+
+				return;
+			}
+
+			const message message(buf, buf_len);
+
+			switch (message.type())
+			{
+				case MESSAGE_TYPE_DATA_0:
+				case MESSAGE_TYPE_DATA_1:
+				case MESSAGE_TYPE_DATA_2:
+				case MESSAGE_TYPE_DATA_3:
+				case MESSAGE_TYPE_DATA_4:
+				case MESSAGE_TYPE_DATA_5:
+				case MESSAGE_TYPE_DATA_6:
+				case MESSAGE_TYPE_DATA_7:
+				case MESSAGE_TYPE_DATA_8:
+				case MESSAGE_TYPE_DATA_9:
+				case MESSAGE_TYPE_DATA_10:
+				case MESSAGE_TYPE_DATA_11:
+				case MESSAGE_TYPE_DATA_12:
+				case MESSAGE_TYPE_DATA_13:
+				case MESSAGE_TYPE_DATA_14:
+				case MESSAGE_TYPE_DATA_15:
+				case MESSAGE_TYPE_CONTACT_REQUEST:
+				case MESSAGE_TYPE_CONTACT:
+				case MESSAGE_TYPE_KEEP_ALIVE:
+				case MESSAGE_TYPE_AGGREGATED_DATA:
+				{
+					do_handle_data(identity, sender, data_message(message));
+
+					break;
+				}
+				default:
+				{
+					// Path MTU probes would prove nothing once reassembled and fragments can't be nested.
+					m_logger(log_level::trace) << "Reassembled a datagram of type " << static_cast<unsigned int>(message.type()) << " from " << sender << " that can't be fragmented. Ignoring.";
+
+					break;
+				}
+			}
+		}
+		catch (std::runtime_error&)
+		{
+			m_logger(log_level::trace) << "Reassembled an invalid datagram from " << sender << ". Ignoring.";
+		}
+	}
+
 	std::ostream& operator<<(std::ostream& os, server::session_loss_reason value)
 	{
 		switch (value)
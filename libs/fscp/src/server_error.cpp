@@ -86,6 +86,10 @@ namespace fscp
 			{
 				return "No session is available for the specified host";
 			}
+			case server_error::too_many_sessions:
+			{
+				return "The maximum count of sessions was reached";
+			}
 			default:
 			{
 				return "Unknown FSCP error";
@@ -0,0 +1,244 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file timer_wheel.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A hashed timer wheel.
+ */
+
+#include "timer_wheel.hpp"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+
+#include <cassert>
+
+namespace fscp
+{
+	const timer_wheel::timer_id_type timer_wheel::INVALID_TIMER_ID;
+
+	timer_wheel::timer_wheel(boost::asio::io_service& io_service, const boost::posix_time::time_duration& resolution, size_t slot_count) :
+		m_io_service(io_service),
+		m_timer(io_service),
+		m_resolution(resolution),
+		m_mutex(),
+		m_slots(slot_count),
+		m_entries(),
+		m_current_tick(0),
+		m_next_timer_id(INVALID_TIMER_ID + 1),
+		m_ticking(false),
+		m_ticking_generation(0)
+	{
+		assert(resolution.total_microseconds() > 0);
+		assert(slot_count > 0);
+	}
+
+	timer_wheel::timer_id_type timer_wheel::async_wait(const boost::posix_time::time_duration& timeout, handler_type handler)
+	{
+		const int64_t resolution = m_resolution.total_microseconds();
+		const int64_t duration = std::max<int64_t>(timeout.total_microseconds(), 0);
+
+		// A timer always waits for at least one tick: the current one is already under way.
+		const uint64_t ticks = std::max<uint64_t>(static_cast<uint64_t>((duration + resolution - 1) / resolution), 1);
+
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		const timer_id_type timer_id = m_next_timer_id++;
+		const uint64_t expiration_tick = m_current_tick + ticks;
+
+		m_entries.insert(std::make_pair(timer_id, entry_type(expiration_tick, handler)));
+		m_slots[expiration_tick % m_slots.size()].push_back(timer_id);
+
+		if (!m_ticking)
+		{
+			start_ticking();
+		}
+
+		return timer_id;
+	}
+
+	bool timer_wheel::cancel(timer_id_type timer_id)
+	{
+		handler_type handler;
+
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			const entry_map_type::iterator entry = m_entries.find(timer_id);
+
+			if (entry == m_entries.end())
+			{
+				return false;
+			}
+
+			handler = entry->second.handler;
+			m_entries.erase(entry);
+
+			if (m_entries.empty())
+			{
+				stop_ticking();
+			}
+		}
+
+		m_io_service.post(boost::bind(handler, boost::asio::error::make_error_code(boost::asio::error::operation_aborted)));
+
+		return true;
+	}
+
+	size_t timer_wheel::cancel_all()
+	{
+		entry_map_type entries;
+
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			entries.swap(m_entries);
+
+			stop_ticking();
+		}
+
+		for (auto&& entry : entries)
+		{
+			m_io_service.post(boost::bind(entry.second.handler, boost::asio::error::make_error_code(boost::asio::error::operation_aborted)));
+		}
+
+		return entries.size();
+	}
+
+	size_t timer_wheel::pending_count() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		return m_entries.size();
+	}
+
+	void timer_wheel::start_ticking()
+	{
+		// This must be called with the mutex held.
+		m_ticking = true;
+
+		m_timer.expires_from_now(m_resolution);
+		m_timer.async_wait(boost::bind(&timer_wheel::handle_tick, this, m_ticking_generation, boost::asio::placeholders::error));
+	}
+
+	void timer_wheel::stop_ticking()
+	{
+		// This must be called with the mutex held.
+		if (m_ticking)
+		{
+			m_ticking = false;
+
+			// A tick that already expired can't be cancelled anymore: the generation tells it to do nothing.
+			++m_ticking_generation;
+			m_timer.cancel();
+		}
+
+		// Some slots may still reference cancelled timers.
+		for (auto&& slot : m_slots)
+		{
+			slot.clear();
+		}
+	}
+
+	void timer_wheel::handle_tick(uint64_t ticking_generation, const boost::system::error_code& ec)
+	{
+		// The wheel might have been destroyed already.
+		if (ec == boost::asio::error::operation_aborted)
+		{
+			return;
+		}
+
+		std::vector<handler_type> expired_handlers;
+
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			if (ticking_generation != m_ticking_generation)
+			{
+				return;
+			}
+
+			++m_current_tick;
+
+			slot_type& slot = m_slots[m_current_tick % m_slots.size()];
+			slot_type::iterator last = slot.begin();
+
+			for (auto&& timer_id : slot)
+			{
+				const entry_map_type::iterator entry = m_entries.find(timer_id);
+
+				// The timer was cancelled.
+				if (entry == m_entries.end())
+				{
+					continue;
+				}
+
+				if (entry->second.expiration_tick <= m_current_tick)
+				{
+					expired_handlers.push_back(entry->second.handler);
+					m_entries.erase(entry);
+				}
+				else
+				{
+					// The timer expires on a later revolution.
+					*last++ = timer_id;
+				}
+			}
+
+			slot.erase(last, slot.end());
+
+			if (m_entries.empty())
+			{
+				stop_ticking();
+			}
+			else
+			{
+				// The next tick is scheduled relative to the previous deadline so that the wheel doesn't drift.
+				m_timer.expires_at(m_timer.expires_at() + m_resolution);
+				m_timer.async_wait(boost::bind(&timer_wheel::handle_tick, this, ticking_generation, boost::asio::placeholders::error));
+			}
+		}
+
+		for (auto&& handler : expired_handlers)
+		{
+			handler(boost::system::error_code());
+		}
+	}
+}
@@ -0,0 +1,261 @@
+/**
+ * \file checksum.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A checksum fuzzing and benchmark program.
+ *
+ * Checks every supported checksum kernel, the checksum helper and the
+ * incremental updates against a byte-wise reference implementation, then
+ * measures the throughput of each kernel.
+ */
+
+#include <asiotap/osi/checksum.hpp>
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+	const unsigned int FUZZ_ITERATIONS = 100000;
+	const size_t FUZZ_MAX_LENGTH = 4096;
+	const size_t BENCHMARK_TOTAL_SIZE = 1 << 30;
+
+	// The IPv4 header checksum offset, used to store the checksum in the incremental update tests.
+	const size_t CHECKSUM_OFFSET = 10;
+
+	namespace ao = asiotap::osi;
+
+	const ao::checksum_kernel KERNELS[] = { ao::checksum_kernel::scalar, ao::checksum_kernel::sse2, ao::checksum_kernel::avx2, ao::checksum_kernel::neon };
+
+	const char* kernel_name(ao::checksum_kernel kernel)
+	{
+		switch (kernel)
+		{
+			case ao::checksum_kernel::scalar:
+				return "scalar";
+			case ao::checksum_kernel::sse2:
+				return "sse2";
+			case ao::checksum_kernel::avx2:
+				return "avx2";
+			case ao::checksum_kernel::neon:
+				return "neon";
+		}
+
+		return "unknown";
+	}
+
+	// RFC 1071, one network order word at a time: the result is stored in the frame with htons().
+	uint16_t reference_checksum(const uint8_t* buf, size_t buf_len)
+	{
+		uint32_t sum = 0;
+
+		for (size_t i = 0; i < buf_len; i += 2)
+		{
+			sum += static_cast<uint32_t>(buf[i]) << 8;
+
+			if (i + 1 < buf_len)
+			{
+				sum += buf[i + 1];
+			}
+
+			sum = (sum & 0xFFFF) + (sum >> 16);
+		}
+
+		return htons(static_cast<uint16_t>(~sum));
+	}
+
+	bool fuzz_kernels(std::mt19937& gen, const std::vector<uint8_t>& data)
+	{
+		std::uniform_int_distribution<size_t> length_distribution(0, FUZZ_MAX_LENGTH / 2);
+		std::uniform_int_distribution<size_t> offset_distribution(0, 63);
+
+		for (unsigned int i = 0; i < FUZZ_ITERATIONS; ++i)
+		{
+			const size_t len = length_distribution(gen) * 2;
+			const uint8_t* buf = &data[offset_distribution(gen)];
+			const uint16_t expected = reference_checksum(buf, len);
+
+			for (auto kernel : KERNELS)
+			{
+				if (ao::is_checksum_kernel_supported(kernel))
+				{
+					const uint16_t result = static_cast<uint16_t>(~ao::fold_checksum(ao::add_checksum_words(kernel, buf, len, 0)));
+
+					if (result != expected)
+					{
+						std::cerr << "Kernel " << kernel_name(kernel) << " mismatch for " << len << " byte(s)" << std::endl;
+
+						return false;
+					}
+				}
+			}
+		}
+
+		return true;
+	}
+
+	bool fuzz_helper(std::mt19937& gen, const std::vector<uint8_t>& data)
+	{
+		std::uniform_int_distribution<size_t> length_distribution(0, FUZZ_MAX_LENGTH);
+		std::uniform_int_distribution<size_t> offset_distribution(0, 63);
+
+		for (unsigned int i = 0; i < FUZZ_ITERATIONS; ++i)
+		{
+			const size_t len = length_distribution(gen);
+			const uint8_t* buf = &data[offset_distribution(gen)];
+
+			// The buffer is fed in random chunks, which may have odd lengths.
+			ao::checksum_helper helper;
+
+			for (size_t offset = 0; offset < len;)
+			{
+				const size_t chunk = std::min(len - offset, std::uniform_int_distribution<size_t>(0, 100)(gen));
+
+				helper.update(reinterpret_cast<const uint16_t*>(buf + offset), chunk);
+				offset += chunk;
+			}
+
+			if (static_cast<uint16_t>(helper.compute()) != reference_checksum(buf, len))
+			{
+				std::cerr << "Helper mismatch for " << len << " byte(s)" << std::endl;
+
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool fuzz_update(std::mt19937& gen, const std::vector<uint8_t>& data)
+	{
+		std::uniform_int_distribution<size_t> length_distribution(CHECKSUM_OFFSET / 2 + 1, 750);
+		std::uniform_int_distribution<unsigned int> byte_distribution(0, 255);
+
+		for (unsigned int i = 0; i < FUZZ_ITERATIONS; ++i)
+		{
+			const size_t len = length_distribution(gen) * 2;
+			std::vector<uint8_t> buf(data.begin(), data.begin() + len);
+
+			uint16_t checksum = 0;
+			std::memcpy(&buf[CHECKSUM_OFFSET], &checksum, sizeof(checksum));
+			checksum = ao::compute_checksum(reinterpret_cast<const uint16_t*>(&buf[0]), len);
+			std::memcpy(&buf[CHECKSUM_OFFSET], &checksum, sizeof(checksum));
+
+			// Rewrite a 16-bit field, then a 4-bytes field, anywhere but on the checksum.
+			const size_t field_lengths[] = { 2, 4 };
+
+			for (auto field_length : field_lengths)
+			{
+				size_t offset = std::uniform_int_distribution<size_t>(0, (len - field_length) / 2)(gen) * 2;
+
+				if ((offset + field_length > CHECKSUM_OFFSET) && (offset < CHECKSUM_OFFSET + sizeof(checksum)))
+				{
+					offset = CHECKSUM_OFFSET + sizeof(checksum);
+				}
+
+				if (offset + field_length > len)
+				{
+					continue;
+				}
+
+				uint8_t old_field[4];
+				uint8_t new_field[4];
+				std::memcpy(old_field, &buf[offset], field_length);
+
+				for (size_t j = 0; j < field_length; ++j)
+				{
+					new_field[j] = static_cast<uint8_t>(byte_distribution(gen));
+				}
+
+				if (field_length == sizeof(uint16_t))
+				{
+					uint16_t old_value;
+					uint16_t new_value;
+					std::memcpy(&old_value, old_field, sizeof(old_value));
+					std::memcpy(&new_value, new_field, sizeof(new_value));
+
+					checksum = ao::update_checksum(checksum, old_value, new_value);
+				}
+				else
+				{
+					checksum = ao::update_checksum(checksum, old_field, new_field, field_length);
+				}
+
+				std::memcpy(&buf[offset], new_field, field_length);
+				std::memcpy(&buf[CHECKSUM_OFFSET], &checksum, sizeof(checksum));
+
+				if (ao::compute_checksum(reinterpret_cast<const uint16_t*>(&buf[0]), len) != 0)
+				{
+					std::cerr << "Incremental update mismatch for a " << field_length << " bytes field at offset " << offset << std::endl;
+
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	double measure(ao::checksum_kernel kernel, const std::vector<uint8_t>& data, size_t len, uint64_t& checksum)
+	{
+		const size_t iterations = BENCHMARK_TOTAL_SIZE / len;
+		const auto start = std::chrono::steady_clock::now();
+
+		for (size_t i = 0; i < iterations; ++i)
+		{
+			checksum += ao::fold_checksum(ao::add_checksum_words(kernel, &data[i % 64], len, 0));
+		}
+
+		const auto duration = std::chrono::steady_clock::now() - start;
+
+		return static_cast<double>(iterations * len) / std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+	}
+}
+
+int main()
+{
+	std::mt19937 gen(42);
+	std::uniform_int_distribution<unsigned int> byte_distribution(0, 255);
+
+	std::vector<uint8_t> data(65536 + 64);
+
+	for (auto&& byte : data)
+	{
+		byte = static_cast<uint8_t>(byte_distribution(gen));
+	}
+
+	if (!fuzz_kernels(gen, data) || !fuzz_helper(gen, data) || !fuzz_update(gen, data))
+	{
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "Fuzzing: OK" << std::endl;
+	std::cout << "Selected kernel: " << kernel_name(ao::get_checksum_kernel()) << std::endl;
+
+	uint64_t checksum = 0;
+	const size_t lengths[] = { 20, 64, 1500, 65536 };
+
+	for (auto kernel : KERNELS)
+	{
+		if (ao::is_checksum_kernel_supported(kernel))
+		{
+			std::cout << kernel_name(kernel) << ":";
+
+			for (auto len : lengths)
+			{
+				std::cout << " " << len << " bytes: " << measure(kernel, data, len, checksum) << " GB/s";
+			}
+
+			std::cout << std::endl;
+		}
+	}
+
+	std::cout << "Checksum: " << checksum << std::endl;
+
+	return EXIT_SUCCESS;
+}
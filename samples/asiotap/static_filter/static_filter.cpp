@@ -0,0 +1,165 @@
+/**
+ * \file static_filter.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A filter chain benchmark program.
+ *
+ * Compares the runtime composed filters with the static filters on a DHCP
+ * frame chain.
+ */
+
+#include <asiotap/osi/ethernet_builder.hpp>
+#include <asiotap/osi/ipv4_builder.hpp>
+#include <asiotap/osi/udp_builder.hpp>
+#include <asiotap/osi/bootp_builder.hpp>
+#include <asiotap/osi/dhcp_builder.hpp>
+#include <asiotap/osi/ethernet_filter.hpp>
+#include <asiotap/osi/ipv4_filter.hpp>
+#include <asiotap/osi/udp_filter.hpp>
+#include <asiotap/osi/bootp_filter.hpp>
+#include <asiotap/osi/dhcp_filter.hpp>
+#include <asiotap/osi/complex_filter.hpp>
+#include <asiotap/osi/static_filter.hpp>
+
+#include <boost/array.hpp>
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	const unsigned int PARSES_COUNT = 1000000;
+
+	namespace ao = asiotap::osi;
+
+	typedef boost::array<uint8_t, 2048> frame_buffer_type;
+
+	boost::asio::const_buffer build_dhcp_frame(frame_buffer_type& frame_buffer, uint16_t destination_port)
+	{
+		const boost::array<uint8_t, ao::ETHERNET_ADDRESS_SIZE> hardware_address = {{ 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 }};
+		const boost::array<uint8_t, ao::ETHERNET_ADDRESS_SIZE> broadcast_address = {{ 0xff, 0xff, 0xff, 0xff, 0xff, 0xff }};
+		const boost::asio::mutable_buffer buf = boost::asio::buffer(frame_buffer);
+
+		ao::builder<ao::dhcp_frame> dhcp_builder(buf);
+		dhcp_builder.add_option(ao::dhcp_option::dhcp_message_type, ao::DHCP_DISCOVER_MESSAGE);
+		dhcp_builder.add_option(ao::dhcp_option::end);
+		dhcp_builder.complete_padding(60);
+		size_t payload_size = dhcp_builder.write();
+
+		ao::builder<ao::bootp_frame> bootp_builder(buf, payload_size);
+		payload_size = bootp_builder.write(
+		                   ao::BOOTP_BOOTREQUEST,
+		                   1,
+		                   static_cast<uint8_t>(hardware_address.size()),
+		                   0,
+		                   0x12345678,
+		                   0,
+		                   0,
+		                   boost::asio::ip::address_v4::any(),
+		                   boost::asio::ip::address_v4::any(),
+		                   boost::asio::ip::address_v4::any(),
+		                   boost::asio::ip::address_v4::any(),
+		                   boost::asio::buffer(hardware_address),
+		                   boost::asio::const_buffer(NULL, 0),
+		                   boost::asio::const_buffer(NULL, 0)
+		               );
+
+		ao::builder<ao::udp_frame> udp_builder(buf, payload_size);
+		payload_size = udp_builder.write(68, destination_port);
+
+		ao::builder<ao::ipv4_frame> ipv4_builder(buf, payload_size);
+		payload_size = ipv4_builder.write(
+		                   0,
+		                   0,
+		                   0,
+		                   0,
+		                   64,
+		                   ao::UDP_PROTOCOL,
+		                   boost::asio::ip::address_v4::any(),
+		                   boost::asio::ip::address_v4::broadcast()
+		               );
+
+		udp_builder.update_checksum(ipv4_builder.get_helper());
+
+		ao::builder<ao::ethernet_frame> ethernet_builder(buf, payload_size);
+		payload_size = ethernet_builder.write(boost::asio::buffer(broadcast_address), boost::asio::buffer(hardware_address), ao::IP_PROTOCOL);
+
+		return buf + (boost::asio::buffer_size(buf) - payload_size);
+	}
+
+	template <typename Function>
+	double measure(const std::vector<boost::asio::const_buffer>& frames, unsigned int& checksum, Function function)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		for (unsigned int i = 0; i < PARSES_COUNT; ++i)
+		{
+			checksum += function(frames[i % frames.size()]);
+		}
+
+		const auto duration = std::chrono::steady_clock::now() - start;
+
+		return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()) / PARSES_COUNT;
+	}
+}
+
+int main()
+{
+	typedef ao::complex_static_filter<ao::dhcp_frame, ao::bootp_frame, ao::udp_frame, ao::ipv4_frame, ao::ethernet_frame>::type dhcp_static_filter_type;
+
+	ao::filter<ao::ethernet_frame> ethernet_filter;
+	ao::complex_filter<ao::ipv4_frame, ao::ethernet_frame>::type ipv4_filter(ethernet_filter);
+	ao::complex_filter<ao::udp_frame, ao::ipv4_frame, ao::ethernet_frame>::type udp_filter(ipv4_filter);
+	ao::complex_filter<ao::bootp_frame, ao::udp_frame, ao::ipv4_frame, ao::ethernet_frame>::type bootp_filter(udp_filter);
+	ao::complex_filter<ao::dhcp_frame, ao::bootp_frame, ao::udp_frame, ao::ipv4_frame, ao::ethernet_frame>::type dhcp_filter(bootp_filter);
+
+	// A DHCP frame, a frame that stops at the UDP layer and a truncated frame.
+	frame_buffer_type dhcp_frame_buffer;
+	frame_buffer_type other_frame_buffer;
+
+	const boost::asio::const_buffer dhcp_frame = build_dhcp_frame(dhcp_frame_buffer, ao::BOOTP_PROTOCOL);
+	const boost::asio::const_buffer other_frame = build_dhcp_frame(other_frame_buffer, 53);
+
+	std::vector<boost::asio::const_buffer> frames;
+	frames.push_back(dhcp_frame);
+	frames.push_back(other_frame);
+	frames.push_back(boost::asio::buffer(dhcp_frame, sizeof(ao::ethernet_frame) + sizeof(ao::ipv4_frame) + 4));
+
+	const auto dynamic_parse = [&](boost::asio::const_buffer frame) -> unsigned int {
+		ethernet_filter.parse(frame);
+
+		const bool result = static_cast<bool>(dhcp_filter.get_last_helper());
+		dhcp_filter.clear_last_helper();
+
+		return result ? 1 : 0;
+	};
+
+	const auto static_parse = [](boost::asio::const_buffer frame) -> unsigned int {
+		return dhcp_static_filter_type::parse(frame, [](ao::const_helper<ao::dhcp_frame>, ao::const_helper<ao::bootp_frame>, ao::const_helper<ao::udp_frame>, ao::const_helper<ao::ipv4_frame>, ao::const_helper<ao::ethernet_frame>) {
+			return true;
+		}) ? 1 : 0;
+	};
+
+	for (auto&& frame : frames)
+	{
+		if (dynamic_parse(frame) != static_parse(frame))
+		{
+			std::cerr << "Mismatch for a frame of " << boost::asio::buffer_size(frame) << " byte(s)" << std::endl;
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	unsigned int checksum = 0;
+
+	const double dynamic_duration = measure(frames, checksum, dynamic_parse);
+	const double static_duration = measure(frames, checksum, static_parse);
+
+	std::cout << "Complex filter: " << dynamic_duration << " ns/frame" << std::endl;
+	std::cout << "Static filter: " << static_duration << " ns/frame" << std::endl;
+	std::cout << "Checksum: " << checksum << std::endl;
+
+	return EXIT_SUCCESS;
+}
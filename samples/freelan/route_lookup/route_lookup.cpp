@@ -0,0 +1,148 @@
+/**
+ * \file route_lookup.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A route lookup benchmark program.
+ *
+ * Compares the linear scan of a sorted routes list with the longest-prefix
+ * match trie used by the router.
+ */
+
+#include <freelan/route_trie.hpp>
+
+#include <asiotap/types/ip_route.hpp>
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace
+{
+	const unsigned int ROUTES_COUNT = 10000;
+	const unsigned int LOOKUPS_COUNT = 1000000;
+
+	typedef std::multimap<asiotap::ipv4_network_address, unsigned int> linear_routes_type;
+	typedef freelan::route_trie<boost::asio::ip::address_v4, unsigned int> trie_routes_type;
+
+	unsigned int linear_lookup(const linear_routes_type& routes, const boost::asio::ip::address_v4& addr)
+	{
+		for (auto&& route : routes)
+		{
+			if (has_address(route.first, addr))
+			{
+				return route.second;
+			}
+		}
+
+		return 0;
+	}
+
+	unsigned int trie_lookup(const trie_routes_type& routes, const boost::asio::ip::address_v4& addr)
+	{
+		unsigned int result = 0;
+
+		routes.find(addr, [&result](unsigned int value) {
+			result = value;
+
+			return true;
+		});
+
+		return result;
+	}
+
+	template <typename Function>
+	double measure(const std::vector<boost::asio::ip::address_v4>& addresses, unsigned int& checksum, Function function)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		for (auto&& addr : addresses)
+		{
+			checksum += function(addr);
+		}
+
+		const auto duration = std::chrono::steady_clock::now() - start;
+
+		return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()) / addresses.size();
+	}
+}
+
+int main()
+{
+	std::mt19937 gen(42);
+
+	linear_routes_type linear_routes;
+	trie_routes_type trie_routes;
+
+	std::uniform_int_distribution<uint32_t> address_distribution;
+	std::uniform_int_distribution<unsigned int> prefix_length_distribution(8, 32);
+
+	// Routes are announced by peers: each one gets a distinct value.
+	for (unsigned int i = 1; i <= ROUTES_COUNT; ++i)
+	{
+		const asiotap::ipv4_network_address random_network_address(boost::asio::ip::address_v4(address_distribution(gen)), prefix_length_distribution(gen));
+
+		linear_routes.insert(std::make_pair(asiotap::ipv4_network_address(random_network_address.get_network_address(), random_network_address.prefix_length()), i));
+	}
+
+	for (auto&& route : linear_routes)
+	{
+		trie_routes.insert(route.first, route.second);
+	}
+
+	// Half of the addresses hit a route, the other half is random.
+	std::vector<boost::asio::ip::address_v4> addresses;
+	addresses.reserve(LOOKUPS_COUNT);
+
+	std::vector<asiotap::ipv4_network_address> networks;
+
+	for (auto&& route : linear_routes)
+	{
+		networks.push_back(route.first);
+	}
+
+	std::uniform_int_distribution<size_t> network_distribution(0, networks.size() - 1);
+
+	for (unsigned int i = 0; i < LOOKUPS_COUNT; ++i)
+	{
+		if (i % 2 == 0)
+		{
+			const asiotap::ipv4_network_address& network = networks[network_distribution(gen)];
+			const uint32_t host_mask = (network.prefix_length() == 32) ? 0 : (0xFFFFFFFFu >> network.prefix_length());
+
+			addresses.push_back(boost::asio::ip::address_v4(network.address().to_ulong() | (address_distribution(gen) & host_mask)));
+		}
+		else
+		{
+			addresses.push_back(boost::asio::ip::address_v4(address_distribution(gen)));
+		}
+	}
+
+	// The linear scan is slow: only a sample of the addresses is used for it.
+	const std::vector<boost::asio::ip::address_v4> linear_addresses(addresses.begin(), addresses.begin() + LOOKUPS_COUNT / 100);
+
+	for (auto&& addr : linear_addresses)
+	{
+		if (linear_lookup(linear_routes, addr) != trie_lookup(trie_routes, addr))
+		{
+			std::cerr << "Mismatch for " << addr << std::endl;
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	unsigned int checksum = 0;
+
+	const double linear_duration = measure(linear_addresses, checksum, [&linear_routes](const boost::asio::ip::address_v4& addr) { return linear_lookup(linear_routes, addr); });
+	const double trie_duration = measure(addresses, checksum, [&trie_routes](const boost::asio::ip::address_v4& addr) { return trie_lookup(trie_routes, addr); });
+
+	std::cout << "Routes: " << linear_routes.size() << " (" << trie_routes.node_count() << " trie nodes)" << std::endl;
+	std::cout << "Linear scan: " << linear_duration << " ns/lookup" << std::endl;
+	std::cout << "Trie: " << trie_duration << " ns/lookup" << std::endl;
+	std::cout << "Checksum: " << checksum << std::endl;
+
+	return EXIT_SUCCESS;
+}